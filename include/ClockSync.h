@@ -0,0 +1,84 @@
+/**
+ * @file ClockSync.h
+ * @brief Header file for the clock shared by several spotlights.
+ *
+ * Spotlights in one room run their modes on the same clock, so a color
+ * wheel or cycle started at the same time (see `Protocol::StartAt`) stays in
+ * phase without any traffic per frame. Each unit has its own `millis()`, the
+ * shared clock is an offset to it (see `Spotlight::getTime()`).
+ *
+ * The unit with the lowest chip ID leads: it sends its time to a multicast
+ * group every `Constants::CLOCK_BEACON_INTERVAL`. The others follow the
+ * leader and take over once its beacons stop for
+ * `Constants::CLOCK_LEADER_TIMEOUT`, keeping the clock they followed.
+ *
+ * A unit that joins listens for as long before it leads. It adopts the
+ * clock of any beacon it hears meanwhile, so a restarted leader takes the
+ * lead back with the clock the others kept rather than its own uptime.
+ *
+ * | Offset | Beacon field                          |
+ * |--------|---------------------------------------|
+ * | 0      | magic (u8 'S', u8 'C')                |
+ * | 2      | version (u8, 1)                       |
+ * | 3      | unit ID (u32, little-endian)          |
+ * | 7      | time (u32, little-endian) in ms       |
+ */
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include "Spotlight.h"
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+/**
+ * @class ClockSync
+ * @brief Keeps the clock of the spotlight in step with the other units.
+ *
+ * A beacon arrives late by the network delay, never early, so the largest
+ * offset over `Constants::CLOCK_FILTER_BEACONS` beacons is the closest one.
+ * On a WiFi LAN that is within a few milliseconds, well below a frame.
+ */
+class ClockSync {
+public:
+  /**
+   * @brief Constructor for the ClockSync class.
+   * @param spotlight The spotlight whose clock is shared.
+   */
+  explicit ClockSync(Spotlight *spotlight);
+
+  /**
+   * @brief Sends and receives the beacons. Should be called from the main
+   * loop, it joins the multicast group once WiFi is connected.
+   */
+  void update();
+
+  /**
+   * @brief Checks whether a packet waits for `update()`, e.g. to end the
+   * idle delay of the main loop early.
+   */
+  bool hasPacket() { return _udp.available() > 0; }
+
+  /**
+   * @brief Checks whether this unit's clock is the one shared.
+   */
+  bool isLeader() const;
+
+private:
+  WiFiUDP _udp;
+  Spotlight *_spotlight;
+  uint32_t _id;
+  bool _joined;
+  uint32_t _leaderId;            // The lower unit followed, if any.
+  unsigned long _leaderSeenTime; // millis() of its last beacon, or the join.
+  unsigned long _beaconTime;     // millis() of the last beacon sent.
+  bool _synced;                  // The offset to the leader is set.
+  uint8_t _samples;              // Beacons in the current filter window.
+  unsigned long _bestOffset;     // Largest offset in the window.
+
+  void receive();
+  void sendBeacon();
+  void addSample(unsigned long offset);
+};
+
+#endif
@@ -18,6 +18,12 @@ struct RGB {
   uint8_t r, g, b;
 };
 
+// High resolution RGB color representation used by the output path.
+// Components are unorm16 (0-65535).
+struct RGB16 {
+  uint16_t r, g, b;
+};
+
 // HSL (Hue, Saturation, Lightness) color representation.
 struct HSL {
   float h, s, l;
@@ -29,6 +35,22 @@ struct LCH {
   float l, c, h;
 };
 
+/**
+ * @brief The color space transitions between two colors are blended in.
+ */
+enum class Interpolation : uint8_t {
+  // The LCH of `rgbToLch()`, which is HSL with the saturation scaled to a
+  // chroma. Cheap, but midpoints can be muddy or too bright.
+  Hsl,
+  // OKLCH, the polar form of the perceptual OKLab: lightness and hue stay
+  // even across a transition.
+  Oklch
+};
+
+// The OKLCH chroma represented by the fixed point chroma 65535 (see
+// `fx::fromOklch()`). The most saturated sRGB colors reach about 0.32.
+constexpr float OKLCH_MAX_CHROMA = 0.4f;
+
 /**
  * @brief Overloaded operator for adding two LCH structs.
  */
@@ -46,6 +68,14 @@ LCH operator*(const LCH &a, float scalar);
  */
 LCH operator*(float scalar, const LCH &a);
 
+/**
+ * @brief Overloaded operators for comparing two RGB structs.
+ */
+bool operator==(const RGB &a, const RGB &b);
+bool operator!=(const RGB &a, const RGB &b);
+bool operator==(const RGB16 &a, const RGB16 &b);
+bool operator!=(const RGB16 &a, const RGB16 &b);
+
 /**
  * @brief Converts a Kelvin color temperature to an RGB value.
  * @param kelvin The color temperature in Kelvin (1500-10000).
@@ -76,6 +106,28 @@ LCH rgbToLch(const RGB &rgb);
  */
 RGB lchToRgb(const LCH &lch);
 
+/**
+ * @brief Converts an RGB color to OKLCH.
+ *
+ * The color is taken as sRGB, i.e. decoded to linear light first. This uses
+ * cube roots and is meant for setup time, see `fx::oklchToRgb()` for the
+ * way back per frame.
+ * @param rgb Input RGB color.
+ * @return The OKLCH color: lightness 0.0-1.0, chroma 0.0-0.32 and hue in
+ * degrees.
+ */
+LCH rgbToOklch(const RGB &rgb);
+
+/**
+ * @brief Converts an OKLCH color to RGB, the float reference of
+ * `fx::oklchToRgb()`.
+ *
+ * Colors outside of the sRGB gamut are clipped per channel.
+ * @param lch Input OKLCH color.
+ * @return The resulting RGB color.
+ */
+RGB oklchToRgb(const LCH &lch);
+
 /**
  * @brief Converts an RGB color to HSL.
  * @param rgb Input RGB color.
@@ -103,6 +155,169 @@ void rgbToHsv(const RGB &rgb, float &h, float &s, float &v);
  * @return The resulting RGB color.
  */
 RGB hexToRgb(const String &hexString);
+
+/**
+ * @brief Converts a 6-digit hex string to an RGB color struct, in place.
+ * @param hex The hex digits (e.g., "FF5733"), not necessarily terminated.
+ * @param length The number of characters.
+ * @return The resulting RGB color, black if it isn't a 6-digit hex color.
+ */
+RGB hexToRgb(const char *hex, size_t length);
+
+/**
+ * @brief Parses a comma-separated list of 6-digit hex colors, in place.
+ * @param list The list (e.g., "FF5733,00FF00").
+ * @param colors Array receiving the colors.
+ * @param maxCount The size of the array, further colors are ignored.
+ * @return The number of colors written to the array.
+ */
+size_t hexListToRgb(const char *list, RGB *colors, size_t maxCount);
+
+/**
+ * @brief Fixed point color conversions for the per-frame hot path.
+ *
+ * The ESP8266 has no FPU, so these avoid floating point math entirely.
+ * Lightness, chroma, saturation and value are unorm16 (0-65535 represents
+ * 0.0-1.0). Hue is a binary angle where 65536 is a full turn, so it wraps
+ * around naturally. The float functions above remain the reference and are
+ * used for setup-time conversions like `rgbToLch()`.
+ */
+namespace fx {
+
+// LCH color representation in fixed point.
+struct LCH {
+  uint16_t l, c, h;
+};
+
+/**
+ * @brief Converts a float LCH color to fixed point.
+ * @param lch Input LCH color (as returned by `ColorSpace::rgbToLch()`).
+ * @return The resulting fixed point LCH color.
+ */
+LCH fromLch(const ColorSpace::LCH &lch);
+
+/**
+ * @brief Widens an 8-bit RGB color to 16 bits per channel.
+ * @param rgb Input RGB color.
+ * @return The resulting RGB16 color.
+ */
+RGB16 toRgb16(const RGB &rgb);
+
+/**
+ * @brief Narrows a 16-bit RGB color to 8 bits per channel.
+ * @param rgb Input RGB16 color.
+ * @return The resulting RGB color.
+ */
+RGB toRgb8(const RGB16 &rgb);
+
+/**
+ * @brief Converts a hue in degrees to a binary angle.
+ * @param degrees Hue value (any range, wraps around).
+ * @return The hue as binary angle.
+ */
+uint16_t hueFromDegrees(float degrees);
+
+/**
+ * @brief Interpolates between two fixed point LCH colors.
+ *
+ * Matches `a + (b - a) * t` of the float LCH operators. Lightness and chroma
+ * are clamped, the hue wraps around.
+ * @param a Start color.
+ * @param b End color.
+ * @param t Interpolation factor in Q16 (65536 is 1.0). May overshoot.
+ * @return The interpolated color.
+ */
+LCH interpolate(const LCH &a, const LCH &b, int32_t t);
+
+/**
+ * @brief Converts a float OKLCH color to fixed point.
+ *
+ * Chroma is scaled by `OKLCH_MAX_CHROMA`. Grays get a chroma and hue of 0, so
+ * `interpolateOklch()` can tell that their hue doesn't matter.
+ * @param lch Input OKLCH color (as returned by `ColorSpace::rgbToOklch()`).
+ * @return The resulting fixed point OKLCH color.
+ */
+LCH fromOklch(const ColorSpace::LCH &lch);
+
+/**
+ * @brief Converts an RGB color to the fixed point LCH of an interpolation
+ * space.
+ *
+ * Uses the float conversions, so it is meant for setup time.
+ * @param rgb Input RGB color.
+ * @param space The interpolation space.
+ * @return The resulting fixed point color.
+ */
+LCH fromRgb(const RGB &rgb, Interpolation space);
+
+/**
+ * @brief Interpolates between two fixed point OKLCH colors.
+ *
+ * The hue takes the shorter way around. A gray end takes the hue of the
+ * other end, so fading from or to white doesn't sweep through the wheel.
+ * @param a Start color.
+ * @param b End color.
+ * @param t Interpolation factor in Q16 (65536 is 1.0). May overshoot.
+ * @return The interpolated color.
+ */
+LCH interpolateOklch(const LCH &a, const LCH &b, int32_t t);
+
+/**
+ * @brief Interpolates between two fixed point colors of an interpolation
+ * space.
+ * @param a Start color.
+ * @param b End color.
+ * @param t Interpolation factor in Q16 (65536 is 1.0). May overshoot.
+ * @param space The space of both colors.
+ * @return The interpolated color.
+ */
+LCH interpolate(const LCH &a, const LCH &b, int32_t t, Interpolation space);
+
+/**
+ * @brief Converts a fixed point OKLCH color to RGB.
+ *
+ * The sine of the hue and the sRGB encoding of the channels come from lookup
+ * tables, the rest is integer math. Colors outside of the sRGB gamut are
+ * clipped per channel.
+ * @param lch Input OKLCH color.
+ * @return The resulting RGB16 color.
+ */
+RGB16 oklchToRgb(const LCH &lch);
+
+/**
+ * @brief Converts a fixed point color of an interpolation space to RGB.
+ * @param lch Input color.
+ * @param space The space of the color.
+ * @return The resulting RGB16 color.
+ */
+RGB16 lchToRgb(const LCH &lch, Interpolation space);
+
+/**
+ * @brief Converts a fixed point LCH color to RGB without going through the
+ * intermediate HSL struct.
+ * @param lch Input LCH color.
+ * @return The resulting RGB16 color.
+ */
+RGB16 lchToRgb(const LCH &lch);
+
+/**
+ * @brief Converts a fixed point HSL color to RGB.
+ * @param h Hue as binary angle.
+ * @param s Saturation (unorm16).
+ * @param l Lightness (unorm16).
+ * @return The resulting RGB16 color.
+ */
+RGB16 hslToRgb(uint16_t h, uint16_t s, uint16_t l);
+
+/**
+ * @brief Converts a fixed point HSV color to RGB.
+ * @param h Hue as binary angle.
+ * @param s Saturation (unorm16).
+ * @param v Value/Brightness (unorm16).
+ * @return The resulting RGB16 color.
+ */
+RGB16 hsvToRgb(uint16_t h, uint16_t s, uint16_t v);
+} // namespace fx
 } // namespace ColorSpace
 
 #endif
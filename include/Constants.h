@@ -6,6 +6,8 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
+#include "ColorSpace.h"
+#include "Gamma.h"
 #include <Arduino.h>
 
 namespace Constants {
@@ -13,6 +15,198 @@ namespace Constants {
 // This value is defined here so that memory can be statically allocated
 // at compile time, avoiding dynamic allocation issues.
 const size_t MAX_COLORS = 32;
+
+// The maximum number of fixtures one controller drives (see Spotlight.h).
+// Fits the bits of Spotlight::FixtureMask.
+const size_t MAX_FIXTURES = 16;
+
+// The maximum number of pixels of a fixture, e.g. the LEDs of a strip (see
+// StripOutput.h). Effects spread across the pixels render into one frame
+// buffer of this size (6 bytes per pixel), shared by all fixtures.
+const size_t MAX_PIXELS = 300;
+
+// PCA9685 PWM controllers for fixtures on I2C (see Pca9685.h). Chips are
+// addressed from PCA9685_ADDRESS up. They run at PWM_FREQUENCY.
+const uint8_t PCA9685_ADDRESS = 0x40;
+const uint8_t PCA9685_MAX_CHIPS = 4;
+// The I2C clock in Hz. A frame changing all 16 outputs of a chip takes about
+// 1.5 ms per chip at 400 kHz, the PCA9685 also supports 1 MHz.
+const uint32_t PCA9685_I2C_CLOCK = 400000;
+
+// The total number of RGB16 entries (6 bytes each) of the pre-rendered color
+// cycle gradients. The entries are shared by all transitions of a palette,
+// so a full palette of MAX_COLORS still gets 32 entries per transition.
+const size_t GRADIENT_CACHE_ENTRIES = 1024;
+
+// The space transitions to fixed colors and color cycle transitions are
+// blended in, until changed with Spotlight::setInterpolation().
+const ColorSpace::Interpolation DEFAULT_INTERPOLATION =
+    ColorSpace::Interpolation::Oklch;
+
+// The default rate at which animation frames are rendered, in Hz.
+// Between frames the CPU is left to the web server.
+const uint16_t DEFAULT_FRAME_RATE = 200;
+// The allowed range for the configurable frame rate, in Hz.
+const uint16_t MIN_FRAME_RATE = 1;
+const uint16_t MAX_FRAME_RATE = 1000;
+
+// Time the candle effect takes to glide to the next flicker of its flame,
+// picked at random from this range, in milliseconds.
+const unsigned long CANDLE_MIN_FLICKER = 50;
+const unsigned long CANDLE_MAX_FLICKER = 150;
+
+// Time the running average of the current takes to follow a fall of it, in
+// milliseconds (see Spotlight::getCurrent()). The power limit is lifted as
+// slowly.
+const unsigned long POWER_RELEASE_TIME = 500;
+
+// Time the main loop sleeps per pass while the light is idle (see
+// Spotlight::isIdle()), in milliseconds. It wakes up within a millisecond
+// for UDP packets and requests, new connections and WebSocket messages wait
+// at most this long.
+const unsigned long IDLE_LOOP_DELAY = 10;
+
+// PWM output configuration, applied in PwmOutput::begin().
+// The range is the maximum duty value (10 bit).
+const uint16_t PWM_RANGE = 1023;
+const uint16_t PWM_FREQUENCY = 1000; // In Hz.
+
+// Output curve calibration for the red, green and blue channel. The curves
+// are precomputed into lookup tables in Spotlight::begin(). The gamma is only
+// used by Gamma::Curve::Power, the scale balances the channels.
+const Gamma::Curve OUTPUT_CURVE[3] = {
+    Gamma::Curve::Cie1931, Gamma::Curve::Cie1931, Gamma::Curve::Cie1931};
+const float OUTPUT_GAMMA[3] = {2.2f, 2.2f, 2.2f};
+const float OUTPUT_SCALE[3] = {1.0f, 1.0f, 1.0f};
+
+// Number of sub-step bits resolved by temporal dithering (see
+// Spotlight::setDithering()). A pattern repeats every 2^DITHER_BITS frames,
+// so more bits need a higher frame rate to stay flicker free.
+const uint8_t DITHER_BITS = 2;
+
+// Maximum size of the state record, see Spotlight::saveState(): a header,
+// the settings of each fixture and the palette.
+const size_t MAX_STATE_SIZE = 5 + 27 * MAX_FIXTURES + 6 * MAX_COLORS;
+// Time the state has to stay unchanged before StateStore saves it, in
+// milliseconds. The copy in RTC memory costs no flash wear, so it is kept
+// closer to the current state.
+const unsigned long STATE_SAVE_DELAY = 5000;
+const unsigned long STATE_RTC_SAVE_DELAY = 250;
+// Size of a sector of the state log in flash, see StateStore. Records are
+// appended until it is full, then the log moves on to the next sector.
+const size_t STATE_LOG_SIZE = 4096;
+// The state copy in RTC memory, in 4 byte blocks. The first 32 blocks of
+// the user memory are used by OTA updates.
+const uint32_t STATE_RTC_OFFSET = 32;
+const size_t STATE_RTC_SIZE = 512 - 4 * STATE_RTC_OFFSET;
+
+// Time to wait for the connection to the last known access point on its
+// cached channel, before falling back to a scan, in milliseconds.
+const unsigned long WIFI_FAST_CONNECT_TIMEOUT = 5000;
+
+// Port of the WebSocket control channel (see Protocol.h).
+const uint16_t WEBSOCKET_PORT = 81;
+// Minimum time between two color updates pushed to the WebSocket clients, in
+// milliseconds.
+const unsigned long STATE_PUSH_INTERVAL = 50;
+
+// Clock shared by the spotlights on the network (see ClockSync.h). The
+// beacons go to a multicast group, once per interval.
+const uint16_t CLOCK_PORT = 4049;
+const uint8_t CLOCK_GROUP[4] = {239, 255, 83, 67};
+const unsigned long CLOCK_BEACON_INTERVAL = 1000;
+// Time without beacons from the leader after which the next unit leads, in
+// milliseconds.
+const unsigned long CLOCK_LEADER_TIMEOUT = 3500;
+// Number of beacons the offset to the leader is filtered over.
+const uint8_t CLOCK_FILTER_BEACONS = 8;
+
+// Commands sent to groups of spotlights (see GroupControl.h), on their own
+// multicast group.
+const uint16_t GROUP_PORT = 4050;
+const uint8_t GROUP_ADDRESS[4] = {239, 255, 83, 71};
+// Time within which a command with the same sender and sequence is a retry,
+// in milliseconds.
+const unsigned long GROUP_RETRY_WINDOW = 2000;
+// Most packets read per GroupControl::update().
+const size_t GROUP_PACKETS_PER_UPDATE = 4;
+
+// Real-time streaming over UDP (see UdpStream.h). DDP uses port 4048.
+const uint16_t STREAM_PORT = 4048;
+// Time without streamed colors after which the fixtures go back to their
+// modes, in milliseconds.
+const unsigned long STREAM_TIMEOUT = 2500;
+// Default smoothing time constant of the streamed colors, in milliseconds.
+// 0 shows every packet as it arrives.
+const unsigned long STREAM_SMOOTHING = 0;
+// Most packets read per UdpStream::update(), so a flood can't stall the
+// loop.
+const size_t STREAM_PACKETS_PER_UPDATE = 4;
+
+// Number of HTTP commands the async server backend can hold until the next
+// SpotlightServer::update() (see SPOTLIGHT_ASYNC_SERVER).
+// Each HTTP request takes two to four, its fixture selection, its start time
+// and the commands.
+const size_t COMMAND_QUEUE_LENGTH = 16;
+// Maximum number of commands in a request, on both servers. The queue keeps
+// one entry free and a batch may need a fixture selection queued before it.
+const size_t MAX_BATCH_COMMANDS = COMMAND_QUEUE_LENGTH - 2;
+
+// Keyframe scenes (see Scene.h). Each of the MAX_SCENES slots is a file in
+// LittleFS. The compiled scene played back takes 32 bytes per keyframe.
+const size_t MAX_SCENES = 8;
+const size_t MAX_SCENE_KEYFRAMES = 32;
+// The size of the largest scene file, in bytes.
+const size_t MAX_SCENE_SIZE = 2 + 12 * MAX_SCENE_KEYFRAMES;
+
+// Maximum size of a command batch (see Protocol::applyBatch()), in bytes. The
+// HTTP body carries batches and scenes hex encoded, so it can be twice as
+// long as the larger of them.
+const size_t MAX_BATCH_SIZE = 256;
+const size_t MAX_BODY_SIZE =
+    2 * (MAX_SCENE_SIZE > MAX_BATCH_SIZE ? MAX_SCENE_SIZE : MAX_BATCH_SIZE) +
+    64;
+
+// Length of the windows /metrics aggregates timings over, in milliseconds.
+const unsigned long METRICS_WINDOW = 10000;
+// Number of routes /metrics keeps request timings for.
+const size_t METRICS_MAX_ROUTES = 28;
+// Size of the static buffer /metrics is rendered into.
+const size_t METRICS_BUFFER_SIZE = 1024;
+
+// Size of the static buffer /state is rendered into, enough for
+// MAX_FIXTURES fixtures in their longest modes and a full palette.
+const size_t STATE_SNAPSHOT_SIZE = 4096;
+// Number of clients /events streams state changes to at once.
+const size_t MAX_EVENT_CLIENTS = 4;
+// Time after which an idle event stream gets a comment, so clients that
+// went away are noticed, in milliseconds.
+const unsigned long EVENT_KEEPALIVE_INTERVAL = 15000;
+// Time an event may take to reach a client before the client is dropped, in
+// milliseconds. Events are written as far as the client takes them, without
+// blocking the loop.
+const unsigned long EVENT_SEND_TIMEOUT = 5000;
+
+// Size of the static buffer /latency is rendered into (latency benchmark
+// builds only).
+const size_t LATENCY_BUFFER_SIZE = 256;
+
+// Size of the ring buffer log lines wait in until Serial has room for them.
+const size_t LOG_BUFFER_SIZE = 1024;
+// Maximum length of a log line including the prefix, longer lines are cut.
+const size_t LOG_LINE_LENGTH = 128;
+
+// Size of the static buffer /trace is rendered into (tracing builds only).
+const size_t TRACE_BUFFER_SIZE = 4096;
+
+// Maximum length of a served file path including the terminator. The files
+// in data/ are named well below this, longer paths get a 404.
+const size_t MAX_PATH_LENGTH = 32;
+// Number of static files whose entity tags are kept in RAM.
+const size_t ETAG_CACHE_ENTRIES = 8;
+// Cache-Control header of the static files. Browsers revalidate them on
+// every load, which costs a "304 Not Modified" once they are cached.
+const char *const ASSET_CACHE_CONTROL = "no-cache";
 } // namespace Constants
 
 #endif
@@ -8,9 +8,23 @@
 
 #include <Arduino.h>
 
+// The number of segments of each precomputed easing table is
+// 2^EASING_TABLE_BITS (e.g. 8 -> 256 segments, 257 entries per function).
+// Can be overridden with a build flag, e.g. `-D EASING_TABLE_BITS=6`.
+#ifndef EASING_TABLE_BITS
+#define EASING_TABLE_BITS 8
+#endif
+
 // Easing functions based on Robert Penner's easing equations.
 namespace Easing {
 
+// Fixed point type with 16 fractional bits, i.e. 65536 represents 1.0.
+// Signed, because some easing functions (elastic, back) overshoot.
+typedef int32_t q16_t;
+const q16_t Q16_ONE = 1L << 16;
+
+const size_t TABLE_SEGMENTS = 1u << EASING_TABLE_BITS;
+
 /**
  * @brief A collection of easing functions for smooth color transitions.
  *
@@ -30,6 +44,9 @@ enum EasingFunction {
   BounceInOut
 };
 
+// The number of entries in `EasingFunction`.
+const size_t EASING_FUNCTION_COUNT = BounceInOut + 1;
+
 /**
  * @brief Gets the eased value for a given time and easing function.
  * @param func The easing function to use.
@@ -38,6 +55,27 @@ enum EasingFunction {
  */
 float getEasedValue(EasingFunction func, float t);
 
+/**
+ * @brief Gets the eased value from the precomputed lookup tables.
+ *
+ * The tables are generated at compile time and stored in flash. Values
+ * between the table entries are linearly interpolated, so no floating point
+ * math is required. This is the fast path for animation frames;
+ * `getEasedValue()` remains the accurate reference implementation.
+ * @param func The easing function to use.
+ * @param t The time value in Q16 (0-Q16_ONE). Larger values are clamped.
+ * @return The eased value in Q16.
+ */
+q16_t getEasedValueQ16(EasingFunction func, uint32_t t);
+
+/**
+ * @brief Float convenience wrapper around `getEasedValueQ16()`.
+ * @param func The easing function to use.
+ * @param t The time value (0.0-1.0). Values outside are clamped.
+ * @return The eased value.
+ */
+float getEasedValueFast(EasingFunction func, float t);
+
 /**
  * @brief Converts an easing function name string to its enum value.
  * @param easingName The name of the easing function (e.g., "linear",
@@ -47,7 +85,27 @@ float getEasedValue(EasingFunction func, float t);
  */
 EasingFunction easingFromString(const String &easingName);
 
+/**
+ * @brief Converts an easing function name to its enum value, in place.
+ * @param easingName The name of the easing function, not necessarily
+ * terminated. Case is ignored.
+ * @param length The length of the name.
+ * @return The corresponding EasingFunction enum value. Defaults to Linear if
+ * not found.
+ */
+EasingFunction easingFromString(const char *easingName, size_t length);
+
+/**
+ * @brief Gets the name of an easing function, as accepted by
+ * `easingFromString()`.
+ * @param func The easing function.
+ * @return The name, e.g. "cubic-in-out".
+ */
+const char *easingName(EasingFunction func);
+
 // --- Specific Easing Function Implementations ---
+// These are the reference implementations used for accuracy tests of the
+// lookup tables.
 float easeLinear(float t);
 float easeSineInOut(float t);
 float easeQuadInOut(float t);
@@ -0,0 +1,464 @@
+/**
+ * @file Effects.h
+ * @brief Header file for the modes a fixture renders, one class per mode.
+ *
+ * An effect is a small trivially copyable class with the parameters of a
+ * mode. Its nested `Runtime` is the progress the renderer keeps, reset
+ * whenever the mode restarts. The effect of each fixture is held in a `Slot`
+ * sized for the largest one, so switching modes never allocates and
+ * `Spotlight`'s double buffered state stays a plain copy.
+ *
+ * The functions at the end dispatch on the index of the held effect with a
+ * compile-time chain of comparisons, not a virtual call. They are defined
+ * next to the effects, so the compiler sees and inlines each effect's
+ * `render()`.
+ *
+ * A new mode is a class with these members, added to the list of `Slot`:
+ *
+ *     struct Runtime { ... };
+ *     void render(Runtime &runtime, const Context &context,
+ *                 Canvas &canvas) const;
+ *     void save(RecordWriter &out) const; // RECORD_PARAMS_SIZE at most.
+ *     bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+ *     // No frame would change the output anymore, see isIdle() below.
+ *     bool isIdle(const Runtime &runtime) const;
+ *
+ * Its index in the list is its mode in the state record, see
+ * `Spotlight::saveState()`.
+ */
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "ColorSpace.h"
+#include "Easing.h"
+#include "GradientCache.h"
+#include "Scene.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <new>
+#include <tuple>
+#include <type_traits>
+
+namespace Effects {
+
+// The bytes of the state record each effect can store its parameters in.
+const size_t RECORD_PARAMS_SIZE = 8;
+
+// Little-endian cursors over the state record, like the protocol messages.
+struct RecordWriter {
+  uint8_t *p;
+  void put8(uint8_t v) { *p++ = v; }
+  void put16(uint16_t v) {
+    put8(v & 0xFF);
+    put8(v >> 8);
+  }
+  void put32(uint32_t v) {
+    put16(v & 0xFFFF);
+    put16(v >> 16);
+  }
+  void putLch(const ColorSpace::fx::LCH &lch) {
+    put16(lch.l);
+    put16(lch.c);
+    put16(lch.h);
+  }
+};
+
+struct RecordReader {
+  const uint8_t *p;
+  uint8_t get8() { return *p++; }
+  uint16_t get16() {
+    uint16_t v = get8();
+    return v | (get8() << 8);
+  }
+  uint32_t get32() {
+    uint32_t v = get16();
+    return v | (static_cast<uint32_t>(get16()) << 16);
+  }
+  ColorSpace::fx::LCH getLch() {
+    ColorSpace::fx::LCH lch;
+    lch.l = get16();
+    lch.c = get16();
+    lch.h = get16();
+    return lch;
+  }
+};
+
+/**
+ * @brief The settings of a fixture that outlive its mode, e.g. the duration
+ * of the next transition.
+ */
+struct Settings {
+  unsigned long fadeDuration; // To a fixed color, in ms.
+  Easing::EasingFunction fadeEasing;
+  unsigned long cycleDuration; // Per color cycle transition, in ms.
+  Easing::EasingFunction cycleEasing;
+  uint16_t wheelSpread; // Across all pixels, 65535 = a full turn.
+};
+
+/**
+ * @brief What an effect renders a frame from, besides its own parameters.
+ *
+ * The palette and the scene are shared by all fixtures.
+ */
+struct Context {
+  unsigned long elapsed; // Since the mode started, in ms.
+  const Settings &settings;
+  ColorSpace::Interpolation interpolation;
+  GradientCache &gradients;
+  size_t colorCount; // Of the palette.
+  bool isRandom;     // The palette is cycled in random order.
+  const Scene &scene;
+};
+
+/**
+ * @brief The pixels of the fixture being rendered.
+ *
+ * An effect either fills the whole fixture with one color, writes every
+ * pixel, or leaves the output as it is.
+ */
+class Canvas {
+public:
+  enum class Result : uint8_t { Unchanged, Filled, Pixels };
+
+  /**
+   * @param pixels The frame buffer, at least count pixels.
+   * @param count The number of pixels of the fixture.
+   * @param shown The color the fixture shows, i.e. its first pixel.
+   * @param needsRefresh True if the output has to be written again even if
+   * it didn't change, see `Output::needsRefresh()`.
+   */
+  Canvas(ColorSpace::RGB16 *pixels, size_t count,
+         const ColorSpace::RGB16 &shown, bool needsRefresh)
+      : _pixels(pixels), _count(count), _shown(shown),
+        _needsRefresh(needsRefresh), _color{0, 0, 0},
+        _result(Result::Unchanged) {}
+
+  size_t size() const { return _count; }
+  const ColorSpace::RGB16 &shown() const { return _shown; }
+  bool needsRefresh() const { return _needsRefresh; }
+
+  /**
+   * @brief Shows one color on all pixels.
+   */
+  void fill(const ColorSpace::RGB16 &color) {
+    _color = color;
+    _result = Result::Filled;
+  }
+
+  /**
+   * @brief Gets the frame buffer, the caller has to write all `size()`
+   * pixels.
+   */
+  ColorSpace::RGB16 *pixels() {
+    _result = Result::Pixels;
+    return _pixels;
+  }
+
+  Result result() const { return _result; }
+  const ColorSpace::RGB16 &color() const { return _color; }
+
+private:
+  ColorSpace::RGB16 *_pixels;
+  size_t _count;
+  ColorSpace::RGB16 _shown;
+  bool _needsRefresh;
+  ColorSpace::RGB16 _color;
+  Result _result;
+};
+
+/**
+ * @brief Keeps the color shown, e.g. one set with
+ * `Spotlight::setColorTemperature()`.
+ */
+struct Static {
+  struct Runtime {};
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const {}
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const { return true; }
+};
+
+/**
+ * @brief Fades to a fixed color, then keeps it.
+ */
+struct Fade {
+  ColorSpace::fx::LCH start; // In the interpolation space.
+  ColorSpace::fx::LCH end;
+  struct Runtime {
+    bool done;
+  };
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const {}
+  // The end is the color of the record, the start black.
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const { return runtime.done; }
+};
+
+/**
+ * @brief Rotates the hue around the color wheel, at full saturation and
+ * value. Spread across the pixels with `Settings::wheelSpread`.
+ */
+struct Wheel {
+  uint16_t startHue; // Binary angle.
+  unsigned long period; // Of a full turn in ms, more than 0.
+  bool counterClockwise;
+  struct Runtime {};
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const;
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const { return period == 0; }
+};
+
+/**
+ * @brief Blends through the shared palette.
+ */
+struct Cycle {
+  struct Runtime {
+    unsigned long transitionStart; // Context::elapsed it started at.
+    uint8_t colorIndex;
+    uint8_t previousIndex; // The color the transition starts from.
+    bool empty; // The palette has no colors, nothing is shown.
+  };
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const {}
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const { return runtime.empty; }
+};
+
+/**
+ * @brief Plays the shared keyframe scene.
+ */
+struct Playback {
+  ColorSpace::fx::LCH entry; // Shown when the scene started, HSL based.
+  struct Runtime {
+    uint8_t cursor; // See Scene::sample().
+    bool done; // The scene holds its last color.
+  };
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const {}
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const { return runtime.done; }
+};
+
+/**
+ * @brief Pulses the brightness of a color up and down, easing in and out.
+ */
+struct Breathe {
+  ColorSpace::RGB16 color; // At full brightness.
+  unsigned long period; // Of a breath in ms, 0 shows the color.
+  uint8_t minimum; // The lowest brightness, 255 = full.
+  struct Runtime {};
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const;
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const {
+    return period == 0 || minimum == 255;
+  }
+};
+
+/**
+ * @brief Flashes a color, black in between.
+ */
+struct Strobe {
+  ColorSpace::RGB16 color;
+  unsigned long period; // Of a flash and the pause in ms, 0 shows the color.
+  uint8_t duty; // The part of the period the color is on, 255 = always.
+  struct Runtime {};
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const;
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const {
+    return period == 0 || duty == 255;
+  }
+};
+
+/**
+ * @brief Flickers a color like a candle flame. The brightness glides to a
+ * random dip every `Constants::CANDLE_MIN_FLICKER` -
+ * `Constants::CANDLE_MAX_FLICKER` ms.
+ */
+struct Candle {
+  ColorSpace::RGB16 color; // At full brightness.
+  uint8_t intensity; // The deepest dip, 255 = down to black.
+  struct Runtime {
+    unsigned long segmentStart; // Context::elapsed the glide started at.
+    unsigned long segmentLength;
+    uint16_t from = 65535; // Brightness, unorm16.
+    uint16_t to = 65535;
+  };
+  void render(Runtime &runtime, const Context &context, Canvas &canvas) const;
+  void save(RecordWriter &out) const;
+  bool restore(RecordReader &in, const ColorSpace::fx::LCH &color);
+  bool isIdle(const Runtime &runtime) const { return intensity == 0; }
+};
+
+/**
+ * @brief Holds one of the effects Ts, like a std::variant without
+ * exceptions or a heap.
+ *
+ * The effects have to be trivially copyable, so a slot copies as plain
+ * memory.
+ */
+template <typename... Ts> class BasicSlot {
+public:
+  static const uint8_t COUNT = sizeof...(Ts);
+
+  template <size_t I>
+  using Type = typename std::tuple_element<I, std::tuple<Ts...>>::type;
+
+  // The index of the effect T in Ts.
+  template <typename T> static constexpr uint8_t indexOf() {
+    return IndexOf<T, Ts...>::value;
+  }
+
+  /**
+   * @brief Storage for the runtime of whichever effect the slot holds.
+   */
+  class Runtime {
+  public:
+    template <typename T> typename T::Runtime &reset() {
+      return *new (_storage) typename T::Runtime();
+    }
+    template <typename T> typename T::Runtime &get() {
+      return *reinterpret_cast<typename T::Runtime *>(_storage);
+    }
+    template <typename T> const typename T::Runtime &get() const {
+      return *reinterpret_cast<const typename T::Runtime *>(_storage);
+    }
+
+  private:
+    alignas(typename Ts::Runtime...) unsigned char _storage[std::max(
+        {sizeof(typename Ts::Runtime)...})];
+  };
+
+  // Starts out holding the first effect, value initialized.
+  BasicSlot() { emplace<Type<0>>(); }
+
+  uint8_t index() const { return _index; }
+
+  template <typename T> bool is() const { return _index == indexOf<T>(); }
+
+  // Only valid while the slot holds a T.
+  template <typename T> T &get() {
+    return *reinterpret_cast<T *>(_storage);
+  }
+  template <typename T> const T &get() const {
+    return *reinterpret_cast<const T *>(_storage);
+  }
+
+  // Replaces the effect, with T's members initialized from args in order.
+  template <typename T, typename... Args> T &emplace(Args &&...args) {
+    _index = indexOf<T>();
+    return *new (_storage) T{std::forward<Args>(args)...};
+  }
+
+  /**
+   * @brief Calls f with the held effect.
+   */
+  template <typename F> void visit(F &&f) const { visitFrom<0>(f); }
+  template <typename F> void visit(F &&f) { visitFrom<0>(f); }
+
+  /**
+   * @brief Calls f with a value initialized effect of the given index, which
+   * the slot holds afterwards.
+   * @return False, leaving the slot unchanged, if there is no such effect.
+   */
+  template <typename F> bool emplaceIndex(uint8_t index, F &&f) {
+    return emplaceFrom<0>(index, f);
+  }
+
+private:
+  template <typename T, typename U, typename... Rest> struct IndexOf {
+    static constexpr uint8_t value = 1 + IndexOf<T, Rest...>::value;
+  };
+  template <typename T, typename... Rest> struct IndexOf<T, T, Rest...> {
+    static constexpr uint8_t value = 0;
+  };
+
+  template <size_t I, typename F> void visitFrom(F &f) const {
+    if constexpr (I + 1 < COUNT) {
+      if (_index != I) {
+        visitFrom<I + 1>(f);
+        return;
+      }
+    }
+    f(get<Type<I>>());
+  }
+  template <size_t I, typename F> void visitFrom(F &f) {
+    if constexpr (I + 1 < COUNT) {
+      if (_index != I) {
+        visitFrom<I + 1>(f);
+        return;
+      }
+    }
+    f(get<Type<I>>());
+  }
+
+  template <size_t I, typename F> bool emplaceFrom(uint8_t index, F &f) {
+    if (index == I) {
+      return f(emplace<Type<I>>());
+    }
+    if constexpr (I + 1 < COUNT) {
+      return emplaceFrom<I + 1>(index, f);
+    }
+    return false;
+  }
+
+  static_assert(COUNT > 0 && COUNT < 255, "Too many effects");
+  static_assert((std::is_trivially_copyable<Ts>::value && ...),
+                "Effects are copied as plain memory");
+
+  alignas(Ts...) unsigned char _storage[std::max({sizeof(Ts)...})];
+  uint8_t _index;
+};
+
+// The modes a fixture can be in. Appending keeps the state record valid.
+typedef BasicSlot<Static, Fade, Wheel, Cycle, Playback, Breathe, Strobe,
+                  Candle>
+    Slot;
+
+/**
+ * @brief Resets the runtime for the effect in the slot, so it renders from
+ * its beginning.
+ */
+void restart(const Slot &slot, Slot::Runtime &runtime);
+
+/**
+ * @brief Renders a frame of the effect in the slot.
+ * @param slot The effect.
+ * @param runtime Its runtime, reset by `restart()` when it started.
+ * @param context The time into the mode and the shared state.
+ * @param canvas Where to render to.
+ */
+void render(const Slot &slot, Slot::Runtime &runtime, const Context &context,
+            Canvas &canvas);
+
+/**
+ * @brief Checks whether rendering the effect in the slot again would leave
+ * the output as it is, e.g. once a fade reached its color.
+ * @param slot The effect.
+ * @param runtime Its runtime, as left by the last `render()`.
+ */
+bool isIdle(const Slot &slot, const Slot::Runtime &runtime);
+
+/**
+ * @brief Writes the parameters of the effect in the slot, padded to
+ * `RECORD_PARAMS_SIZE`.
+ */
+void save(const Slot &slot, RecordWriter &out);
+
+/**
+ * @brief Reads the parameters written by `save()` into the slot.
+ * @param slot The slot, unchanged if the parameters are invalid.
+ * @param mode The index of the effect.
+ * @param in The parameters, `RECORD_PARAMS_SIZE` bytes are consumed.
+ * @param color The color of the fixture in the record, in the interpolation
+ * space.
+ * @return False if there is no such effect or its parameters are invalid.
+ */
+bool restore(Slot &slot, uint8_t mode, RecordReader &in,
+             const ColorSpace::fx::LCH &color);
+} // namespace Effects
+
+#endif
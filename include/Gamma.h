@@ -0,0 +1,65 @@
+/**
+ * @file Gamma.h
+ * @brief Header file for the output linearization lookup tables.
+ *
+ * LEDs respond linearly to the PWM duty cycle, but perceived brightness
+ * doesn't. These tables map the linear unorm16 channel values of the color
+ * path to PWM duty values, so that dimming looks even.
+ */
+
+#ifndef GAMMA_H
+#define GAMMA_H
+
+#include <Arduino.h>
+
+namespace Gamma {
+
+/**
+ * @brief The curve used to map channel values to PWM duty values.
+ */
+enum class Curve {
+  Linear,
+  Power,  // duty = value^gamma
+  Cie1931 // Inverse of the CIE 1931 lightness (L*) function.
+};
+
+// Number of fractional bits of the values returned by `Table::apply()`.
+// The output is a PWM duty in 1/64 steps, leaving the sub-step precision
+// to the output stage.
+const uint8_t FRACTION_BITS = 6;
+
+/**
+ * @class Table
+ * @brief A lookup table for one output channel, with linear interpolation
+ * between the entries.
+ */
+class Table {
+public:
+  /**
+   * @brief Fills the table.
+   *
+   * This evaluates the curve with floating point math and is meant to be run
+   * once during setup, never per frame.
+   * @param curve The curve to use.
+   * @param gamma The exponent for `Curve::Power`.
+   * @param scale Scales the output (0.0-1.0), e.g. to balance channels.
+   * @param pwmRange The maximum PWM duty value (at most 1023).
+   */
+  void build(Curve curve, float gamma, float scale, uint16_t pwmRange);
+
+  /**
+   * @brief Maps a channel value to a PWM duty.
+   * @param value The linear channel value (unorm16).
+   * @return The PWM duty with `FRACTION_BITS` fractional bits.
+   */
+  uint16_t apply(uint16_t value) const;
+
+private:
+  static const uint8_t INDEX_BITS = 8;
+  static const size_t SEGMENTS = 1u << INDEX_BITS;
+
+  uint16_t _entries[SEGMENTS + 1];
+};
+} // namespace Gamma
+
+#endif
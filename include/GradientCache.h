@@ -0,0 +1,85 @@
+/**
+ * @file GradientCache.h
+ * @brief Header file for the pre-rendered color cycle gradients.
+ */
+
+#ifndef GRADIENTCACHE_H
+#define GRADIENTCACHE_H
+
+#include "ColorSpace.h"
+#include "Constants.h"
+#include <Arduino.h>
+
+/**
+ * @class GradientCache
+ * @brief Pre-renders the transitions between palette colors into RGB ramps.
+ *
+ * The palette of the color cycle mode only changes on an API call, so the
+ * interpolation and conversion to RGB of each transition can be done once,
+ * in either interpolation space. Ramps are indexed by the eased progress, so
+ * the easing function can change without invalidating them, and a frame only
+ * costs a lookup and a linear interpolation between two ramp entries.
+ */
+class GradientCache {
+public:
+  GradientCache();
+
+  /**
+   * @brief Sets the palette and pre-renders its transitions.
+   *
+   * With `precompute` set, every transition from `colors[i]` to
+   * `colors[i + 1]` (wrapping around) gets its own ramp. Otherwise, used for
+   * random order, `prepare()` renders a single ramp whenever a new transition
+   * starts.
+   * The number of entries per ramp is chosen so that all ramps fit in
+   * `Constants::GRADIENT_CACHE_ENTRIES`.
+   * @param colors The palette. Must stay valid while the cache is in use.
+   * @param count The number of colors (max `Constants::MAX_COLORS`).
+   * @param precompute True to render all sequential transitions up front.
+   * @param space The interpolation space of the colors.
+   */
+  void build(const ColorSpace::fx::LCH *colors, size_t count, bool precompute,
+             ColorSpace::Interpolation space);
+
+  /**
+   * @brief Renders the ramp of a transition that isn't precomputed.
+   *
+   * Does nothing if the transition already has a ramp.
+   * @param from Palette index of the start color.
+   * @param to Palette index of the end color.
+   */
+  void prepare(size_t from, size_t to);
+
+  /**
+   * @brief Gets the color of a transition.
+   *
+   * Transitions without a ramp, e.g. of a fixture that started its random
+   * transition before another one, are converted directly.
+   * @param from Palette index of the start color.
+   * @param to Palette index of the end color.
+   * @param t Eased progress in Q16. Values outside 0.0-1.0 (overshooting
+   * easing functions) are converted directly instead of using a ramp.
+   * @return The resulting RGB16 color.
+   */
+  ColorSpace::RGB16 sample(size_t from, size_t to, int32_t t);
+
+private:
+  static const uint16_t MAX_STEPS = 256;
+
+  const ColorSpace::fx::LCH *_colors;
+  size_t _count;
+  bool _precomputed;
+  ColorSpace::Interpolation _space;
+  uint16_t _steps; // The number of entries per ramp minus one.
+
+  // Palette indices each ramp was rendered for.
+  uint8_t _rampFrom[Constants::MAX_COLORS];
+  uint8_t _rampTo[Constants::MAX_COLORS];
+
+  ColorSpace::RGB16 _entries[Constants::GRADIENT_CACHE_ENTRIES];
+
+  void renderRamp(size_t ramp, size_t from, size_t to);
+  ColorSpace::RGB16 convert(size_t from, size_t to, int32_t t) const;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file GroupControl.h
+ * @brief Header file for the commands sent to a group of spotlights at once.
+ *
+ * All spotlights listen on one multicast group, so a dashboard controls a
+ * whole fleet with a single UDP packet instead of a HTTP request per unit.
+ * Each unit is a member of up to 32 groups (see `SPOTLIGHT_GROUPS`), a
+ * command addresses a set of them. Multi-byte values are little-endian.
+ *
+ * | Offset | Command field                                            |
+ * |--------|----------------------------------------------------------|
+ * | 0      | magic (u8 'S', u8 'G')                                   |
+ * | 2      | version (u8, 1)                                          |
+ * | 3      | flags (u8, 0x01 = acknowledge)                           |
+ * | 4      | groups (u32, bit i addresses group i)                    |
+ * | 8      | sequence (u16), the same for retries of a command        |
+ * | 10     | a batch of commands, see Protocol.h                      |
+ *
+ * A unit applies a command if it is a member of any addressed group. A
+ * retry arriving within `Constants::GROUP_RETRY_WINDOW` isn't applied
+ * again, but acknowledged again if requested. The acknowledgement goes back
+ * to the sender only:
+ *
+ * | Offset | Acknowledgement field                                    |
+ * |--------|----------------------------------------------------------|
+ * | 0      | magic (u8 'S', u8 'A')                                   |
+ * | 2      | version (u8, 1)                                          |
+ * | 3      | status (u8, 0 = applied, 1 = invalid batch)              |
+ * | 4      | sequence (u16) of the command                            |
+ * | 6      | unit ID (u32)                                            |
+ * | 10     | digest (u32), CRC32 of Spotlight::saveState()'s record   |
+ *
+ * Units reporting the same digest show the same modes and colors, so the
+ * dashboard sees at a glance whether the fleet is in step.
+ */
+
+#ifndef GROUPCONTROL_H
+#define GROUPCONTROL_H
+
+#include "Spotlight.h"
+#include "config.h"
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+// The groups this unit is a member of, bit i is group i. The default is
+// group 0 only, set it per unit in config.h.
+#ifndef SPOTLIGHT_GROUPS
+#define SPOTLIGHT_GROUPS 0x00000001UL
+#endif
+
+/**
+ * @class GroupControl
+ * @brief Applies the group commands received over multicast.
+ */
+class GroupControl {
+public:
+  /**
+   * @brief Constructor for the GroupControl class.
+   * @param spotlight The spotlight to control.
+   */
+  explicit GroupControl(Spotlight *spotlight);
+
+  /**
+   * @brief Receives the commands. Should be called from the main loop, it
+   * joins the multicast group once WiFi is connected.
+   */
+  void update();
+
+  /**
+   * @brief Checks whether a packet waits for `update()`, e.g. to end the
+   * idle delay of the main loop early.
+   */
+  bool hasPacket() { return _udp.available() > 0; }
+
+  /**
+   * @brief Sets the groups this unit is a member of.
+   * @param groups The groups, bit i is group i.
+   */
+  void setGroups(uint32_t groups);
+
+private:
+  WiFiUDP _udp;
+  Spotlight *_spotlight;
+  uint32_t _id;
+  uint32_t _groups;
+  bool _joined;
+
+  // The last command applied, to recognize its retries.
+  IPAddress _lastSender;
+  uint16_t _lastSequence;
+  unsigned long _lastCommandTime; // millis(), 0 for none.
+
+  void handlePacket(size_t size);
+  void sendAck(uint16_t sequence, uint8_t status);
+};
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file JsonWriter.h
+ * @brief Header file for the JSON responses rendered into static buffers.
+ */
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <Arduino.h>
+
+/**
+ * @class JsonWriter
+ * @brief Appends to a buffer with snprintf(), remembering if anything was
+ * cut off.
+ */
+class JsonWriter {
+public:
+  /**
+   * @param buffer The buffer to write to.
+   * @param size The size of the buffer.
+   */
+  JsonWriter(char *buffer, size_t size);
+
+  /**
+   * @brief Appends formatted text, like printf().
+   */
+  void append(const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  /**
+   * @brief Gets the length of the text, or 0 if it didn't fit.
+   */
+  size_t length() const;
+
+private:
+  char *_buffer;
+  size_t _size;
+  size_t _length;
+  bool _overflow;
+};
+
+#endif
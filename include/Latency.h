@@ -0,0 +1,83 @@
+/**
+ * @file Latency.h
+ * @brief Header file for the command-to-photon latency benchmark.
+ *
+ * Building with SPOTLIGHT_LATENCY=1 (env:nodemcuv2_latency) timestamps every
+ * command three times: when the server has received it, when `Spotlight`
+ * publishes the state change, and when `writeLeds()` first writes the
+ * changed output. The percentiles of the last `Latency::SAMPLES` commands are
+ * served at /latency, scripts/latency_bench.py drives the benchmark.
+ * Otherwise the macros compile to nothing.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+
+#ifndef SPOTLIGHT_LATENCY
+#define SPOTLIGHT_LATENCY 0
+#endif
+
+namespace Latency {
+
+// Number of recent commands the percentiles are computed over.
+const size_t SAMPLES = 256;
+
+#if SPOTLIGHT_LATENCY
+
+/**
+ * @brief Timestamps the receipt of a command.
+ *
+ * Must be paired with `applied()` or, if the command is rejected,
+ * `discard()`.
+ */
+void received();
+
+/**
+ * @brief Forgets the last received command, it was rejected.
+ */
+void discard();
+
+/**
+ * @brief Timestamps the state change of all received commands.
+ */
+void applied();
+
+/**
+ * @brief Timestamps the output of all applied commands.
+ */
+void written();
+
+/**
+ * @brief Clears all samples.
+ */
+void reset();
+
+/**
+ * @brief Writes the percentiles as compact JSON, in microseconds.
+ *
+ * "apply" is the time from receipt to the state change, "render" from the
+ * state change to the output and "total" from receipt to output.
+ * @param buffer The buffer to write to.
+ * @param size The size of the buffer.
+ * @return The length of the JSON, 0 if the buffer is too small.
+ */
+size_t toJson(char *buffer, size_t size);
+
+#define LATENCY_RECEIVED() Latency::received()
+#define LATENCY_DISCARD() Latency::discard()
+#define LATENCY_APPLIED() Latency::applied()
+#define LATENCY_WRITTEN() Latency::written()
+
+#else
+
+#define LATENCY_RECEIVED() ((void)0)
+#define LATENCY_DISCARD() ((void)0)
+#define LATENCY_APPLIED() ((void)0)
+#define LATENCY_WRITTEN() ((void)0)
+
+#endif
+} // namespace Latency
+
+#endif
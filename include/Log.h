@@ -0,0 +1,109 @@
+/**
+ * @file Log.h
+ * @brief Header file for the leveled, buffered logger.
+ *
+ * Log lines are formatted into a ring buffer and only written to Serial by
+ * `Log::drain()`, which never writes more than the UART FIFO has room for.
+ * Logging from a request handler therefore never waits for the UART.
+ *
+ * Lines above SPOTLIGHT_LOG_LEVEL (0 none, 1 errors, 2 warnings, 3 info,
+ * 4 debug) are compiled out. Below that, `Log::setLevel()` selects what is
+ * logged at runtime, where a disabled line costs a level check.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+
+#ifndef SPOTLIGHT_LOG_LEVEL
+#define SPOTLIGHT_LOG_LEVEL 4
+#endif
+
+namespace Log {
+
+enum Level : uint8_t { None, Error, Warning, Info, Debug };
+
+/**
+ * @brief Selects the lines logged from now on.
+ * @param level The most verbose level to log.
+ */
+void setLevel(Level level);
+
+/**
+ * @brief Gets the most verbose level logged.
+ */
+Level level();
+
+/**
+ * @brief Checks whether lines of a level are logged.
+ */
+inline bool isEnabled(Level lineLevel) { return lineLevel <= level(); }
+
+/**
+ * @brief Parses a level name ("none", "error", "warning", "info", "debug").
+ * @param name The name, case insensitive.
+ * @param level Set to the level if the name is known.
+ * @return True if the name is known.
+ */
+bool levelFromString(const char *name, Level &level);
+
+/**
+ * @brief Formats a line into the buffer.
+ *
+ * A line that doesn't fit into the buffer is dropped, and counted in a note
+ * written once there's room again. Use the LOG_* macros instead, which skip
+ * the formatting for disabled levels.
+ * @param lineLevel The level of the line.
+ * @param format The printf format, without the trailing newline.
+ */
+void write(Level lineLevel, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Writes as much of the buffer to Serial as fits without blocking.
+ *
+ * Should be called from idle time, e.g. at the end of `loop()`.
+ */
+void drain();
+
+/**
+ * @brief Writes the whole buffer to Serial, blocking until it's empty.
+ *
+ * Only meant for places where blocking is fine, e.g. in `setup()`.
+ */
+void flush();
+} // namespace Log
+
+#define LOG_AT(lineLevel, ...)                                                 \
+  do {                                                                         \
+    if (Log::isEnabled(lineLevel)) {                                           \
+      Log::write(lineLevel, __VA_ARGS__);                                      \
+    }                                                                          \
+  } while (0)
+
+#if SPOTLIGHT_LOG_LEVEL >= 1
+#define LOG_ERROR(...) LOG_AT(Log::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if SPOTLIGHT_LOG_LEVEL >= 2
+#define LOG_WARNING(...) LOG_AT(Log::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+
+#if SPOTLIGHT_LOG_LEVEL >= 3
+#define LOG_INFO(...) LOG_AT(Log::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if SPOTLIGHT_LOG_LEVEL >= 4
+#define LOG_DEBUG(...) LOG_AT(Log::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#endif
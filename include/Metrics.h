@@ -0,0 +1,102 @@
+/**
+ * @file Metrics.h
+ * @brief Header file for the runtime telemetry served at /metrics.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "Constants.h"
+#include <Arduino.h>
+
+/**
+ * @class Metrics
+ * @brief Collects loop, update and request timings with a fixed memory
+ * footprint.
+ *
+ * Timings are aggregated over windows of `Constants::METRICS_WINDOW`
+ * milliseconds. The averages and maxima reported are those of the last
+ * complete window, the counts are totals since boot.
+ */
+class Metrics {
+public:
+  /**
+   * @brief Aggregated durations of one kind of work.
+   */
+  struct Timing {
+    uint32_t count; // Since boot.
+
+    // The window being collected.
+    uint32_t windowCount;
+    uint32_t windowTotal;
+    uint32_t windowMax;
+
+    // The last complete window.
+    uint32_t lastAverage;
+    uint32_t lastMax;
+
+    void record(uint32_t micros);
+    void roll();
+  };
+
+  Metrics();
+
+  /**
+   * @brief Counts a main loop iteration and closes the window when it's due.
+   *
+   * Should be called once at the end of `loop()`.
+   */
+  void countLoop();
+
+  /**
+   * @brief Records the duration of a `Spotlight::update()` call.
+   * @param micros The duration in microseconds.
+   */
+  void recordUpdate(uint32_t micros);
+
+  /**
+   * @brief Records the time the server spent handling clients.
+   * @param micros The duration in microseconds.
+   */
+  void recordHandleClient(uint32_t micros);
+
+  /**
+   * @brief Registers a route for request timing.
+   * @param uri The route, must outlive this object (e.g. a string literal).
+   * @return The index to pass to `recordRequest()`, -1 if all
+   * `Constants::METRICS_MAX_ROUTES` are taken.
+   */
+  int addRoute(const char *uri);
+
+  /**
+   * @brief Records the handling of a request.
+   * @param route The index returned by `addRoute()`, ignored if negative.
+   * @param micros The duration in microseconds.
+   */
+  void recordRequest(int route, uint32_t micros);
+
+  /**
+   * @brief Writes all metrics as compact JSON.
+   * @param buffer The buffer to write to.
+   * @param size The size of the buffer.
+   * @return The length of the JSON, or 0 if it didn't fit.
+   */
+  size_t toJson(char *buffer, size_t size);
+
+private:
+  unsigned long _windowStart;
+  uint32_t _windowLoops;
+  uint32_t _loopsPerSecond; // Of the last complete window.
+
+  Timing _update;
+  Timing _handleClient;
+
+  struct Route {
+    const char *uri;
+    Timing timing;
+  };
+  Route _routes[Constants::METRICS_MAX_ROUTES];
+  size_t _routeCount;
+};
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ * @file Output.h
+ * @brief Header file for the output backends a fixture is drawn on.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "ColorSpace.h"
+#include "Gamma.h"
+#include "Pca9685.h"
+#include "config.h"
+#include <Arduino.h>
+
+// The current model of the power limiter, for outputs not given their own
+// with Output::setChannelCurrent(), calibrate it in config.h: the current
+// the red, green and blue LED of a pixel draw at full duty, in mA. The
+// values are passed as arguments, so use commas.
+#ifndef SPOTLIGHT_CHANNEL_CURRENT
+#define SPOTLIGHT_CHANNEL_CURRENT 20, 20, 20
+#endif
+
+/**
+ * @class Output
+ * @brief The hardware a fixture is connected to.
+ *
+ * `Spotlight` renders each frame of a fixture as linear RGB16 pixels and
+ * hands them to its output, which maps them through the output curves and
+ * buffers or writes them. Once all fixtures are rendered, `show()` sends what
+ * was buffered, so outputs sharing a bus are updated together.
+ *
+ * The duties from the curves are scaled by `setScale()`, the brightness
+ * master and power limit of `Spotlight`, with one multiply per channel.
+ * Their sum before scaling is kept as the load, which the current model of
+ * the output turns into the current the power limit works with.
+ */
+class Output {
+public:
+  // The scale that keeps the duties, 1.0 in Q16.
+  static const uint32_t SCALE_ONE = 1u << 16;
+
+  Output();
+  virtual ~Output() {}
+
+  /**
+   * @brief Initializes the hardware, with all pixels off.
+   * @param curves The output curves of the red, green and blue channel,
+   * mapping to 0-`Constants::PWM_RANGE`. Must stay valid.
+   */
+  virtual void begin(const Gamma::Table *curves) = 0;
+
+  /**
+   * @brief Gets the number of pixels, 1 for a single spot.
+   */
+  virtual size_t getPixelCount() const { return 1; }
+
+  /**
+   * @brief Writes a frame.
+   * @param pixels The colors of the pixels, `getPixelCount()` of them (at
+   * most `Constants::MAX_PIXELS`).
+   */
+  virtual void write(const ColorSpace::RGB16 *pixels) = 0;
+
+  /**
+   * @brief Writes a frame of one color, without a frame buffer. The default
+   * writes a single pixel, outputs with more pixels override it.
+   * @param color The color of all pixels.
+   */
+  virtual void fill(const ColorSpace::RGB16 &color) { write(&color); }
+
+  /**
+   * @brief Sends the frames buffered by `write()`.
+   */
+  virtual void show() {}
+
+  /**
+   * @brief Enables temporal dithering, if the output supports it.
+   * @param enabled True to enable dithering.
+   */
+  virtual void setDithering(bool enabled) {}
+
+  /**
+   * @brief Checks whether the frame has to be written again even if it
+   * didn't change, e.g. to keep dithering it.
+   */
+  virtual bool needsRefresh() const { return false; }
+
+  /**
+   * @brief Checks whether `write()` and `show()` may run from a Ticker
+   * callback (see `Spotlight::RenderMode::Timer`), which must not yield.
+   */
+  virtual bool isTimerSafe() const { return true; }
+
+  /**
+   * @brief Sets the scale of the duties, from the next `write()` on.
+   * @param scale The scale in Q16, at most `SCALE_ONE`.
+   */
+  void setScale(uint32_t scale) { _scale = scale; }
+
+  /**
+   * @brief Gets the duty of the red, green and blue channel of the last
+   * frame, summed over the pixels and before scaling. The duties are
+   * `Gamma::Table::apply()` results.
+   */
+  const uint32_t *getLoad() const { return _load; }
+
+  /**
+   * @brief Sets the current model, e.g. for a strip whose LEDs draw less
+   * than the spots. Defaults to `SPOTLIGHT_CHANNEL_CURRENT`.
+   * @param red The current the red LED of a pixel draws at full duty, in mA,
+   * measured on the supply.
+   * @param green The current of the green LED.
+   * @param blue The current of the blue LED.
+   */
+  void setChannelCurrent(uint16_t red, uint16_t green, uint16_t blue);
+
+  /**
+   * @brief Gets the current a load (see `getLoad()`) draws by the current
+   * model, in microamperes.
+   */
+  uint32_t getCurrent(const uint32_t *load) const;
+
+  /**
+   * @brief Gets the current the last frame draws at full scale, in
+   * microamperes.
+   */
+  uint32_t getCurrent() const { return getCurrent(_load); }
+
+protected:
+  /**
+   * @brief Scales the duty of a channel and adds it to the load.
+   * Implementations reset the load at the start of `write()`.
+   * @param channel The channel, 0-2 for red, green and blue.
+   * @param duty The duty from the channel's output curve.
+   * @return The scaled duty.
+   */
+  uint16_t scaleDuty(size_t channel, uint16_t duty) {
+    _load[channel] += duty;
+    return (duty * _scale) >> 16; // Fits, duties are below 65536.
+  }
+
+  void resetLoad() { _load[0] = _load[1] = _load[2] = 0; }
+
+private:
+  uint32_t _scale;
+  uint32_t _load[3];
+  uint32_t _channelCurrent[3]; // In uA per unit of the load, Q16.
+};
+
+/**
+ * @class PwmOutput
+ * @brief A spot on three GPIO pins, driven by analogWrite().
+ *
+ * The only output with temporal dithering, since the 10-bit PWM of the
+ * ESP8266 steps visibly at low brightness.
+ */
+class PwmOutput : public Output {
+public:
+  PwmOutput(uint8_t redPin, uint8_t greenPin, uint8_t bluePin);
+
+  void begin(const Gamma::Table *curves) override;
+  void write(const ColorSpace::RGB16 *pixels) override;
+  void setDithering(bool enabled) override;
+  bool needsRefresh() const override;
+
+private:
+  uint8_t _pins[3];
+  const Gamma::Table *_curves;
+  uint16_t _duty[3]; // Last duty written.
+
+  // Temporal dithering variables.
+  bool _dithering;
+  bool _ditherActive; // Any fractional duty.
+  uint8_t _ditherError[3];
+};
+
+/**
+ * @class Pca9685Output
+ * @brief A spot on three channels of a PCA9685 chain.
+ *
+ * Several outputs can share the chain, `show()` flushes all of its changed
+ * channels at once.
+ */
+class Pca9685Output : public Output {
+public:
+  /**
+   * @param driver The chain, shared with the other outputs on it.
+   * @param red The channel connected to the red LED channel, counted across
+   * the chain.
+   * @param green The channel connected to the green LED channel.
+   * @param blue The channel connected to the blue LED channel.
+   */
+  Pca9685Output(Pca9685 &driver, uint8_t red, uint8_t green, uint8_t blue);
+
+  void begin(const Gamma::Table *curves) override;
+  void write(const ColorSpace::RGB16 *pixels) override;
+  void show() override;
+
+private:
+  Pca9685 &_driver;
+  uint8_t _channels[3];
+  const Gamma::Table *_curves;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file Pca9685.h
+ * @brief Header file for the PCA9685 I2C PWM driver.
+ */
+
+#ifndef PCA9685_H
+#define PCA9685_H
+
+#include "Constants.h"
+#include <Arduino.h>
+
+/**
+ * @class Pca9685
+ * @brief Drives a chain of PCA9685 16-channel, 12-bit PWM controllers.
+ *
+ * Channels are numbered across the chain: channel 16 is the first output of
+ * the chip at `Constants::PCA9685_ADDRESS + 1`. Duties are buffered and only
+ * sent by `flush()`, which writes each run of changed channels in a single
+ * I2C transfer, so a frame costs one transfer per chip at most.
+ */
+class Pca9685 {
+public:
+  // The number of outputs per chip.
+  static constexpr uint8_t CHANNELS_PER_CHIP = 16;
+  // The maximum duty, i.e. always on.
+  static constexpr uint16_t MAX_DUTY = 4095;
+
+  Pca9685();
+
+  /**
+   * @brief Initializes I2C and configures the chips.
+   *
+   * Each output on the chain calls this with the chips it needs, only chips
+   * not started yet are configured.
+   * @param chips The number of chips in the chain (max
+   * `Constants::PCA9685_MAX_CHIPS`).
+   * @param frequency The PWM frequency in Hz (24-1526).
+   */
+  void begin(uint8_t chips, uint16_t frequency);
+
+  /**
+   * @brief Buffers the duty of a channel.
+   * @param channel The channel, counted across the chain.
+   * @param duty The duty (0-`MAX_DUTY`).
+   */
+  void setDuty(uint8_t channel, uint16_t duty);
+
+  /**
+   * @brief Sends the buffered duties that changed.
+   */
+  void flush();
+
+private:
+  uint8_t _chips;
+  uint16_t _duty[Constants::PCA9685_MAX_CHIPS * CHANNELS_PER_CHIP];
+  uint16_t _dirty[Constants::PCA9685_MAX_CHIPS]; // Bit i is channel i.
+
+  void writeRegister(uint8_t chip, uint8_t reg, uint8_t value);
+  void writeChannels(uint8_t chip, uint8_t first, uint8_t count);
+};
+
+#endif
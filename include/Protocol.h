@@ -0,0 +1,154 @@
+/**
+ * @file Protocol.h
+ * @brief Header file for the compact binary control protocol.
+ *
+ * Every message starts with an opcode byte followed by a fixed payload (the
+ * cycle command has a variable number of colors). Multi-byte values are
+ * little-endian, durations are in milliseconds.
+ *
+ * | Opcode | Command               | Payload                              |
+ * |--------|-----------------------|--------------------------------------|
+ * | 0x01   | Set RGB               | r, g, b (u8 each)                    |
+ * | 0x02   | Set Kelvin            | kelvin (u16), brightness (u8, 0-255) |
+ * | 0x03   | Color wheel mode      | period (u32), direction (u8, 1=ccw)  |
+ * | 0x04   | Color cycle mode      | random (u8), count (u8), count * rgb |
+ * | 0x05   | Set cycle duration    | duration (u32)                       |
+ * | 0x06   | Set cycle easing      | easing (u8, Easing::EasingFunction)  |
+ * | 0x07   | Set transition dur.   | duration (u32)                       |
+ * | 0x08   | Set transition easing | easing (u8, Easing::EasingFunction)  |
+ * | 0x09   | Select fixtures       | mask (u16, bit i is fixture i)       |
+ * | 0x0A   | Set wheel spread      | spread (u16, 65535 = a full turn)    |
+ * | 0x0B   | Play scene            | slot (u8, see Scene.h)               |
+ * | 0x0C   | Start at              | time (u32, see Spotlight::getTime()) |
+ * | 0x0D   | Set interpolation     | space (u8, ColorSpace::Interpolation)|
+ * | 0x0E   | Breathe mode          | r, g, b, period (u32), minimum (u8)  |
+ * | 0x0F   | Strobe mode           | r, g, b, period (u32), duty (u8)     |
+ * | 0x10   | Candle mode           | r, g, b, intensity (u8)              |
+ * | 0x11   | Set brightness        | level (u16, 65535 = full)            |
+ * | 0x12   | Set stream smoothing  | time constant (u32, ms)              |
+ *
+ * The levels of the breathe, strobe and candle modes are 0-255 for 0.0-1.0,
+ * see Spotlight::enableBreatheMode() and the following. The brightness
+ * and the stream smoothing apply to all fixtures, regardless of the
+ * selection.
+ *
+ * A batch is several commands back to back. It is applied atomically, see
+ * applyBatch(). The commands control all fixtures unless a select command
+ * earlier in the same batch narrows them down. A start at command schedules
+ * the modes and transitions the batch starts, so spotlights sharing a clock
+ * start them in step.
+ *
+ * Messages sent by the spotlight:
+ *
+ * | Opcode | Message | Payload                                        |
+ * |--------|---------|------------------------------------------------|
+ * | 0x80   | Color   | r, g, b (u8 each) of the currently shown color |
+ * | 0x81   | Error   | opcode (u8) of the rejected command            |
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "Spotlight.h"
+#include <Arduino.h>
+
+namespace Protocol {
+
+enum Opcode : uint8_t {
+  SetRGB = 0x01,
+  SetKelvin = 0x02,
+  SetWheelMode = 0x03,
+  SetCycleMode = 0x04,
+  SetCycleDuration = 0x05,
+  SetCycleEasing = 0x06,
+  SetTransitionDuration = 0x07,
+  SetTransitionEasing = 0x08,
+  SelectFixtures = 0x09,
+  SetWheelSpread = 0x0A,
+  PlayScene = 0x0B,
+  StartAt = 0x0C,
+  SetInterpolation = 0x0D,
+  SetBreatheMode = 0x0E,
+  SetStrobeMode = 0x0F,
+  SetCandleMode = 0x10,
+  SetBrightness = 0x11,
+  SetStreamSmoothing = 0x12,
+
+  Color = 0x80,
+  Error = 0x81
+};
+
+// The size of the largest message: a fixture selection, a start time and a
+// cycle command with MAX_COLORS colors.
+const size_t MAX_MESSAGE_SIZE = 3 + 5 + 3 + 3 * Constants::MAX_COLORS;
+
+/**
+ * @brief A message being encoded, with the helpers to append little-endian
+ * values.
+ */
+struct Message {
+  uint8_t data[MAX_MESSAGE_SIZE];
+  size_t length = 0;
+
+  Message &put8(uint8_t value);
+  Message &put16(uint16_t value);
+  Message &put32(uint32_t value);
+};
+
+/**
+ * @brief Gets the length of the first command in a buffer.
+ * @param data The buffer, starting with a command.
+ * @param length The length of the buffer in bytes.
+ * @return The length of the command, or 0 if the opcode is unknown or the
+ * command is truncated.
+ */
+size_t messageLength(const uint8_t *data, size_t length);
+
+/**
+ * @brief Checks whether a message is a valid command, without applying it.
+ * @param data The message.
+ * @param length The length of the message in bytes.
+ * @return True if the message is a valid command.
+ */
+bool validate(const uint8_t *data, size_t length);
+
+/**
+ * @brief Decodes a single command and applies it to the spotlight.
+ * @param spotlight The spotlight to control.
+ * @param data The message.
+ * @param length The length of the message in bytes.
+ * @return True if the message was a valid command.
+ */
+bool apply(Spotlight &spotlight, const uint8_t *data, size_t length);
+
+/**
+ * @brief Applies a batch of commands as a single change.
+ *
+ * Nothing is applied if any command of the batch is invalid. Otherwise all
+ * commands are applied within Spotlight::beginBatch()/endBatch(), starting
+ * and ending with all fixtures selected.
+ * @param spotlight The spotlight to control.
+ * @param data The commands, back to back.
+ * @param length The length of the batch in bytes.
+ * @return True if the batch was valid and applied.
+ */
+bool applyBatch(Spotlight &spotlight, const uint8_t *data, size_t length);
+
+/**
+ * @brief Encodes a color message.
+ * @param color The color to send.
+ * @param out Buffer for the message, at least 4 bytes.
+ * @return The length of the message.
+ */
+size_t encodeColor(const ColorSpace::RGB &color, uint8_t *out);
+
+/**
+ * @brief Encodes an error message.
+ * @param opcode The opcode of the rejected command.
+ * @param out Buffer for the message, at least 2 bytes.
+ * @return The length of the message.
+ */
+size_t encodeError(uint8_t opcode, uint8_t *out);
+} // namespace Protocol
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * @file Scene.h
+ * @brief Header file for the keyframe scenes.
+ *
+ * A scene is a list of keyframes played back by the spotlight itself, so a
+ * show doesn't need a command per color change. Scenes are uploaded once in
+ * a compact binary format and stored in LittleFS, one file per slot.
+ * Multi-byte values are little-endian, times are in milliseconds.
+ *
+ * | Offset | Field                                                    |
+ * |--------|----------------------------------------------------------|
+ * | 0      | flags (u8, bit 0 = loop)                                 |
+ * | 1      | count (u8, 1-`Constants::MAX_SCENE_KEYFRAMES`)           |
+ * | 2      | count * keyframe                                         |
+ *
+ * | Offset | Keyframe field                                           |
+ * |--------|----------------------------------------------------------|
+ * | 0      | r, g, b (u8 each)                                        |
+ * | 3      | fade (u32), the time to blend from the previous color    |
+ * | 7      | easing (u8, Easing::EasingFunction) of the fade          |
+ * | 8      | hold (u32), the time the color is held after the fade    |
+ *
+ * The first keyframe fades from the color shown when the scene starts, and
+ * when looping from the last keyframe. A scene that doesn't loop holds its
+ * last color.
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "ColorSpace.h"
+#include "Constants.h"
+#include "Easing.h"
+#include <Arduino.h>
+
+/**
+ * @class Scene
+ * @brief A scene compiled for playback.
+ *
+ * Loading converts the keyframes to fixed point LCH and absolute times once,
+ * so playback never parses. Each fixture keeps a cursor into the flat array
+ * of segments, which only ever moves forward, so a frame costs O(1).
+ */
+class Scene {
+public:
+  Scene();
+
+  /**
+   * @brief Checks whether data is a valid scene.
+   * @param data The scene in the binary format.
+   * @param length The length of the data in bytes.
+   * @return True if the scene is valid.
+   */
+  static bool validate(const uint8_t *data, size_t length);
+
+  /**
+   * @brief Stores a scene in a slot.
+   * @param slot The slot (max `Constants::MAX_SCENES` - 1).
+   * @param data The scene, must be valid.
+   * @param length The length of the scene in bytes.
+   * @return True if the scene was written.
+   */
+  static bool save(uint8_t slot, const uint8_t *data, size_t length);
+
+  /**
+   * @brief Checks whether a slot holds a scene.
+   * @param slot The slot.
+   */
+  static bool exists(uint8_t slot);
+
+  /**
+   * @brief Loads and compiles the scene of a slot.
+   * @param slot The slot.
+   * @return False, leaving the scene unchanged, if the slot holds no valid
+   * scene.
+   */
+  bool load(uint8_t slot);
+
+  /**
+   * @brief Compiles a scene.
+   * @param data The scene in the binary format.
+   * @param length The length of the data in bytes.
+   * @return False, leaving the scene unchanged, if the data is invalid.
+   */
+  bool compile(const uint8_t *data, size_t length);
+
+  /**
+   * @brief Gets the color of the scene at a point in time.
+   * @param elapsed The time since the scene started, in ms.
+   * @param entry The color shown when the scene started.
+   * @param cursor The segment of the previous call, 0 when the scene starts.
+   * Updated to the segment of this call.
+   * @return The resulting RGB16 color.
+   */
+  ColorSpace::RGB16 sample(unsigned long elapsed,
+                           const ColorSpace::fx::LCH &entry,
+                           uint8_t &cursor) const;
+
+  /**
+   * @brief Checks whether the scene holds its color from a point in time on.
+   * @param elapsed The time since the scene started, in ms.
+   * @return true past the end of a scene that doesn't loop, or when the
+   * scene is empty and shows the entry color.
+   */
+  bool isFinished(unsigned long elapsed) const;
+
+private:
+  // A keyframe with absolute times. The fade runs from start to holdStart,
+  // the hold from holdStart to end.
+  struct Segment {
+    uint32_t start;
+    uint32_t holdStart;
+    uint32_t end;
+    ColorSpace::fx::LCH from;
+    ColorSpace::fx::LCH to;
+    ColorSpace::RGB16 color; // `to` converted, shown during the hold.
+    Easing::EasingFunction easing;
+  };
+
+  Segment _segments[Constants::MAX_SCENE_KEYFRAMES];
+  uint8_t _count;
+  bool _loop;
+  uint32_t _duration; // The end of the last segment.
+};
+
+#endif
@@ -9,15 +9,36 @@
 #include "ColorSpace.h"
 #include "Constants.h"
 #include "Easing.h"
+#include "Effects.h"
+#include "Gamma.h"
+#include "GradientCache.h"
+#include "Output.h"
+#include "Scene.h"
+#include "config.h"
 #include <Arduino.h>
+#include <Ticker.h>
+
+// The current all fixtures may draw together, in mA. 0 doesn't limit it.
+#ifndef SPOTLIGHT_POWER_BUDGET
+#define SPOTLIGHT_POWER_BUDGET 0
+#endif
 
 /**
  * @class Spotlight
- * @brief A class to control a tri-color LED spotlight with various modes.
+ * @brief A class to control tri-color LED spotlights with various modes.
+ *
+ * This class provides methods to set the color of up to
+ * `Constants::MAX_FIXTURES` RGB LED spotlights or strips (fixtures) using
+ * different color spaces and animation modes, all in a non-blocking manner
+ * using timer-based updates. The setters apply to the fixtures picked with
+ * `selectFixtures()`, all of them by default. Every frame renders all
+ * fixtures in one pass, each to its `Output`. Each mode is an effect class
+ * (see Effects.h), held by value per fixture.
  *
- * This class provides methods to set the color of an RGB LED spotlight
- * using different color spaces and animation modes, all in a non-blocking
- * manner using timer-based updates.
+ * The color cycle palette and its pre-rendered gradients are shared by all
+ * fixtures, since a gradient cache per fixture wouldn't fit into RAM. Each
+ * fixture cycles through it with its own timing. The same goes for the
+ * keyframe scene.
  */
 class Spotlight {
 public:
@@ -26,8 +47,27 @@ public:
    */
   enum class RotationDirection { Clockwise, CounterClockwise };
 
+  /**
+   * @brief Defines where animation frames are rendered.
+   */
+  enum class RenderMode {
+    Loop, // From update(), i.e. from the main loop.
+    Timer // From a Ticker, independent of how long loop() blocks.
+  };
+
+  // A set of fixtures, bit i is fixture i.
+  typedef uint16_t FixtureMask;
+  static const FixtureMask ALL_FIXTURES = 0xFFFF;
+
   /**
    * @brief Constructor for the Spotlight class.
+   * @param outputs The output of each fixture. The outputs must stay valid.
+   * @param count The number of fixtures (max `Constants::MAX_FIXTURES`).
+   */
+  Spotlight(Output *const *outputs, size_t count);
+
+  /**
+   * @brief Constructor for a single fixture on GPIO pins.
    * @param redPin The GPIO pin connected to the red LED channel.
    * @param greenPin The GPIO pin connected to the green LED channel.
    * @param bluePin The GPIO pin connected to the blue LED channel.
@@ -35,7 +75,7 @@ public:
   Spotlight(int redPin, int greenPin, int bluePin);
 
   /**
-   * @brief Initializes the LED pins as outputs.
+   * @brief Precomputes the output curves and initializes the outputs.
    */
   void begin();
 
@@ -44,9 +84,161 @@ public:
    *
    * This method should be called in the main `loop()` to handle all
    * time-based animations and transitions without using `delay()`.
+   * Frames are only rendered at the configured frame rate; calls in
+   * between return immediately.
    */
   void update();
 
+  /**
+   * @brief Sets the rate at which animation frames are rendered.
+   * @param hz The frame rate in Hz (clamped to `Constants::MIN_FRAME_RATE` -
+   * `Constants::MAX_FRAME_RATE`).
+   */
+  void setFrameRate(uint16_t hz);
+
+  /**
+   * @brief Enables temporal dithering of the GPIO PWM outputs.
+   *
+   * Carries the fraction of each channel's PWM duty over to the next frames,
+   * so slow fades at low brightness don't step visibly. Works best with a
+   * high frame rate (see `Constants::DITHER_BITS`).
+   * @param enabled True to enable dithering.
+   */
+  void setDithering(bool enabled);
+
+  /**
+   * @brief Sets the brightness master, which scales all fixtures.
+   *
+   * Applied by the outputs after the modes (see `Output::setScale()`), so
+   * the state and `getColor()` are unchanged. Takes effect with the next
+   * frame.
+   * @param level The brightness (0.0-1.0).
+   */
+  void setBrightness(float level);
+
+  /**
+   * @brief Gets the brightness master (0.0-1.0).
+   */
+  float getBrightness() const;
+
+  /**
+   * @brief Gets the current the fixtures draw by the current models of
+   * their outputs (see `Output::setChannelCurrent()`), in mA.
+   *
+   * With a `SPOTLIGHT_POWER_BUDGET` the outputs are scaled down so that a
+   * running average of the current stays within it. The average follows a
+   * rise at once and a fall within about `Constants::POWER_RELEASE_TIME`,
+   * so a flashing mode doesn't make the limit pump. A fixture set to a
+   * color is only written once the scale keeps it within the budget.
+   */
+  uint32_t getCurrent() const;
+
+  /**
+   * @brief Checks whether no frame would change the output, so the main
+   * loop can sleep (see `Constants::IDLE_LOOP_DELAY`).
+   *
+   * True once all fixtures settled on their colors, e.g. a fade or
+   * `setColorTemperature()` finished, nothing is streamed and the power
+   * limit is steady. No frames are rendered then. Setters, the stream and
+   * the brightness wake the renderer with the next frame.
+   */
+  bool isIdle() const;
+
+  /**
+   * @brief Selects where animation frames are rendered.
+   *
+   * In `RenderMode::Timer` frames are rendered from a Ticker at the
+   * configured frame rate. Ticker callbacks also run while the web server
+   * blocks and yields (e.g. while streaming a file), so HTTP traffic doesn't
+   * make the light stutter. `update()` then does nothing. Outputs that
+   * yield while showing a frame, like `StripOutput`, can't be used in it.
+   * @param mode The render mode to use.
+   * @return False if an output isn't `Output::isTimerSafe()`, the mode is
+   * kept then.
+   */
+  bool setRenderMode(RenderMode mode);
+
+  /**
+   * @brief Shows streamed colors, e.g. received by UdpStream.h, instead of
+   * the modes.
+   *
+   * The channels of all fixtures are numbered in order, r, g, b per pixel.
+   * A fixture shows the stream from the first channel written to it, until
+   * nothing was streamed for `Constants::STREAM_TIMEOUT`. Then all fixtures
+   * go back to their modes, which kept running meanwhile, and the setters
+   * called during the stream take effect.
+   * @param offset The first channel.
+   * @param in The channel values, read directly into the stream buffer.
+   * Channels beyond `Constants::MAX_PIXELS` pixels are left unread.
+   * @param length The number of channels, at most what in has available.
+   */
+  void streamChannels(size_t offset, Stream &in, size_t length);
+
+  /**
+   * @brief Sets the time constant the streamed colors are smoothed with.
+   * @param seconds The time for about two thirds of a change, 0 shows the
+   * streamed values as they arrive.
+   */
+  void setStreamSmoothing(float seconds);
+
+  /**
+   * @brief Checks whether any fixture shows streamed colors.
+   */
+  bool isStreaming() const;
+
+  /**
+   * @brief Gets the time the modes run on, in ms.
+   *
+   * It's `millis()` shifted by the offset set with `setClockOffset()`, so
+   * spotlights sharing a clock (see ClockSync.h) render the same phase of
+   * modes started at the same time.
+   */
+  unsigned long getTime() const;
+
+  /**
+   * @brief Sets the offset of `getTime()` to `millis()`.
+   * @param offset The offset in ms.
+   */
+  void setClockOffset(unsigned long offset);
+
+  /**
+   * @brief Sets when the modes and transitions started by the next change
+   * begin, instead of now.
+   *
+   * Applies to the next published change, i.e. the rest of the batch or
+   * the next setter. Until a start time in the future the fixtures keep
+   * showing their previous colors. The random color cycle order isn't
+   * shared, only the timing.
+   * @param time The start time, see `getTime()`.
+   */
+  void setStartTime(unsigned long time);
+
+  /**
+   * @brief Gets the number of fixtures.
+   */
+  size_t getFixtureCount() const;
+
+  /**
+   * @brief Selects the fixtures the setters below apply to.
+   * @param fixtures The fixtures. Bits of fixtures that don't exist are
+   * ignored.
+   */
+  void selectFixtures(FixtureMask fixtures);
+
+  /**
+   * @brief Starts a batch of changes.
+   *
+   * Until `endBatch()` the setters only prepare the new state, which is then
+   * published at once. The renderer never sees a partial update, and a mode or
+   * transition started by the batch restarts only once.
+   */
+  void beginBatch();
+
+  /**
+   * @brief Publishes the changes made since `beginBatch()`.
+   */
+  void endBatch();
+
   /**
    * @brief Sets a fixed RGB color with a simple fade transition.
    * @param r Red value (0-255).
@@ -69,16 +261,64 @@ public:
    */
   void enableColorWheelMode(float periodSeconds, RotationDirection direction);
 
+  /**
+   * @brief Spreads the color wheel across the pixels of a fixture.
+   *
+   * Pixel i of n is ahead of the first one by `spread * i / n` turns, so a
+   * strip shows a moving rainbow. A single spot isn't affected.
+   * @param spread The part of the wheel shown at once (0.0-1.0).
+   */
+  void setWheelSpread(float spread);
+
   /**
    * @brief Enables a mode to cycle through a list of colors with blending.
+   *
+   * The palette is shared, fixtures already cycling switch to it as well.
    * @param colors An array of ColorSpace::RGB structs.
-   * @param count The number of colors in the array. Max `maxColors` from
-   * constructor.
+   * @param count The number of colors in the array. Max
+   * `Constants::MAX_COLORS`.
    * @param isRandom If true, the order of colors is randomized.
    */
   void enableColorCycleMode(const ColorSpace::RGB *colors, size_t count,
                             bool isRandom);
 
+  /**
+   * @brief Plays the keyframe scene stored in a slot (see Scene.h).
+   *
+   * The scene is shared, fixtures already playing one switch to it as well.
+   * @param slot The slot.
+   * @return False, without changing anything, if the slot holds no valid
+   * scene.
+   */
+  bool playScene(uint8_t slot);
+
+  /**
+   * @brief Pulses the brightness of a color, easing down and back up.
+   * @param color The color at full brightness.
+   * @param periodSeconds The duration of one breath in seconds, 0 shows the
+   * color.
+   * @param minimum The lowest brightness (0.0-1.0).
+   */
+  void enableBreatheMode(const ColorSpace::RGB &color, float periodSeconds,
+                         float minimum);
+
+  /**
+   * @brief Flashes a color, with black in between.
+   * @param color The color of the flashes.
+   * @param periodSeconds The duration of a flash and the pause after it in
+   * seconds, 0 shows the color.
+   * @param duty The part of the period the color is on (0.0-1.0).
+   */
+  void enableStrobeMode(const ColorSpace::RGB &color, float periodSeconds,
+                        float duty);
+
+  /**
+   * @brief Flickers a color like a candle flame.
+   * @param color The color at full brightness.
+   * @param intensity How deep the flame dips (0.0-1.0), 1.0 down to black.
+   */
+  void enableCandleMode(const ColorSpace::RGB &color, float intensity);
+
   /**
    * @brief Sets the duration for each transition in color cycle mode.
    * @param duration The duration in seconds.
@@ -104,45 +344,210 @@ public:
    */
   void setTransitionEasing(Easing::EasingFunction easing);
 
+  /**
+   * @brief Sets the color space transitions are blended in.
+   *
+   * Applies to all fixtures, since they share the palette: the transitions
+   * to fixed colors and the color cycle transitions, including those in
+   * progress. The palette is pre-rendered again. Scenes keep their own
+   * blending (see Scene.h). The default is
+   * `Constants::DEFAULT_INTERPOLATION`.
+   * @param space The interpolation space.
+   */
+  void setInterpolation(ColorSpace::Interpolation space);
+
+  /**
+   * @brief Gets the color shown by the last rendered frame.
+   * @param fixture The fixture.
+   * @return The color, before the output curves are applied.
+   */
+  ColorSpace::RGB getColor(size_t fixture = 0);
+
+  /**
+   * @brief Counts the published changes, so a caller can tell whether the
+   * state changed since it last looked.
+   */
+  uint32_t getRevision() const;
+
+  /**
+   * @brief Gets the published mode of a fixture, with its parameters.
+   * @param fixture The fixture, less than `getFixtureCount()`.
+   */
+  const Effects::Slot &getEffect(size_t fixture) const;
+
+  /**
+   * @brief Gets the published durations, easings and wheel spread of a
+   * fixture.
+   * @param fixture The fixture, less than `getFixtureCount()`.
+   */
+  const Effects::Settings &getSettings(size_t fixture) const;
+
+  /**
+   * @brief Gets the space transitions are blended in.
+   */
+  ColorSpace::Interpolation getInterpolation() const;
+
+  /**
+   * @brief Gets the color cycle palette, in the order it is cycled through.
+   * @param colors Where to write the colors, `Constants::MAX_COLORS` fit.
+   * @param isRandom Set if the colors are cycled in random order.
+   * @return The number of colors.
+   */
+  size_t getPalette(ColorSpace::RGB *colors, bool &isRandom) const;
+
+  /**
+   * @brief Gets the slot of the scene played by `Effects::Playback`.
+   */
+  uint8_t getSceneSlot() const;
+
+  /**
+   * @brief Writes the modes, colors, palette, durations and easings of all
+   * fixtures as a compact record.
+   *
+   * The record holds the configuration, not the progress of the animations.
+   * Static colors, e.g. from `setColorTemperature()`, are stored as the end
+   * of a transition, so restoring fades them in. Must not be called within a
+   * batch.
+   * @param out Where to write the record.
+   * @param size The size of out, `Constants::MAX_STATE_SIZE` always fits.
+   * @return The length of the record, 0 if it doesn't fit.
+   */
+  size_t saveState(uint8_t *out, size_t size) const;
+
+  /**
+   * @brief Restores a record written by `saveState()`.
+   *
+   * All modes restart from their beginning. Records of another layout
+   * version are rejected.
+   * @param data The record.
+   * @param length The length of the record in bytes.
+   * @return False, leaving the state unchanged, if the record is invalid.
+   */
+  bool restoreState(const uint8_t *data, size_t length);
+
 private:
-  int _redPin, _greenPin, _bluePin;
-
-  // Current color state variables.
-  ColorSpace::RGB _currentRGB;
-
-  // Animation state variables.
-  unsigned long _animationStartTime;
-  bool _isAnimating;
-
-  // Color Wheel Mode variables.
-  float _currentHue;
-  float _startHue;
-  float _saturation;
-  float _value;
-  float _rotationPeriod;
-  RotationDirection _rotationDirection;
-
-  // Color Cycle Mode variables.
-  ColorSpace::LCH _colorCycleList[Constants::MAX_COLORS];
-  size_t _colorCycleCount;
-  size_t _currentColorIndex;
-  ColorSpace::LCH _startLCH;
-  float _transitionDuration;
-  Easing::EasingFunction _currentEasing;
-  bool _isRandom;
-
-  // Smooth transition variables for fixed colors
-  bool _isTransitioning;
-  unsigned long _transitionStartTime;
-  float _fixedTransitionDuration;
-  Easing::EasingFunction _fixedTransitionEasing;
-  ColorSpace::LCH _fixedStartLCH;
-  ColorSpace::LCH _fixedEndLCH;
+  Output *_outputs[Constants::MAX_FIXTURES];
+  size_t _fixtureCount;
+  FixtureMask _selectedFixtures;
+  PwmOutput _pinOutput; // The output of the single fixture constructor.
+
+  // Output stage variables. The color of a fixture is the one of its first
+  // pixel, varied is set while its pixels differ.
+  ColorSpace::RGB16 _currentRGB[Constants::MAX_FIXTURES];
+  bool _varied[Constants::MAX_FIXTURES];
+  Gamma::Table _outputCurves[3];
+
+  // Pixels of the fixture being rendered, reused by all fixtures and frames.
+  ColorSpace::RGB16 _frame[Constants::MAX_PIXELS];
+
+  // Frame scheduler variables.
+  unsigned long _frameInterval; // In microseconds.
+  unsigned long _nextFrameTime; // micros() deadline of the next frame.
+  RenderMode _renderMode;
+  Ticker _ticker;
+
+  // Stream variables, see streamChannels(). The smoothed colors are kept per
+  // pixel, the frame buffer is shared by all fixtures.
+  uint8_t _streamChannels[3 * Constants::MAX_PIXELS];
+  ColorSpace::RGB16 _streamRGB[Constants::MAX_PIXELS];
+  ColorSpace::RGB16 _resumeRGB[Constants::MAX_FIXTURES]; // Before the stream.
+  FixtureMask _streamFixtures; // Showing the stream.
+  unsigned long _lastStreamTime; // millis() of the last streamed channels.
+  unsigned long _streamSmoothing; // In ms.
+  uint16_t _streamAlpha; // Smoothing step per frame in Q15, 1 << 15 = none.
+
+  // Brightness and power limiter variables, see setBrightness(). The
+  // estimates are updated as the fixtures are written, at full scale and in
+  // microamperes.
+  uint32_t _brightness; // Q16, Output::SCALE_ONE = full.
+  uint32_t _outputScale; // Set on the outputs, the brightness and limit.
+  uint32_t _fixtureCurrent[Constants::MAX_FIXTURES];
+  uint32_t _requestedCurrent; // Of all fixtures.
+  uint32_t _averageCurrent; // Of all fixtures at the brightness.
+  uint16_t _powerAlpha; // Release step of the average per frame in Q15.
+  bool _powerSettled; // The last frame left the scale and average as is.
+
+  /**
+   * @brief Everything the renderer needs to know about the active modes.
+   *
+   * The setters never modify the state the renderer reads. They change a
+   * copy and then publish it by flipping `_publishedState`, so a frame
+   * rendered from the Ticker always sees a consistent state. The effects
+   * are trivially copyable, so a copy is a plain memcpy.
+   *
+   * The per fixture variables are arrays indexed by fixture, so the render
+   * pass walks each of them linearly.
+   */
+  struct AnimationState {
+    // Incremented whenever a new mode or transition starts, so the renderer
+    // knows to restart its progress.
+    uint32_t generation[Constants::MAX_FIXTURES];
+    unsigned long startTime[Constants::MAX_FIXTURES];
+
+    // The mode of each fixture, with its parameters.
+    Effects::Slot effect[Constants::MAX_FIXTURES];
+    Effects::Settings settings[Constants::MAX_FIXTURES];
+
+    // Color Cycle Mode palette, shared by the fixtures.
+    size_t colorCycleCount;
+    bool isRandom;
+
+    // The space the fixed colors and the palette are stored and blended in.
+    ColorSpace::Interpolation interpolation;
+  };
+  AnimationState _states[2];
+  volatile uint8_t _publishedState;
+
+  // Batch variables, see beginBatch().
+  bool _batching;
+  bool _batchEdited; // True once the back state holds the batch's changes.
+  FixtureMask _batchRestart; // Fixtures a change in the batch restarts.
+
+  // Color Cycle Mode palette. Only written by enableColorCycleMode(), which
+  // can't be interrupted by a frame (Ticker callbacks only run when the loop
+  // yields).
+  ColorSpace::fx::LCH _colorCycleList[Constants::MAX_COLORS];
+  GradientCache _gradientCache;
+
+  // Scene Mode scene, only written by playScene() like the palette.
+  Scene _scene;
+  uint8_t _sceneSlot; // The slot it was loaded from.
+
+  uint32_t _revision; // Incremented by publishState().
+
+  // Shared clock variables, see getTime() and setStartTime().
+  unsigned long _clockOffset;
+  unsigned long _startTime;
+  bool _hasStartTime;
+
+  // Renderer variables per fixture, only touched while rendering a frame.
+  uint32_t _renderedGeneration[Constants::MAX_FIXTURES];
+  unsigned long _renderStartTime[Constants::MAX_FIXTURES];
+  bool _startPending[Constants::MAX_FIXTURES]; // Start time not reached yet.
+  Effects::Slot::Runtime _effectRuntime[Constants::MAX_FIXTURES];
 
   // Private helper methods.
-  void stopAllAnimations();
-  void writeLeds(const ColorSpace::RGB &color);
-  ColorSpace::RGB getCurrentRGB();
+  AnimationState &editState();
+  void publishState(FixtureMask restart);
+  bool isSelected(size_t fixture) const;
+  void renderFrame();
+  void renderFixture(const AnimationState &state, size_t fixture,
+                     unsigned long now);
+  void startRenderTimer();
+  size_t getPixelCount(size_t fixture) const;
+  void writeLeds(size_t fixture, ColorSpace::RGB16 color);
+  void writeFrame(size_t fixture);
+  void showOutputs();
+  void renderStream(size_t fixture, size_t firstPixel);
+  void stopStream();
+  void updateStreamAlpha();
+  uint16_t averageStep(unsigned long timeConstant) const;
+  void updateCurrent(size_t fixture);
+  void limitPower();
+  void limitInrush(size_t fixture, ColorSpace::RGB16 color);
+  uint32_t powerScale() const;
+  void applyScale(uint32_t scale);
+  static unsigned long toMillis(float seconds);
 };
 
 #endif
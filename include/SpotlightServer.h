@@ -10,61 +10,315 @@
 #ifndef SPOTLIGHTSERVER_H
 #define SPOTLIGHTSERVER_H
 
+#include "Latency.h"
+#include "Metrics.h"
+#include "Protocol.h"
 #include "Spotlight.h"
+#include "StateSnapshot.h"
+#include "Trace.h"
 #include <Arduino.h>
-#include <ESP8266WebServer.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
+#include <WebSocketsServer.h>
+
+// Selects the HTTP server backend. The default is the synchronous
+// ESP8266WebServer, which serves one client per update() and blocks while
+// streaming a file. With 1 the server is built on ESPAsyncWebServer, which
+// handles several clients at once from the TCP stack's callbacks.
+#ifndef SPOTLIGHT_ASYNC_SERVER
+#define SPOTLIGHT_ASYNC_SERVER 0
+#endif
+
+#if SPOTLIGHT_ASYNC_SERVER
+#include <ESPAsyncWebServer.h>
+#else
+#include <ESP8266WebServer.h>
+#endif
+
+/**
+ * @class HttpRequest
+ * @brief The parts of a HTTP request the handlers need, so they work with
+ * either server backend.
+ *
+ * The returned strings point into the backend's request and are valid until
+ * the handler returns. No String is allocated to look them up.
+ */
+class HttpRequest {
+public:
+  virtual ~HttpRequest() = default;
+
+  /**
+   * @brief Gets the path of the request.
+   */
+  virtual const char *uri() = 0;
+
+  /**
+   * @brief Gets the value of an argument.
+   * @param name The name of the argument.
+   * @return The value, or nullptr if the argument is missing.
+   */
+  virtual const char *arg(const char *name) = 0;
+
+  /**
+   * @brief Gets the body of a POST request, empty if there is none.
+   */
+  virtual const char *body() = 0;
+
+  /**
+   * @brief Checks whether the body is longer than
+   * `Constants::MAX_BODY_SIZE`. The async server drops such a body.
+   */
+  virtual bool isBodyTooLarge() = 0;
+
+  /**
+   * @brief Gets the value of a request header.
+   * @param name The name of the header, case is ignored.
+   * @return The value, or nullptr if the header is missing.
+   */
+  virtual const char *header(const char *name) = 0;
+
+  /**
+   * @brief Sends the response.
+   * @param code The HTTP status code.
+   * @param contentType The content type of the response.
+   * @param content The body of the response.
+   */
+  virtual void send(int code, const char *contentType,
+                    const char *content) = 0;
+
+  /**
+   * @brief Sends a file from LittleFS as the response, with caching headers.
+   * @param path The path of the file, which must exist.
+   * @param contentType The content type of the uncompressed file.
+   * @param gzipped True if the file is gzip compressed.
+   * @param etag The entity tag of the file.
+   * @return False if the file couldn't be opened.
+   */
+  virtual bool sendFile(const char *path, const char *contentType,
+                        bool gzipped, const char *etag) = 0;
+
+  /**
+   * @brief Sends a "304 Not Modified" response.
+   * @param etag The entity tag of the file.
+   */
+  virtual void sendNotModified(const char *etag) = 0;
+
+  /**
+   * @brief Sends a response that can be revalidated by its entity tag,
+   * without the server caching it.
+   * @param contentType The content type of the response.
+   * @param content The body of the response.
+   * @param etag The entity tag of the content.
+   */
+  virtual void sendTagged(const char *contentType, const char *content,
+                          const char *etag) = 0;
+};
 
 class SpotlightServer {
 public:
   /**
    * @brief Constructor for the SpotlightServer class.
    * @param spotlightInstance A pointer to the Spotlight object to control.
+   * @param metrics A pointer to the metrics to record to and serve.
    */
-  SpotlightServer(Spotlight *spotlightInstance);
+  SpotlightServer(Spotlight *spotlightInstance, Metrics *metrics);
 
   /**
-   * @brief Initializes the WiFi connection and sets up all API routes.
+   * @brief Sets up all API routes and starts connecting to WiFi.
+   *
+   * Doesn't wait for the connection, `update()` brings the network up in the
+   * background, so the light is controllable by its restored state (see
+   * StateStore.h) right away.
    */
   void begin();
 
   /**
    * @brief Main update loop for the server. Should be called frequently
-   * to handle incoming requests.
+   * to handle incoming requests and the WiFi connection.
    */
   void update();
 
+  /**
+   * @brief Checks whether a request waits for `update()`: a queued command
+   * of the async server, or data from the client the sync server keeps
+   * alive. New connections and WebSocket messages aren't seen.
+   */
+  bool hasPendingRequest();
+
 private:
+#if SPOTLIGHT_ASYNC_SERVER
+  AsyncWebServer _server;
+
+  // Commands received by the async handlers, applied in update(). The TCP
+  // callbacks can't interrupt the main loop, so no locking is needed.
+  Protocol::Message _commandQueue[Constants::COMMAND_QUEUE_LENGTH];
+  size_t _commandQueueHead;
+  size_t _commandQueueTail;
+#else
   ESP8266WebServer _server;
+#endif
+  WebSocketsServer _webSocket;
   Spotlight *_spotlight;
+  Metrics *_metrics;
+  StateSnapshot _snapshot;
+
+  // WiFi bring-up, driven from update().
+  enum class NetworkState {
+    Connecting, // Waiting for the connection.
+    Online      // Connected, mDNS announced.
+  };
+  NetworkState _networkState;
+  bool _fastConnect; // Connecting to the cached access point and channel.
+  unsigned long _connectStart;
+  bool _mdnsStarted;
+
+  // Entity tags of the served files, computed on their first request. The
+  // files only change with a new file system image, i.e. after a restart.
+  struct CachedEtag {
+    char path[Constants::MAX_PATH_LENGTH];
+    char etag[11]; // 8 hex digits in quotes.
+  };
+  CachedEtag _etags[Constants::ETAG_CACHE_ENTRIES];
+  size_t _nextEtag;
+
+  // State pushed to the WebSocket clients.
+  ColorSpace::RGB _pushedColor;
+  unsigned long _lastPushTime;
+
+  // State change notifications at /events.
+#if SPOTLIGHT_ASYNC_SERVER
+  AsyncEventSource _events;
+#else
+  // A client of /events and the event it is sent.
+  struct EventStream {
+    // "event: state\nid: \ndata: " with a 32-bit id and the NUL.
+    static const size_t FIELDS_SIZE = 24 + 10 + 1;
+    WiFiClient client;
+    const char *preamble;     // Sent first, e.g. the response header.
+    char fields[FIELDS_SIZE]; // The fields up to the data, or a comment.
+    uint8_t fieldsLength;
+    bool withState;        // The snapshot and the end of the event follow.
+    size_t sent;           // Bytes of the event written so far.
+    bool busy;             // An event is being sent.
+    unsigned long started; // millis() the event was started at.
+  };
+  EventStream _eventStreams[Constants::MAX_EVENT_CLIENTS];
+  unsigned long _lastKeepAlive;
+#endif
+  uint32_t _eventRevision; // Of the state the clients were sent last.
+  unsigned long _lastEventTime;
+
+  typedef void (SpotlightServer::*Handler)(HttpRequest &request);
 
   // API endpoint handlers
-  void handleSetRGB();
-  void handleSetKelvin();
-  void handleSetWheelMode();
-  void handleSetCycleMode();
-  void handleSetCycleDuration();
-  void handleSetCycleEasing();
-  void handleSetTransitionDuration();
-  void handleSetTransitionEasing();
+  void handleSetRGB(HttpRequest &request);
+  void handleSetKelvin(HttpRequest &request);
+  void handleSetWheelMode(HttpRequest &request);
+  void handleSetBreatheMode(HttpRequest &request);
+  void handleSetStrobeMode(HttpRequest &request);
+  void handleSetCandleMode(HttpRequest &request);
+  void handleSetCycleMode(HttpRequest &request);
+  void handleSetCycleDuration(HttpRequest &request);
+  void handleSetCycleEasing(HttpRequest &request);
+  void handleSetTransitionDuration(HttpRequest &request);
+  void handleSetTransitionEasing(HttpRequest &request);
+  void handleSetInterpolation(HttpRequest &request);
+  void handleSetBrightness(HttpRequest &request);
+  void handleSetStreamSmoothing(HttpRequest &request);
+  void handleBatch(HttpRequest &request);
+  void handleUploadScene(HttpRequest &request);
+  void handlePlayScene(HttpRequest &request);
+  void handleTime(HttpRequest &request);
+  void handleMetrics(HttpRequest &request);
+  void handleState(HttpRequest &request);
+  void handleSetLogLevel(HttpRequest &request);
+#if SPOTLIGHT_TRACE
+  void handleTrace(HttpRequest &request);
+#endif
+#if SPOTLIGHT_LATENCY
+  void handleLatency(HttpRequest &request);
+  void handleResetLatency(HttpRequest &request);
+#endif
+
+  /**
+   * @brief Registers a handler for GET requests on the active backend.
+   * @param uri The path of the endpoint.
+   * @param handler The handler to call.
+   */
+  void on(const char *uri, Handler handler);
+
+  /**
+   * @brief Registers a handler for POST requests with a body.
+   * @param uri The path of the endpoint.
+   * @param handler The handler to call.
+   */
+  void onPost(const char *uri, Handler handler);
+
+  /**
+   * @brief Applies the commands decoded by a handler as one batch and sends
+   * the response.
+   *
+   * With the async backend the commands are only queued here and applied in
+   * update(), so all changes to the spotlight happen from the main loop.
+   * @param request The request to respond to.
+   * @param data The encoded commands, back to back.
+   * @param length The length of the commands in bytes.
+   */
+  void submit(HttpRequest &request, const uint8_t *data, size_t length);
+
+  // WiFi connection
+  void startWifi();
+  void updateNetwork();
+  void onConnected();
+
+  // WebSocket control channel
+  void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t *payload,
+                            size_t length);
+  void pushState();
+
+  // Server-sent events
+  void beginEvents();
+  void pushEvents();
+#if !SPOTLIGHT_ASYNC_SERVER
+  void openEventStream();
+  void startEvent(EventStream &stream, const char *preamble, bool withState);
+  bool continueEvent(EventStream &stream);
+#endif
 
   // New handler for the web page
-  bool handleFileRequest(const String &path);
-  String getContentType(const String &filename);
+  bool handleFileRequest(HttpRequest &request);
+  const char *getContentType(const char *filename);
+  const char *getEtag(const char *path);
 
   // Helper functions for parsing request arguments
-  float getFloatArg(const String &name, float defaultValue);
-  int getIntArg(const String &name, int defaultValue);
+  float getFloatArg(HttpRequest &request, const char *name,
+                    float defaultValue);
+  int getIntArg(HttpRequest &request, const char *name, int defaultValue);
+
+  /**
+   * @brief Starts a message with the selection of the "fixture" argument,
+   * and the "start" argument if given.
+   *
+   * The fixture argument is "all" (the default) or a comma-separated list of
+   * fixture indices. The start argument is the time the modes started by
+   * the request begin at, see `/time` and `Spotlight::setStartTime()`.
+   * @param request The request to read the arguments from.
+   * @param message The message to start.
+   * @return False, after sending a 400 response, if an argument is invalid.
+   */
+  bool beginMessage(HttpRequest &request, Protocol::Message &message);
 
-  // Debugging
   /**
-   * @brief Lists the contents of the LittleFS directory and prints them to
-   * Serial.
-   * @param dir The directory to list.
-   * @param numTabs The number of tabs to indent the output.
+   * @brief Decodes a hex encoded request body, whitespace is ignored.
+   * @param request The request to read the body from.
+   * @param out The buffer for the decoded bytes.
+   * @param size The size of the buffer.
+   * @param length Set to the number of decoded bytes.
+   * @return False, after sending a 400 or 413 response, if the body isn't
+   * valid hex or doesn't fit.
    */
-  void listDir(const char *dirname, uint8_t numTabs);
+  bool readHexBody(HttpRequest &request, uint8_t *out, size_t size,
+                   size_t &length);
 };
 
 #endif
@@ -0,0 +1,78 @@
+/**
+ * @file StateSnapshot.h
+ * @brief Header file for the JSON view of the light's state served at
+ * /state.
+ */
+
+#ifndef STATESNAPSHOT_H
+#define STATESNAPSHOT_H
+
+#include "Constants.h"
+#include "Spotlight.h"
+#include <Arduino.h>
+
+/**
+ * @class StateSnapshot
+ * @brief Caches the modes, colors and settings of all fixtures as JSON.
+ *
+ * The JSON is only rendered again after a setter published a new state
+ * (see `Spotlight::getRevision()`), so any number of clients can read it
+ * for the cost of a comparison. The revision is the event id of /events,
+ * and together with a random boot id the entity tag of /state.
+ *
+ * The color shown during a transition isn't part of the snapshot, it is
+ * pushed over the WebSocket (see Protocol.h).
+ */
+class StateSnapshot {
+public:
+  /**
+   * @param spotlight The spotlight to describe.
+   */
+  explicit StateSnapshot(Spotlight *spotlight);
+
+  /**
+   * @brief Gets the JSON of the current state, rendering it if a setter ran
+   * since the last call.
+   * @return The JSON, or an empty string if it didn't fit
+   * `Constants::STATE_SNAPSHOT_SIZE`.
+   */
+  const char *json();
+
+  /**
+   * @brief Gets the revision of the state `json()` returned last.
+   */
+  uint32_t revision() const;
+
+  /**
+   * @brief Gets the entity tag of the state `json()` returned last, quoted.
+   *
+   * Revisions start over after a restart, the boot id keeps a tag from
+   * before from matching.
+   */
+  const char *etag() const;
+
+  /**
+   * @brief Checks if the state changed since `json()` was called last.
+   */
+  bool isStale() const;
+
+  /**
+   * @brief Keeps `json()` on the state it returned last, e.g. while event
+   * streams are still sending it.
+   * @param held True to keep it, false to render changes again.
+   */
+  void hold(bool held);
+
+private:
+  Spotlight *_spotlight;
+  bool _built;
+  bool _held;
+  uint32_t _revision;
+  uint32_t _bootId;
+  char _etag[20]; // Two words of 8 hex digits, a dash and quotes.
+  char _json[Constants::STATE_SNAPSHOT_SIZE];
+
+  void build();
+};
+
+#endif
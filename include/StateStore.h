@@ -0,0 +1,94 @@
+/**
+ * @file StateStore.h
+ * @brief Header file for the persistence of the spotlight state.
+ */
+
+#ifndef STATESTORE_H
+#define STATESTORE_H
+
+#include "Constants.h"
+#include "Spotlight.h"
+#include <Arduino.h>
+
+/**
+ * @class StateStore
+ * @brief Keeps the modes and colors of the spotlight across reboots.
+ *
+ * The state record (see `Spotlight::saveState()`) is kept in two places,
+ * each copy framed with a sequence number and a CRC:
+ *
+ * - RTC memory, which survives resets and deep sleep but not a power loss.
+ *   It's updated shortly after every change, as it costs no flash wear.
+ * - A log in the flash sectors between the end of the file system and the
+ *   sector the core reserves for the EEPROM library, which isn't used here,
+ *   that one included. The default 4 MB layouts leave one sector free there,
+ *   so the log has two. Records are appended once the state stopped
+ *   changing for `Constants::STATE_SAVE_DELAY`, so a fade slider doesn't
+ *   write flash on every step. They are programmed into an erased sector
+ *   one after the other. Once it is full the next record goes to the next
+ *   sector, and only then the sector after that is erased. A record of one
+ *   fixture with a full palette takes 236 bytes, so each of two sectors is
+ *   erased once per 34 saves (12 with `Constants::MAX_FIXTURES`). A file
+ *   system would copy and program a block for every append.
+ *
+ * At boot the newest valid copy is restored by its sequence number, before
+ * the network is up. A record torn by a power loss fails its CRC, the one
+ * before it is used then, in the same or the previous sector. With a log of
+ * one sector, a power loss between erasing it and writing the next record
+ * loses the saved state.
+ */
+class StateStore {
+public:
+  /**
+   * @brief Constructor for the StateStore class.
+   * @param spotlight The spotlight whose state is kept.
+   */
+  explicit StateStore(Spotlight *spotlight);
+
+  /**
+   * @brief Mounts LittleFS and restores the newest saved state, if any.
+   * @return True if a state was restored.
+   */
+  bool begin();
+
+  /**
+   * @brief Saves the state when it changed and has settled. Should be called
+   * from the main loop.
+   */
+  void update();
+
+private:
+  // Precedes each copy of the record.
+  struct RecordHeader {
+    uint16_t magic;
+    uint16_t length;   // Of the record that follows.
+    uint32_t sequence; // Incremented per copy written, the newest wins.
+    uint32_t crc;      // Of the fields above and the record.
+  };
+
+  Spotlight *_spotlight;
+  uint32_t _sequence;        // Of the newest copy read or written.
+  size_t _logSector;         // The sector of the log appended to.
+  size_t _logSize;           // Where the next record is appended in it.
+  bool _nextErased;          // The sector after it is erased.
+  uint32_t _seenRevision;    // Revision at the last update().
+  uint32_t _rtcRevision;     // Revision of the copy in RTC memory.
+  uint32_t _savedRevision;   // Revision of the copy in flash.
+  unsigned long _changeTime; // millis() of the last change seen.
+
+  // A header and its record, word aligned for the RTC memory.
+  uint32_t _buffer[(sizeof(RecordHeader) + Constants::MAX_STATE_SIZE + 3) /
+                   4];
+
+  RecordHeader &header();
+  size_t encode();
+  bool isValid(size_t available);
+  bool readRtc();
+  bool writeRtc(size_t length);
+  bool readLog();
+  size_t scanSector(size_t sector, size_t (&candidates)[2]);
+  bool readLogRecord(size_t sector, size_t offset);
+  bool appendLog(size_t length);
+};
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * @file StripOutput.h
+ * @brief Header file for the addressable LED strip output.
+ */
+
+#ifndef STRIPOUTPUT_H
+#define STRIPOUTPUT_H
+
+#include "Output.h"
+#include <Arduino.h>
+#include <NeoPixelBus.h>
+
+/**
+ * @class StripOutput
+ * @brief A WS2812/SK6812 (GRB) strip, each LED a pixel of the fixture.
+ *
+ * The data signal is generated by the I2S peripheral from a DMA buffer, so
+ * `show()` only encodes the pixels and returns while the hardware clocks them
+ * out, without disabling interrupts. The I2S data output is fixed to GPIO3
+ * (RX), so Serial must be started before `begin()` and can't receive.
+ *
+ * Encoding a long strip takes a good part of a frame, so `show()` skips it
+ * unless `write()` changed a pixel. It waits for the previous frame to be
+ * clocked out with yield(), so it can't be used from a Ticker.
+ */
+class StripOutput : public Output {
+public:
+  /**
+   * @param pixels The number of LEDs (max `Constants::MAX_PIXELS`).
+   */
+  explicit StripOutput(uint16_t pixels);
+
+  void begin(const Gamma::Table *curves) override;
+  size_t getPixelCount() const override;
+  void write(const ColorSpace::RGB16 *pixels) override;
+  void fill(const ColorSpace::RGB16 &color) override;
+  void show() override;
+  bool isTimerSafe() const override { return false; }
+
+private:
+  NeoPixelBus<NeoGrbFeature, NeoEsp8266Dma800KbpsMethod> _strip;
+  const Gamma::Table *_curves;
+  bool _dirty; // A pixel changed since the last show().
+};
+
+#endif
@@ -0,0 +1,142 @@
+/**
+ * @file Trace.h
+ * @brief Header file for the compile-time switchable hot path tracing.
+ *
+ * Building with SPOTLIGHT_TRACE=1 (env:nodemcuv2_trace) makes every
+ * `TRACE_SCOPE()` measure the CPU cycles until the end of its scope. The
+ * cycles are collected into a log2 histogram per trace point and a ring
+ * buffer of the most recent samples. They can be dumped over Serial (send
+ * 't', 'r' resets) or from `/trace`. Otherwise the macros compile to nothing.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+#ifndef SPOTLIGHT_TRACE
+#define SPOTLIGHT_TRACE 0
+#endif
+
+namespace Trace {
+
+enum Point : uint8_t {
+  // Rendering.
+  Update,
+  RenderFrame,
+  WriteLeds,
+
+  // ColorSpace conversions.
+  KelvinToRgb,
+  HsvToRgb,
+  RgbToLch,
+  LchToRgb,
+  RgbToHsl,
+  HslToRgb,
+  RgbToHsv,
+  FxLchToRgb,
+  FxHslToRgb,
+  FxHsvToRgb,
+  FxInterpolate,
+  RgbToOklch,
+  OklchToRgb,
+  FxOklchToRgb,
+
+  // Easing.
+  GetEasedValue,
+  GetEasedValueQ16,
+
+  // Server handlers.
+  HandleSetRGB,
+  HandleSetKelvin,
+  HandleSetWheelMode,
+  HandleSetEffectMode,
+  HandleSetCycleMode,
+  HandleSetCycleDuration,
+  HandleSetCycleEasing,
+  HandleSetTransitionDuration,
+  HandleSetTransitionEasing,
+  HandleSetInterpolation,
+  HandleSetBrightness,
+  HandleSetStreamSmoothing,
+  HandleBatch,
+  HandleUploadScene,
+  HandlePlayScene,
+  HandleMetrics,
+  HandleState,
+  HandleFileRequest,
+  HandleWebSocket,
+
+  // Real-time stream.
+  StreamPacket,
+
+  // Multicast group commands.
+  GroupCommand,
+
+  POINT_COUNT
+};
+
+// Histogram bucket i counts samples of [2^(i-1), 2^i) cycles, the last one
+// everything above.
+const size_t HISTOGRAM_BUCKETS = 20;
+// Number of recent samples kept in the ring buffer.
+const size_t RING_SIZE = 64;
+
+#if SPOTLIGHT_TRACE
+
+/**
+ * @brief Records a sample.
+ * @param point The trace point.
+ * @param cycles The CPU cycles the traced code took.
+ */
+void record(Point point, uint32_t cycles);
+
+/**
+ * @brief Clears all histograms and the ring buffer.
+ */
+void reset();
+
+/**
+ * @brief Writes the histograms and recent samples as text.
+ * @param out Where to write to, e.g. Serial.
+ */
+void dump(Print &out);
+
+/**
+ * @brief Writes the histograms and recent samples as text to a buffer.
+ * @param buffer The buffer to write to, always terminated.
+ * @param size The size of the buffer.
+ * @return The length of the text, cut off if the buffer is too small.
+ */
+size_t dump(char *buffer, size_t size);
+
+/**
+ * @brief Dumps or resets the traces on a 't' or 'r' from Serial.
+ */
+void pollSerial();
+
+/**
+ * @brief Measures the cycles from its construction to its destruction.
+ */
+class Scope {
+public:
+  explicit Scope(Point point) : _point(point), _start(ESP.getCycleCount()) {}
+  ~Scope() { record(_point, ESP.getCycleCount() - _start); }
+
+private:
+  Point _point;
+  uint32_t _start;
+};
+
+#define TRACE_SCOPE(point) Trace::Scope traceScope_(point)
+#define TRACE_POLL_SERIAL() Trace::pollSerial()
+
+#else
+
+#define TRACE_SCOPE(point) ((void)0)
+#define TRACE_POLL_SERIAL() ((void)0)
+
+#endif
+} // namespace Trace
+
+#endif
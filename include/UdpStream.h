@@ -0,0 +1,76 @@
+/**
+ * @file UdpStream.h
+ * @brief Header file for the real-time color stream over UDP.
+ *
+ * Music sync and show control software send a frame every 15-25 ms, more
+ * than HTTP requests keep up with. They stream with DDP (Distributed
+ * Display Protocol) instead, the UDP protocol WLED, xLights and others
+ * speak. Multi-byte header values are big-endian.
+ *
+ * | Offset | Field                                                    |
+ * |--------|----------------------------------------------------------|
+ * | 0      | flags (u8): 0x40 version 1, 0x10 timecode, 0x01 push     |
+ * | 1      | sequence (u8, low 4 bits, 1-15, 0 = not numbered)        |
+ * | 2      | data type (u8, 0x0B or 0 for 8 bit RGB)                  |
+ * | 3      | destination (u8, 1 = the output, 255 = all)              |
+ * | 4      | offset (u32) of the first channel                        |
+ * | 8      | length (u16) of the channel data                         |
+ * | 10     | timecode (u32), only with the timecode flag              |
+ * | 10/14  | length channel values, r, g, b per pixel                 |
+ *
+ * The channels address the pixels of all fixtures in order, see
+ * `Spotlight::streamChannels()`.
+ */
+
+#ifndef UDPSTREAM_H
+#define UDPSTREAM_H
+
+#include "Spotlight.h"
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+/**
+ * @class UdpStream
+ * @brief Receives DDP packets and feeds them to the spotlight.
+ *
+ * The channel values are read from the UDP packet straight into the
+ * spotlight's stream buffer. Packets arriving late or twice, according to
+ * their sequence number, are dropped, so an older frame never replaces a
+ * newer one.
+ */
+class UdpStream {
+public:
+  /**
+   * @brief Constructor for the UdpStream class.
+   * @param spotlight The spotlight to stream to.
+   */
+  explicit UdpStream(Spotlight *spotlight);
+
+  /**
+   * @brief Starts listening on `Constants::STREAM_PORT`. Can be called
+   * before WiFi is connected.
+   */
+  void begin();
+
+  /**
+   * @brief Reads the received packets. Should be called from the main loop.
+   */
+  void update();
+
+  /**
+   * @brief Checks whether a packet waits for `update()`, e.g. to end the
+   * idle delay of the main loop early.
+   */
+  bool hasPacket() { return _udp.available() > 0; }
+
+private:
+  WiFiUDP _udp;
+  Spotlight *_spotlight;
+  uint8_t _lastSequence; // Of the last packet applied, 0 for none.
+  uint8_t _rejected;     // Packets dropped in a row for their sequence.
+
+  void handlePacket(size_t size);
+  bool acceptSequence(uint8_t sequence);
+};
+
+#endif
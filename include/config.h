@@ -13,4 +13,22 @@
 #define WIFI_SSID "mrbr3"
 #define WIFI_PASSWORD "zaungoo1feegheiHaisu"
 
+// Optional static address, skips DHCP when connecting. The values are
+// passed to IPAddress, so use commas.
+// #define WIFI_STATIC_IP 192, 168, 1, 50
+// #define WIFI_GATEWAY 192, 168, 1, 1
+// #define WIFI_SUBNET 255, 255, 255, 0
+
+// Groups this unit answers group commands for, bit i is group i (see
+// GroupControl.h).
+// #define SPOTLIGHT_GROUPS 0x00000001UL
+
+// Power limiting (see Spotlight::setBrightness()). The current the red,
+// green and blue LED of a pixel draw at full duty in mA, measured on the
+// supply, and the current the supply delivers to all fixtures. The channel
+// current is the default of every output, set it per output with
+// Output::setChannelCurrent().
+// #define SPOTLIGHT_CHANNEL_CURRENT 20, 20, 20
+// #define SPOTLIGHT_POWER_BUDGET 2000
+
 #endif
@@ -0,0 +1,43 @@
+# Builds the LittleFS image from a gzipped copy of data/.
+#
+# Text assets are stored as <name>.gz only, the server sends them with
+# "Content-Encoding: gzip" (see SpotlightServer::handleFileRequest()). Other
+# files are copied as they are. Runs for the buildfs/uploadfs targets.
+
+import gzip
+import os
+import shutil
+
+Import("env")
+
+COMPRESSED_EXTENSIONS = (".html", ".css", ".js", ".json", ".svg")
+
+
+def compress_data(source_dir, target_dir):
+    if os.path.isdir(target_dir):
+        shutil.rmtree(target_dir)
+    for root, _, files in os.walk(source_dir):
+        relative_root = os.path.relpath(root, source_dir)
+        target_root = os.path.join(target_dir, relative_root)
+        os.makedirs(target_root, exist_ok=True)
+        for name in files:
+            source = os.path.join(root, name)
+            if name.endswith(COMPRESSED_EXTENSIONS):
+                target = os.path.join(target_root, name + ".gz")
+                with open(source, "rb") as f_in:
+                    # mtime=0 keeps the output, and so the ETag, reproducible.
+                    with gzip.GzipFile(target, "wb", 9, mtime=0) as f_out:
+                        shutil.copyfileobj(f_in, f_out)
+                print("Compressed %s: %d -> %d bytes"
+                      % (name, os.path.getsize(source), os.path.getsize(target)))
+            else:
+                shutil.copy2(source, os.path.join(target_root, name))
+
+
+FS_TARGETS = ("buildfs", "uploadfs", "uploadfsota")
+if any(target in FS_TARGETS for target in COMMAND_LINE_TARGETS):
+    data_dir = env.subst("$PROJECT_DATA_DIR")
+    workspace_dir = env.subst("$PROJECT_WORKSPACE_DIR")
+    compressed_dir = os.path.join(workspace_dir, "data_gz")
+    compress_data(data_dir, compressed_dir)
+    env.Replace(PROJECT_DATA_DIR=compressed_dir)
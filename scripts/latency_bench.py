@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+# Measures the command-to-photon latency of a SPOTLIGHT_LATENCY=1 build
+# (env:nodemcuv2_latency, see include/Latency.h).
+#
+# Fires bursts of "set RGB" commands over HTTP (/rgb) or the WebSocket
+# channel at the given rates, then reads the device side percentiles from
+# /latency. The highest rate without rejected or lost commands whose total
+# p99 stays below --max-p99-ms is reported as the max sustained rate.
+#
+#   scripts/latency_bench.py --host spotlight.local --rates 10,20,50,100
+#   scripts/latency_bench.py --transport ws --rates 50,100,200,400
+
+import argparse
+import base64
+import json
+import os
+import socket
+import struct
+import threading
+import time
+import urllib.error
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+WEBSOCKET_PORT = 81
+OPCODE_SET_RGB = 0x01
+
+
+def http_get(host, path, timeout=5.0):
+    url = "http://%s%s" % (host, path)
+    try:
+        with urllib.request.urlopen(url, timeout=timeout) as response:
+            return response.status, response.read()
+    except urllib.error.HTTPError as error:
+        return error.code, error.read()
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[(len(values) - 1) * p // 100]
+
+
+def ms(us):
+    return us / 1000.0
+
+
+def color(i):
+    # Consecutive commands always differ, so each one changes the output.
+    r = i % 256
+    return r, 255 - r, (i * 7) % 256
+
+
+class WebSocket:
+    """Just enough of RFC 6455 to send binary frames."""
+
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port), timeout=5.0)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(("GET / HTTP/1.1\r\nHost: %s:%d\r\n"
+                           "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: %s\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n"
+                           % (host, port, key)).encode())
+        response = b""
+        while b"\r\n\r\n" not in response:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise ConnectionError("WebSocket handshake failed")
+            response += chunk
+        if b" 101 " not in response.split(b"\r\n", 1)[0]:
+            raise ConnectionError("WebSocket handshake failed")
+        # The state pushes of the device are read and dropped, so its send
+        # buffer never fills up.
+        self.errors = 0
+        self.closed = False
+        self.reader = threading.Thread(target=self._read, daemon=True)
+        self.reader.start()
+
+    def _read(self):
+        self.sock.settimeout(None)
+        try:
+            while not self.closed:
+                data = self.sock.recv(1024)
+                if not data:
+                    break
+                # Error messages (0x81) are short enough to be in one read.
+                if len(data) >= 3 and data[2] == 0x81:
+                    self.errors += 1
+        except OSError:
+            pass
+
+    def send_binary(self, payload):
+        mask = os.urandom(4)
+        header = struct.pack("!BB", 0x82, 0x80 | len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def close(self):
+        self.closed = True
+        self.sock.close()
+
+
+def run_http(host, count, rate, concurrency):
+    round_trips = []
+    rejected = [0]
+    lock = threading.Lock()
+    start = time.monotonic()
+
+    def send(i):
+        if rate > 0:
+            delay = start + i / rate - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        r, g, b = color(i)
+        sent = time.monotonic()
+        try:
+            status, _ = http_get(host, "/rgb?r=%d&g=%d&b=%d" % (r, g, b))
+        except OSError:
+            status = 0
+        elapsed = time.monotonic() - sent
+        with lock:
+            if status == 200:
+                round_trips.append(elapsed)
+            else:
+                rejected[0] += 1
+
+    with ThreadPoolExecutor(max_workers=concurrency) as pool:
+        list(pool.map(send, range(count)))
+    duration = time.monotonic() - start
+    return round_trips, rejected[0], duration
+
+
+def run_ws(host, count, rate):
+    ws = WebSocket(host, WEBSOCKET_PORT)
+    start = time.monotonic()
+    for i in range(count):
+        if rate > 0:
+            delay = start + i / rate - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        ws.send_binary(bytes((OPCODE_SET_RGB,) + color(i)))
+    duration = time.monotonic() - start
+    # Leave the device time to render the last command before closing.
+    time.sleep(0.5)
+    ws.close()
+    return [], ws.errors, duration
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measures the command-to-photon latency of a "
+                    "SPOTLIGHT_LATENCY=1 build.")
+    parser.add_argument("--host", default="spotlight.local")
+    parser.add_argument("--transport", choices=("http", "ws"),
+                        default="http")
+    parser.add_argument("--count", type=int, default=200,
+                        help="commands per burst (the device keeps the "
+                             "last 256)")
+    parser.add_argument("--rates", default="10,20,50,100,0",
+                        help="comma-separated commands/s, 0 is as fast as "
+                             "possible")
+    parser.add_argument("--concurrency", type=int, default=1,
+                        help="parallel HTTP requests")
+    parser.add_argument("--max-p99-ms", type=float, default=50.0,
+                        help="total p99 a rate may have to count as "
+                             "sustained")
+    args = parser.parse_args()
+
+    # Without a transition the output changes on the first frame.
+    status, _ = http_get(args.host, "/setTransitionDuration?duration=0")
+    if status != 200:
+        raise SystemExit("Failed to set the transition duration")
+
+    print("%8s %8s %5s %9s %9s %9s %9s %9s %9s" % (
+        "offered", "achieved", "lost", "rtt p50", "rtt p99", "apply p99",
+        "render p99", "total p50", "total p99"))
+    sustained = 0.0
+    for rate in (float(r) for r in args.rates.split(",")):
+        status, _ = http_get(args.host, "/resetLatency")
+        if status != 200:
+            raise SystemExit("/resetLatency failed, is this a "
+                             "SPOTLIGHT_LATENCY=1 build?")
+        if args.transport == "http":
+            round_trips, rejected, duration = run_http(
+                args.host, args.count, rate, args.concurrency)
+        else:
+            round_trips, rejected, duration = run_ws(args.host, args.count,
+                                                     rate)
+        time.sleep(0.2)
+        status, body = http_get(args.host, "/latency")
+        if status != 200:
+            raise SystemExit("/latency failed: %d" % status)
+        stats = json.loads(body)
+
+        # Commands the device never counted, or never wrote, are lost too.
+        lost = rejected + max(0, args.count - rejected - stats["written"])
+        achieved = args.count / duration if duration > 0 else 0.0
+        print("%8s %8.1f %5d %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f" % (
+            "max" if rate <= 0 else "%.0f" % rate, achieved, lost,
+            percentile(round_trips, 50) * 1000,
+            percentile(round_trips, 99) * 1000,
+            ms(stats["apply"]["p99"]), ms(stats["render"]["p99"]),
+            ms(stats["total"]["p50"]), ms(stats["total"]["p99"])))
+        if lost == 0 and ms(stats["total"]["p99"]) <= args.max_p99_ms:
+            sustained = max(sustained, stats["commandsPerSecond"])
+
+    print("max sustained: %.0f commands/s (total p99 <= %.0f ms)"
+          % (sustained, args.max_p99_ms))
+
+
+if __name__ == "__main__":
+    main()
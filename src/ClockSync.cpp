@@ -0,0 +1,131 @@
+/**
+ * @file ClockSync.cpp
+ * @brief Implementation file for the clock shared by several spotlights.
+ */
+
+#include "ClockSync.h"
+#include "Constants.h"
+#include "Log.h"
+#include <ESP8266WiFi.h>
+
+namespace {
+const uint8_t MAGIC[2] = {'S', 'C'};
+const uint8_t VERSION = 1;
+const size_t BEACON_SIZE = 11;
+// The leader ID while no lower unit is followed.
+const uint32_t NO_UNIT = UINT32_MAX;
+
+IPAddress clockGroup() {
+  return IPAddress(Constants::CLOCK_GROUP[0], Constants::CLOCK_GROUP[1],
+                   Constants::CLOCK_GROUP[2], Constants::CLOCK_GROUP[3]);
+}
+
+void writeU32(uint8_t *p, uint32_t value) {
+  for (size_t i = 0; i < 4; ++i) {
+    p[i] = value >> (8 * i);
+  }
+}
+
+uint32_t readU32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+} // namespace
+
+// Constructor
+ClockSync::ClockSync(Spotlight *spotlight)
+    : _spotlight(spotlight), _id(ESP.getChipId()), _joined(false),
+      _leaderId(NO_UNIT), _leaderSeenTime(0), _beaconTime(0), _synced(false),
+      _samples(0), _bestOffset(0) {}
+
+void ClockSync::update() {
+  if (!_joined) {
+    if (WiFi.status() != WL_CONNECTED) {
+      return;
+    }
+    _joined = _udp.beginMulticast(WiFi.localIP(), clockGroup(),
+                                  Constants::CLOCK_PORT);
+    if (!_joined) {
+      return;
+    }
+    // Listen for a leader before leading.
+    _leaderSeenTime = millis();
+    LOG_INFO("Clock sync started, unit %08x", static_cast<unsigned>(_id));
+  }
+
+  receive();
+  unsigned long now = millis();
+  if (isLeader() && now - _beaconTime >= Constants::CLOCK_BEACON_INTERVAL) {
+    _beaconTime = now;
+    sendBeacon();
+  }
+}
+
+bool ClockSync::isLeader() const {
+  return _joined &&
+         millis() - _leaderSeenTime >= Constants::CLOCK_LEADER_TIMEOUT;
+}
+
+void ClockSync::receive() {
+  while (_udp.parsePacket() > 0) {
+    uint8_t beacon[BEACON_SIZE];
+    size_t length = _udp.read(beacon, sizeof(beacon));
+    unsigned long now = millis(); // As close to the arrival as possible.
+    if (length != BEACON_SIZE || beacon[0] != MAGIC[0] ||
+        beacon[1] != MAGIC[1] || beacon[2] != VERSION) {
+      continue;
+    }
+    uint32_t id = readU32(beacon + 3);
+    if (id == _id) {
+      continue;
+    }
+    if (id > _id) {
+      // A higher ID doesn't lead, but its clock is the shared one while
+      // this unit still listens, so it's adopted before leading.
+      if (_leaderId == NO_UNIT && !isLeader()) {
+        addSample(readU32(beacon + 7) - now);
+      }
+      continue;
+    }
+    // A new leader replaces the one followed only once that one went
+    // silent, or if it's lower still.
+    if (id > _leaderId && !isLeader()) {
+      continue;
+    }
+    if (id != _leaderId) {
+      LOG_INFO("Following the clock of unit %08x", static_cast<unsigned>(id));
+      _leaderId = id;
+      _synced = false;
+      _samples = 0;
+    }
+    _leaderSeenTime = now;
+    addSample(readU32(beacon + 7) - now);
+  }
+}
+
+void ClockSync::sendBeacon() {
+  uint8_t beacon[BEACON_SIZE] = {MAGIC[0], MAGIC[1], VERSION};
+  writeU32(beacon + 3, _id);
+  writeU32(beacon + 7, _spotlight->getTime());
+  _udp.beginPacketMulticast(clockGroup(), Constants::CLOCK_PORT,
+                            WiFi.localIP());
+  _udp.write(beacon, sizeof(beacon));
+  _udp.endPacket();
+}
+
+// Filters the offsets of the beacons, applying the best one per window.
+void ClockSync::addSample(unsigned long offset) {
+  if (_samples == 0 || static_cast<long>(offset - _bestOffset) > 0) {
+    _bestOffset = offset;
+  }
+  if (!_synced) {
+    // Get close right away, the window refines it.
+    _spotlight->setClockOffset(_bestOffset);
+    _synced = true;
+  }
+  if (++_samples >= Constants::CLOCK_FILTER_BEACONS) {
+    _spotlight->setClockOffset(_bestOffset);
+    _samples = 0;
+  }
+}
@@ -4,10 +4,29 @@
  */
 
 #include "ColorSpace.h"
+#include "Trace.h"
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 namespace ColorSpace {
+namespace {
+// The sRGB transfer function, between the encoded channel values (0.0-1.0)
+// and linear light.
+float srgbToLinear(float v) {
+  return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float v) {
+  return v <= 0.0031308f ? 12.92f * v
+                         : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+}
+
+uint8_t channelFromFloat(float v) {
+  return static_cast<uint8_t>(std::max(0.0f, std::min(1.0f, v)) * 255.0f +
+                              0.5f);
+}
+} // namespace
 
 // Overloaded operators for LCH struct.
 LCH operator+(const LCH &a, const LCH &b) {
@@ -24,7 +43,21 @@ LCH operator*(const LCH &a, float scalar) {
 
 LCH operator*(float scalar, const LCH &a) { return a * scalar; }
 
+// Comparison operators for RGB struct.
+bool operator==(const RGB &a, const RGB &b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+bool operator!=(const RGB &a, const RGB &b) { return !(a == b); }
+
+bool operator==(const RGB16 &a, const RGB16 &b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+bool operator!=(const RGB16 &a, const RGB16 &b) { return !(a == b); }
+
 RGB kelvinToRgb(float kelvin) {
+  TRACE_SCOPE(Trace::KelvinToRgb);
   float temp = kelvin / 100.0;
   float red, green, blue;
 
@@ -67,6 +100,7 @@ RGB kelvinToRgb(float kelvin) {
 }
 
 RGB hslToRgb(const HSL &hsl) {
+  TRACE_SCOPE(Trace::HslToRgb);
   float r_f, g_f, b_f;
   if (hsl.s == 0.0f) {
     r_f = g_f = b_f = hsl.l;
@@ -97,6 +131,7 @@ RGB hslToRgb(const HSL &hsl) {
 }
 
 void rgbToHsv(const RGB &rgb, float &h, float &s, float &v) {
+  TRACE_SCOPE(Trace::RgbToHsv);
   float r_f = rgb.r / 255.0f;
   float g_f = rgb.g / 255.0f;
   float b_f = rgb.b / 255.0f;
@@ -128,6 +163,7 @@ void rgbToHsv(const RGB &rgb, float &h, float &s, float &v) {
 }
 
 RGB hsvToRgb(float h, float s, float v) {
+  TRACE_SCOPE(Trace::HsvToRgb);
   float c = v * s;
   float h_prime = fmod(h / 60.0f, 6.0f);
   float x = c * (1.0f - std::abs(fmod(h_prime, 2.0f) - 1.0f));
@@ -169,6 +205,7 @@ RGB hsvToRgb(float h, float s, float v) {
 // Convert RGB to LCH (Luminance, Chroma, Hue)
 // This is a simplified conversion, not a full CIE LCH implementation
 LCH rgbToLch(const RGB &rgb) {
+  TRACE_SCOPE(Trace::RgbToLch);
   float r = rgb.r / 255.0f;
   float g = rgb.g / 255.0f;
   float b = rgb.b / 255.0f;
@@ -200,6 +237,7 @@ LCH rgbToLch(const RGB &rgb) {
 
 // Convert LCH to RGB
 RGB lchToRgb(const LCH &lch) {
+  TRACE_SCOPE(Trace::LchToRgb);
   float s = lch.c;
   if (lch.l < 0.5f) {
     s = (lch.c == 0.0f) ? 0.0f : lch.c / (2.0f * lch.l);
@@ -210,7 +248,52 @@ RGB lchToRgb(const LCH &lch) {
   return hslToRgb({lch.h, s, lch.l});
 }
 
+// Convert RGB to OKLCH, through linear light and OKLab.
+LCH rgbToOklch(const RGB &rgb) {
+  TRACE_SCOPE(Trace::RgbToOklch);
+  float r = srgbToLinear(rgb.r / 255.0f);
+  float g = srgbToLinear(rgb.g / 255.0f);
+  float b = srgbToLinear(rgb.b / 255.0f);
+
+  // Cone responses, then OKLab.
+  float l = cbrtf(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+  float m = cbrtf(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+  float s = cbrtf(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+  float lightness = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+  float labA = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+  float labB = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+
+  float h = atan2f(labB, labA) * (180.0f / PI);
+  if (h < 0.0f) {
+    h += 360.0f;
+  }
+  return {lightness, sqrtf(labA * labA + labB * labB), h};
+}
+
+// Convert OKLCH to RGB
+RGB oklchToRgb(const LCH &lch) {
+  TRACE_SCOPE(Trace::OklchToRgb);
+  float hue = lch.h * (PI / 180.0f);
+  float labA = lch.c * cosf(hue);
+  float labB = lch.c * sinf(hue);
+
+  float l = lch.l + 0.3963377774f * labA + 0.2158037573f * labB;
+  float m = lch.l - 0.1055613458f * labA - 0.0638541728f * labB;
+  float s = lch.l - 0.0894841775f * labA - 1.2914855480f * labB;
+  l = l * l * l;
+  m = m * m * m;
+  s = s * s * s;
+
+  float r = 4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s;
+  float g = -1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s;
+  float b = -0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s;
+  return {channelFromFloat(linearToSrgb(std::max(0.0f, r))),
+          channelFromFloat(linearToSrgb(std::max(0.0f, g))),
+          channelFromFloat(linearToSrgb(std::max(0.0f, b)))};
+}
+
 HSL rgbToHsl(const RGB &rgb) {
+  TRACE_SCOPE(Trace::RgbToHsl);
   float r_f = rgb.r / 255.0f;
   float g_f = rgb.g / 255.0f;
   float b_f = rgb.b / 255.0f;
@@ -240,13 +323,372 @@ HSL rgbToHsl(const RGB &rgb) {
 }
 
 RGB hexToRgb(const String &hexString) {
-  if (hexString.length() != 6) {
+  return hexToRgb(hexString.c_str(), hexString.length());
+}
+
+RGB hexToRgb(const char *hex, size_t length) {
+  if (length != 6) {
     return {0, 0, 0};
   }
-  long number = strtol(hexString.c_str(), NULL, 16);
+  uint32_t number = 0;
+  for (size_t i = 0; i < length; ++i) {
+    char c = hex[i];
+    uint8_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return {0, 0, 0};
+    }
+    number = (number << 4) | digit;
+  }
   uint8_t r = (number >> 16) & 0xFF;
   uint8_t g = (number >> 8) & 0xFF;
   uint8_t b = number & 0xFF;
   return {r, g, b};
 }
+
+size_t hexListToRgb(const char *list, RGB *colors, size_t maxCount) {
+  size_t count = 0;
+  const char *start = list;
+  while (*start != '\0' && count < maxCount) {
+    const char *end = strchr(start, ',');
+    if (end == nullptr) {
+      colors[count++] = hexToRgb(start, strlen(start));
+      break;
+    }
+    colors[count++] = hexToRgb(start, end - start);
+    start = end + 1;
+  }
+  return count;
+}
+
+namespace fx {
+namespace {
+const uint32_t kOne = 65535;
+
+// Multiplies two unorm16 values, rounding the division by 65535.
+inline uint32_t mul(uint32_t a, uint32_t b) {
+  uint32_t x = a * b + 0x8000;
+  return (x + (x >> 16)) >> 16;
+}
+
+// Converts a unorm16 value to 8 bits, truncating like the float versions.
+inline uint8_t to8(uint32_t v) { return (v * 255u + 255u) >> 16; }
+
+inline uint16_t clampUnorm(int32_t v) {
+  return v < 0 ? 0 : (v > static_cast<int32_t>(kOne) ? kOne : v);
+}
+
+inline int32_t lerp(int32_t a, int32_t b, int32_t t) {
+  return a + static_cast<int32_t>((static_cast<int64_t>(b - a) * t) >> 16);
+}
+
+inline uint16_t unormFromFloat(float v) {
+  return clampUnorm(static_cast<int32_t>(v * kOne + 0.5f));
+}
+
+// Same as the hue2rgb lambda in hslToRgb(), with t as binary angle.
+inline uint32_t hueToChannel(uint32_t p, uint32_t q, uint16_t t) {
+  const uint16_t sixth = 10923;      // 1/6 turn
+  const uint16_t half = 32768;       // 1/2 turn
+  const uint16_t twoThirds = 43691;  // 2/3 turn
+  if (t < sixth)
+    return p + (((q - p) * (6u * t)) >> 16);
+  if (t < half)
+    return q;
+  if (t < twoThirds)
+    return p + (((q - p) * std::min(kOne, 6u * (twoThirds - t))) >> 16);
+  return p;
+}
+
+// --- Compile-Time Lookup Tables for OKLCH ---
+// Generated with constexpr math like the easing tables, in double precision.
+namespace Gen {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kLn2 = 0.69314718055994530942;
+
+constexpr double sin(double x) {
+  // Reduce to [-pi, pi], then use the Taylor series.
+  long long turns = static_cast<long long>(x / (2.0 * kPi));
+  x -= static_cast<double>(turns) * 2.0 * kPi;
+  if (x > kPi)
+    x -= 2.0 * kPi;
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 20; ++n) {
+    term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+    sum += term;
+  }
+  return sum;
+}
+
+// Natural logarithm of x > 0, reduced to [0.5, 1) for the atanh series.
+constexpr double log(double x) {
+  int n = 0;
+  for (; x >= 1.0; ++n)
+    x *= 0.5;
+  for (; x < 0.5; --n)
+    x *= 2.0;
+  double y = (x - 1.0) / (x + 1.0);
+  double term = y;
+  double sum = 0.0;
+  for (int k = 1; k < 60; k += 2) {
+    sum += term / k;
+    term *= y * y;
+  }
+  return 2.0 * sum + n * kLn2;
+}
+
+// e^x, split into a power of two and the Taylor series of the rest.
+constexpr double exp(double x) {
+  long long n = static_cast<long long>(x / kLn2);
+  if (static_cast<double>(n) * kLn2 > x)
+    --n;
+  double f = x - static_cast<double>(n) * kLn2;
+  double term = 1.0;
+  double sum = 1.0;
+  for (int k = 1; k < 25; ++k) {
+    term *= f / k;
+    sum += term;
+  }
+  for (; n > 0; --n)
+    sum *= 2.0;
+  for (; n < 0; ++n)
+    sum *= 0.5;
+  return sum;
+}
+
+constexpr double linearToSrgb(double v) {
+  return v <= 0.0031308 ? 12.92 * v : 1.055 * exp(log(v) / 2.4) - 0.055;
+}
+
+// A turn of the sine in Q30, and the sRGB encoding of linear unorm16
+// values. The sRGB curve is steep near black, so it gets more segments.
+const uint8_t SINE_BITS = 10;
+const uint8_t SRGB_BITS = 10;
+
+struct Tables {
+  int32_t sine[(1u << SINE_BITS) + 1];
+  uint16_t srgb[(1u << SRGB_BITS) + 1];
+};
+
+// Converts to fixed point with the given number of fractional bits.
+constexpr int64_t fixed(double v, int bits) {
+  double scaled = v * static_cast<double>(1LL << bits);
+  return static_cast<int64_t>(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+constexpr Tables makeTables() {
+  Tables tables{};
+  for (size_t i = 0; i <= (1u << SINE_BITS); ++i) {
+    tables.sine[i] = static_cast<int32_t>(
+        fixed(sin(2.0 * kPi * i / (1u << SINE_BITS)), 30));
+  }
+  for (size_t i = 0; i <= (1u << SRGB_BITS); ++i) {
+    double v = linearToSrgb(static_cast<double>(i) / (1u << SRGB_BITS));
+    tables.srgb[i] = static_cast<uint16_t>(std::min(1.0, v) * kOne + 0.5);
+  }
+  return tables;
+}
+} // namespace Gen
+
+// The tables live in flash to keep them out of the scarce RAM.
+constexpr Gen::Tables kOklchTables PROGMEM = Gen::makeTables();
+
+// The OKLab math runs in Q28 with 64 bit intermediates, the cube and the
+// matrices would amplify the rounding errors of Q16 into visible steps.
+const int kBits = 28;
+
+inline int64_t shiftRound(int64_t v, int bits) {
+  return (v + (1LL << (bits - 1))) >> bits;
+}
+
+// Sine of a binary angle in Q30.
+inline int64_t sine(uint16_t angle) {
+  const uint8_t shift = 16 - Gen::SINE_BITS;
+  uint32_t index = angle >> shift;
+  int64_t frac = angle & ((1u << shift) - 1);
+  int64_t a = static_cast<int32_t>(pgm_read_dword(&kOklchTables.sine[index]));
+  int64_t b =
+      static_cast<int32_t>(pgm_read_dword(&kOklchTables.sine[index + 1]));
+  return a + (((b - a) * frac) >> shift);
+}
+
+// Encodes a linear Q16 channel value to sRGB, clipping it to the gamut.
+inline uint16_t encodeSrgb(int64_t linear) {
+  if (linear <= 0) {
+    return 0;
+  }
+  if (linear >= kOne) {
+    return kOne;
+  }
+  const uint8_t shift = 16 - Gen::SRGB_BITS;
+  uint32_t index = static_cast<uint32_t>(linear) >> shift;
+  int32_t frac = linear & ((1u << shift) - 1);
+  int32_t a = pgm_read_word(&kOklchTables.srgb[index]);
+  int32_t b = pgm_read_word(&kOklchTables.srgb[index + 1]);
+  return a + (((b - a) * frac) >> shift);
+}
+
+inline int64_t cube(int64_t x) {
+  return shiftRound(shiftRound(x * x, kBits) * x, kBits);
+}
+
+// The way back from OKLab to linear sRGB: a and b to the cube roots of the
+// cone responses, and the cone responses to the channels.
+constexpr int64_t kLabToLms[3][2] = {
+    {Gen::fixed(0.3963377774, kBits), Gen::fixed(0.2158037573, kBits)},
+    {Gen::fixed(-0.1055613458, kBits), Gen::fixed(-0.0638541728, kBits)},
+    {Gen::fixed(-0.0894841775, kBits), Gen::fixed(-1.2914855480, kBits)}};
+constexpr int64_t kLmsToRgb[3][3] = {
+    {Gen::fixed(4.0767416621, kBits), Gen::fixed(-3.3077115913, kBits),
+     Gen::fixed(0.2309699292, kBits)},
+    {Gen::fixed(-1.2684380046, kBits), Gen::fixed(2.6097574011, kBits),
+     Gen::fixed(-0.3413193965, kBits)},
+    {Gen::fixed(-0.0041960863, kBits), Gen::fixed(-0.7034186147, kBits),
+     Gen::fixed(1.7076147010, kBits)}};
+// Unorm16 lightness and chroma to Q28, with 16 more bits of precision.
+constexpr int64_t kLightnessScale = Gen::fixed(1.0 / kOne, kBits + 16);
+constexpr int64_t kChromaScale =
+    Gen::fixed(OKLCH_MAX_CHROMA / kOne, kBits + 16);
+
+// Chroma below this is taken as gray by fromOklch(), about 0.002.
+const uint16_t kGrayChroma = 328;
+} // namespace
+
+RGB16 toRgb16(const RGB &rgb) {
+  // Multiplying by 257 maps 255 to 65535 exactly.
+  return {static_cast<uint16_t>(rgb.r * 257u),
+          static_cast<uint16_t>(rgb.g * 257u),
+          static_cast<uint16_t>(rgb.b * 257u)};
+}
+
+RGB toRgb8(const RGB16 &rgb) { return {to8(rgb.r), to8(rgb.g), to8(rgb.b)}; }
+
+LCH fromLch(const ColorSpace::LCH &lch) {
+  return {unormFromFloat(lch.l), unormFromFloat(lch.c),
+          hueFromDegrees(lch.h)};
+}
+
+uint16_t hueFromDegrees(float degrees) {
+  return static_cast<uint16_t>(
+      static_cast<int32_t>(lroundf(degrees * (65536.0f / 360.0f))));
+}
+
+LCH interpolate(const LCH &a, const LCH &b, int32_t t) {
+  TRACE_SCOPE(Trace::FxInterpolate);
+  return {clampUnorm(lerp(a.l, b.l, t)), clampUnorm(lerp(a.c, b.c, t)),
+          static_cast<uint16_t>(lerp(a.h, b.h, t))};
+}
+
+LCH fromOklch(const ColorSpace::LCH &lch) {
+  uint16_t c = unormFromFloat(lch.c / OKLCH_MAX_CHROMA);
+  if (c < kGrayChroma) {
+    return {unormFromFloat(lch.l), 0, 0};
+  }
+  return {unormFromFloat(lch.l), c, hueFromDegrees(lch.h)};
+}
+
+LCH fromRgb(const RGB &rgb, Interpolation space) {
+  return space == Interpolation::Oklch
+             ? fromOklch(ColorSpace::rgbToOklch(rgb))
+             : fromLch(ColorSpace::rgbToLch(rgb));
+}
+
+LCH interpolateOklch(const LCH &a, const LCH &b, int32_t t) {
+  TRACE_SCOPE(Trace::FxInterpolate);
+  uint16_t from = a.c == 0 ? b.h : a.h;
+  uint16_t to = b.c == 0 ? from : b.h;
+  // The difference of binary angles is the shorter way around.
+  int16_t delta = static_cast<int16_t>(to - from);
+  return {clampUnorm(lerp(a.l, b.l, t)), clampUnorm(lerp(a.c, b.c, t)),
+          static_cast<uint16_t>(
+              from + ((static_cast<int64_t>(delta) * t) >> 16))};
+}
+
+LCH interpolate(const LCH &a, const LCH &b, int32_t t, Interpolation space) {
+  return space == Interpolation::Oklch ? interpolateOklch(a, b, t)
+                                       : interpolate(a, b, t);
+}
+
+RGB16 oklchToRgb(const LCH &lch) {
+  TRACE_SCOPE(Trace::FxOklchToRgb);
+  int64_t lightness = shiftRound(lch.l * kLightnessScale, 16);
+  int64_t chroma = shiftRound(lch.c * kChromaScale, 16);
+  int64_t labA = shiftRound(chroma * sine(lch.h + 16384), 30);
+  int64_t labB = shiftRound(chroma * sine(lch.h), 30);
+
+  int64_t lms[3];
+  for (size_t i = 0; i < 3; ++i) {
+    lms[i] = cube(lightness + shiftRound(kLabToLms[i][0] * labA +
+                                             kLabToLms[i][1] * labB,
+                                         kBits));
+  }
+  uint16_t rgb[3];
+  for (size_t i = 0; i < 3; ++i) {
+    rgb[i] = encodeSrgb(shiftRound(kLmsToRgb[i][0] * lms[0] +
+                                       kLmsToRgb[i][1] * lms[1] +
+                                       kLmsToRgb[i][2] * lms[2],
+                                   2 * kBits - 16));
+  }
+  return {rgb[0], rgb[1], rgb[2]};
+}
+
+RGB16 lchToRgb(const LCH &lch, Interpolation space) {
+  return space == Interpolation::Oklch ? oklchToRgb(lch) : lchToRgb(lch);
+}
+
+RGB16 lchToRgb(const LCH &lch) {
+  TRACE_SCOPE(Trace::FxLchToRgb);
+  // Same chroma to saturation mapping as the float lchToRgb().
+  uint32_t denominator = lch.l < 32768 ? 2u * lch.l : 2u * (kOne - lch.l);
+  uint32_t s = 0;
+  if (lch.c != 0 && denominator != 0) {
+    s = std::min(kOne, (lch.c * kOne + denominator / 2) / denominator);
+  }
+  return hslToRgb(lch.h, s, lch.l);
+}
+
+RGB16 hslToRgb(uint16_t h, uint16_t s, uint16_t l) {
+  TRACE_SCOPE(Trace::FxHslToRgb);
+  if (s == 0) {
+    return {l, l, l};
+  }
+  uint32_t q = l < 32768 ? l + mul(l, s) : l + s - mul(l, s);
+  uint32_t p = 2u * l - q;
+  return {static_cast<uint16_t>(hueToChannel(p, q, h + 21845)),
+          static_cast<uint16_t>(hueToChannel(p, q, h)),
+          static_cast<uint16_t>(hueToChannel(p, q, h - 21845))};
+}
+
+RGB16 hsvToRgb(uint16_t h, uint16_t s, uint16_t v) {
+  TRACE_SCOPE(Trace::FxHsvToRgb);
+  uint32_t scaled = 6u * h;
+  uint32_t sector = scaled >> 16;
+  uint32_t f = scaled & 0xFFFF;
+
+  uint16_t p = mul(v, kOne - s);
+  uint16_t q = mul(v, kOne - mul(s, f));
+  uint16_t t = mul(v, kOne - mul(s, kOne - f));
+
+  switch (sector) {
+  case 0:
+    return {v, t, p};
+  case 1:
+    return {q, v, p};
+  case 2:
+    return {p, v, t};
+  case 3:
+    return {p, q, v};
+  case 4:
+    return {t, p, v};
+  default:
+    return {v, p, q};
+  }
+}
+} // namespace fx
 } // namespace ColorSpace
@@ -4,11 +4,194 @@
  */
 
 #include "Easing.h"
+#include "Trace.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 namespace Easing {
 
+// --- Compile-Time Lookup Table Generation ---
+// The <cmath> functions aren't constexpr, so the tables are generated with
+// small constexpr replacements. They run at compile time only, in double
+// precision.
+namespace {
+namespace Gen {
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr double sin(double x) {
+  // Reduce to [-pi, pi], then use the Taylor series.
+  long long turns = static_cast<long long>(x / (2.0 * kPi));
+  x -= static_cast<double>(turns) * 2.0 * kPi;
+  if (x > kPi)
+    x -= 2.0 * kPi;
+  if (x < -kPi)
+    x += 2.0 * kPi;
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 20; ++n) {
+    term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double cos(double x) { return sin(x + kPi / 2.0); }
+
+constexpr double sqrt(double x) {
+  if (x <= 0.0)
+    return 0.0;
+  double r = x < 1.0 ? 1.0 : x;
+  for (int i = 0; i < 64; ++i) {
+    r = 0.5 * (r + x / r);
+  }
+  return r;
+}
+
+// 2^x, split into an integer power and exp() of the fractional part.
+constexpr double exp2(double x) {
+  long long n = static_cast<long long>(x);
+  if (static_cast<double>(n) > x)
+    --n;
+  double f = (x - static_cast<double>(n)) * 0.69314718055994530942;
+  double term = 1.0;
+  double sum = 1.0;
+  for (int k = 1; k < 25; ++k) {
+    term *= f / k;
+    sum += term;
+  }
+  for (; n > 0; --n)
+    sum *= 2.0;
+  for (; n < 0; ++n)
+    sum *= 0.5;
+  return sum;
+}
+
+// constexpr copies of the easing functions below.
+constexpr double bounceOut(double t) {
+  if (t < 1.0 / 2.75) {
+    return 7.5625 * t * t;
+  } else if (t < 2.0 / 2.75) {
+    t -= 1.5 / 2.75;
+    return 7.5625 * t * t + 0.75;
+  } else if (t < 2.5 / 2.75) {
+    t -= 2.25 / 2.75;
+    return 7.5625 * t * t + 0.9375;
+  } else {
+    t -= 2.625 / 2.75;
+    return 7.5625 * t * t + 0.984375;
+  }
+}
+
+constexpr double eased(EasingFunction func, double t) {
+  switch (func) {
+  case EasingFunction::SineInOut:
+    return -(cos(kPi * t) - 1.0) / 2.0;
+  case EasingFunction::QuadInOut:
+    return t < 0.5 ? 2.0 * t * t : -1.0 + (4.0 - 2.0 * t) * t;
+  case EasingFunction::CubicInOut:
+    return t < 0.5 ? 4.0 * t * t * t
+                   : (t - 1.0) * (2.0 * t - 2.0) * (2.0 * t - 2.0) + 1.0;
+  case EasingFunction::QuartInOut: {
+    double f = t * 2.0;
+    if (f < 1.0)
+      return 0.5 * f * f * f * f;
+    double f2 = f - 2.0;
+    return -0.5 * (f2 * f2 * f2 * f2 - 2.0);
+  }
+  case EasingFunction::QuintInOut: {
+    double f = t * 2.0;
+    if (f < 1.0)
+      return 0.5 * f * f * f * f * f;
+    double f2 = f - 2.0;
+    return 0.5 * (f2 * f2 * f2 * f2 * f2 + 2.0);
+  }
+  case EasingFunction::CircInOut: {
+    double f = t * 2.0;
+    if (f < 1.0)
+      return -0.5 * (sqrt(1.0 - f * f) - 1.0);
+    double f2 = f - 2.0;
+    return 0.5 * (sqrt(1.0 - f2 * f2) + 1.0);
+  }
+  case EasingFunction::ElasticInOut: {
+    if (t == 0.0 || t == 1.0)
+      return t;
+    double p = 0.3 * 1.5;
+    double s = p / 4.0;
+    double f = t * 2.0 - 1.0;
+    if (f < 0.0)
+      return -0.5 * (exp2(10.0 * f) * sin((f - s) * (2.0 * kPi) / p));
+    return exp2(-10.0 * f) * sin((f - s) * (2.0 * kPi) / p) * 0.5 + 1.0;
+  }
+  case EasingFunction::BackInOut: {
+    double s = 1.70158 * 1.525;
+    double f = t * 2.0;
+    if (f < 1.0)
+      return 0.5 * (f * f * ((s + 1.0) * f - s));
+    double f2 = f - 2.0;
+    return 0.5 * (f2 * f2 * ((s + 1.0) * f2 + s) + 2.0);
+  }
+  case EasingFunction::BounceInOut:
+    if (t < 0.5)
+      return (1.0 - bounceOut(1.0 - t * 2.0)) * 0.5;
+    return bounceOut(t * 2.0 - 1.0) * 0.5 + 0.5;
+  default:
+    return t;
+  }
+}
+
+struct Table {
+  q16_t values[EASING_FUNCTION_COUNT][TABLE_SEGMENTS + 1];
+};
+
+constexpr Table makeTable() {
+  Table table{};
+  for (size_t f = 0; f < EASING_FUNCTION_COUNT; ++f) {
+    for (size_t i = 0; i <= TABLE_SEGMENTS; ++i) {
+      double v = eased(static_cast<EasingFunction>(f),
+                       static_cast<double>(i) / TABLE_SEGMENTS);
+      double scaled = v * Q16_ONE;
+      table.values[f][i] = static_cast<q16_t>(scaled < 0.0 ? scaled - 0.5
+                                                           : scaled + 0.5);
+    }
+  }
+  return table;
+}
+
+} // namespace Gen
+
+// The tables live in flash to keep them out of the scarce RAM.
+constexpr Gen::Table kEasingTable PROGMEM = Gen::makeTable();
+
+const uint32_t kSegmentShift = 16 - EASING_TABLE_BITS;
+const uint32_t kSegmentMask = (1u << kSegmentShift) - 1;
+} // namespace
+
+q16_t getEasedValueQ16(EasingFunction func, uint32_t t) {
+  TRACE_SCOPE(Trace::GetEasedValueQ16);
+  if (static_cast<size_t>(func) >= EASING_FUNCTION_COUNT) {
+    func = EasingFunction::Linear;
+  }
+  const q16_t *entries = kEasingTable.values[func];
+  if (t >= static_cast<uint32_t>(Q16_ONE)) {
+    return static_cast<q16_t>(pgm_read_dword(&entries[TABLE_SEGMENTS]));
+  }
+  uint32_t index = t >> kSegmentShift;
+  int32_t frac = t & kSegmentMask;
+  q16_t a = static_cast<q16_t>(pgm_read_dword(&entries[index]));
+  q16_t b = static_cast<q16_t>(pgm_read_dword(&entries[index + 1]));
+  return a + (((b - a) * frac) >> kSegmentShift);
+}
+
+float getEasedValueFast(EasingFunction func, float t) {
+  t = std::max(0.0f, std::min(1.0f, t));
+  uint32_t tQ16 = static_cast<uint32_t>(t * Q16_ONE);
+  return static_cast<float>(getEasedValueQ16(func, tQ16)) / Q16_ONE;
+}
+
 float getEasedValue(EasingFunction func, float t) {
+  TRACE_SCOPE(Trace::GetEasedValue);
   switch (func) {
   case EasingFunction::Linear:
     return easeLinear(t);
@@ -35,30 +218,65 @@ float getEasedValue(EasingFunction func, float t) {
   }
 }
 
+namespace {
+struct EasingName {
+  const char *name;
+  EasingFunction func;
+};
+
+// Sorted by name for the binary search in easingFromString().
+const EasingName kEasingNames[] = {
+    {"back-in-out", EasingFunction::BackInOut},
+    {"bounce-in-out", EasingFunction::BounceInOut},
+    {"circ-in-out", EasingFunction::CircInOut},
+    {"cubic-in-out", EasingFunction::CubicInOut},
+    {"elastic-in-out", EasingFunction::ElasticInOut},
+    {"linear", EasingFunction::Linear},
+    {"quad-in-out", EasingFunction::QuadInOut},
+    {"quart-in-out", EasingFunction::QuartInOut},
+    {"quint-in-out", EasingFunction::QuintInOut},
+    {"sine-in-out", EasingFunction::SineInOut},
+};
+
+// Compares a name that isn't terminated with a table entry, ignoring case.
+int compareName(const char *name, size_t length, const char *entry) {
+  int result = strncasecmp(name, entry, length);
+  if (result != 0) {
+    return result;
+  }
+  return entry[length] == '\0' ? 0 : -1; // A prefix sorts first.
+}
+} // namespace
+
 EasingFunction easingFromString(const String &easingName) {
-  if (easingName.equalsIgnoreCase("linear")) {
-    return EasingFunction::Linear;
-  } else if (easingName.equalsIgnoreCase("sine-in-out")) {
-    return EasingFunction::SineInOut;
-  } else if (easingName.equalsIgnoreCase("quad-in-out")) {
-    return EasingFunction::QuadInOut;
-  } else if (easingName.equalsIgnoreCase("cubic-in-out")) {
-    return EasingFunction::CubicInOut;
-  } else if (easingName.equalsIgnoreCase("quart-in-out")) {
-    return EasingFunction::QuartInOut;
-  } else if (easingName.equalsIgnoreCase("quint-in-out")) {
-    return EasingFunction::QuintInOut;
-  } else if (easingName.equalsIgnoreCase("circ-in-out")) {
-    return EasingFunction::CircInOut;
-  } else if (easingName.equalsIgnoreCase("elastic-in-out")) {
-    return EasingFunction::ElasticInOut;
-  } else if (easingName.equalsIgnoreCase("back-in-out")) {
-    return EasingFunction::BackInOut;
-  } else if (easingName.equalsIgnoreCase("bounce-in-out")) {
-    return EasingFunction::BounceInOut;
-  } else {
-    return EasingFunction::Linear; // Default to linear
+  return easingFromString(easingName.c_str(), easingName.length());
+}
+
+EasingFunction easingFromString(const char *easingName, size_t length) {
+  size_t low = 0;
+  size_t high = sizeof(kEasingNames) / sizeof(kEasingNames[0]);
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int result = compareName(easingName, length, kEasingNames[mid].name);
+    if (result == 0) {
+      return kEasingNames[mid].func;
+    }
+    if (result < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return EasingFunction::Linear; // Default to linear
+}
+
+const char *easingName(EasingFunction func) {
+  for (const EasingName &entry : kEasingNames) {
+    if (entry.func == func) {
+      return entry.name;
+    }
   }
+  return "linear";
 }
 
 // Simple linear interpolation.
@@ -114,8 +332,7 @@ float easeElasticInOut(float t) {
   float f = t * 2.0 - 1.0;
   if (f < 0.0)
     return -0.5 * (pow(2.0, 10.0 * f) * sin((f - s) * (2.0 * PI) / p));
-  float f2 = f - 1.0;
-  return pow(2.0, -10.0 * f2) * sin((f2 - s) * (2.0 * PI) / p) * 0.5 + 1.0;
+  return pow(2.0, -10.0 * f) * sin((f - s) * (2.0 * PI) / p) * 0.5 + 1.0;
 }
 
 // Back easing.
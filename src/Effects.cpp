@@ -0,0 +1,316 @@
+/**
+ * @file Effects.cpp
+ * @brief Implementation file for the modes a fixture renders.
+ */
+
+#include "Effects.h"
+#include "Constants.h"
+
+namespace Effects {
+namespace {
+// Returns how far into a transition we are, in Q16 (clamped to 1.0).
+uint32_t progress(unsigned long elapsed, unsigned long duration) {
+  if (elapsed >= duration) {
+    return Easing::Q16_ONE;
+  }
+  return (static_cast<uint64_t>(elapsed) << 16) / duration;
+}
+
+// Scales a color by a brightness in unorm16.
+ColorSpace::RGB16 scale(const ColorSpace::RGB16 &color, uint16_t level) {
+  uint32_t factor = static_cast<uint32_t>(level) + 1; // 65535 keeps it.
+  return {static_cast<uint16_t>((color.r * factor) >> 16),
+          static_cast<uint16_t>((color.g * factor) >> 16),
+          static_cast<uint16_t>((color.b * factor) >> 16)};
+}
+
+// Colors of the effects are stored as RGB, so they restore exactly.
+void putRgb(RecordWriter &out, const ColorSpace::RGB16 &color) {
+  ColorSpace::RGB rgb = ColorSpace::fx::toRgb8(color);
+  out.put8(rgb.r);
+  out.put8(rgb.g);
+  out.put8(rgb.b);
+}
+
+ColorSpace::RGB16 getRgb(RecordReader &in) {
+  ColorSpace::RGB rgb;
+  rgb.r = in.get8();
+  rgb.g = in.get8();
+  rgb.b = in.get8();
+  return ColorSpace::fx::toRgb16(rgb);
+}
+
+// Writes the color shown again when the output needs it.
+void refresh(Canvas &canvas) {
+  if (canvas.needsRefresh()) {
+    canvas.fill(canvas.shown()); // Keep dithering the static color.
+  }
+}
+} // namespace
+
+void Static::render(Runtime &runtime, const Context &context,
+                    Canvas &canvas) const {
+  refresh(canvas);
+}
+
+// Static colors are saved as a fade to the color shown.
+bool Static::restore(RecordReader &in, const ColorSpace::fx::LCH &color) {
+  return false;
+}
+
+void Fade::render(Runtime &runtime, const Context &context,
+                  Canvas &canvas) const {
+  if (runtime.done) {
+    refresh(canvas);
+    return;
+  }
+  unsigned long duration = context.settings.fadeDuration;
+  if (context.elapsed >= duration) {
+    // Transition is complete, jump to the final color and stop.
+    canvas.fill(ColorSpace::fx::lchToRgb(end, context.interpolation));
+    runtime.done = true;
+    return;
+  }
+  Easing::q16_t t = Easing::getEasedValueQ16(
+      context.settings.fadeEasing, progress(context.elapsed, duration));
+  canvas.fill(ColorSpace::fx::lchToRgb(
+      ColorSpace::fx::interpolate(start, end, t, context.interpolation),
+      context.interpolation));
+}
+
+// The output starts dark, so the color fades in from there.
+bool Fade::restore(RecordReader &in, const ColorSpace::fx::LCH &color) {
+  start = {0, 0, 0};
+  end = color;
+  return true;
+}
+
+void Wheel::render(Runtime &runtime, const Context &context,
+                   Canvas &canvas) const {
+  if (period == 0) {
+    refresh(canvas);
+    return;
+  }
+  // The hue is a binary angle, so wrapping around is free.
+  uint16_t hueDelta = static_cast<uint16_t>(
+      (static_cast<uint64_t>(context.elapsed % period) << 16) / period);
+  if (counterClockwise) {
+    hueDelta = -hueDelta;
+  }
+  uint16_t hue = startHue + hueDelta;
+  uint16_t spread = context.settings.wheelSpread;
+  size_t pixels = canvas.size();
+  if (spread == 0 || pixels == 1) {
+    canvas.fill(ColorSpace::fx::hsvToRgb(hue, 65535, 65535));
+    return;
+  }
+  ColorSpace::RGB16 *frame = canvas.pixels();
+  for (size_t i = 0; i < pixels; ++i) {
+    uint16_t offset = static_cast<uint32_t>(spread) * i / pixels;
+    frame[i] = ColorSpace::fx::hsvToRgb(hue + offset, 65535, 65535);
+  }
+}
+
+void Wheel::save(RecordWriter &out) const {
+  out.put16(startHue);
+  out.put32(period);
+  out.put8(counterClockwise ? 1 : 0);
+}
+
+bool Wheel::restore(RecordReader &in, const ColorSpace::fx::LCH &color) {
+  startHue = in.get16();
+  period = in.get32();
+  uint8_t direction = in.get8();
+  counterClockwise = direction != 0;
+  return direction <= 1;
+}
+
+void Cycle::render(Runtime &runtime, const Context &context,
+                   Canvas &canvas) const {
+  size_t count = context.colorCount;
+  if (count == 0) {
+    runtime.empty = true;
+    return;
+  }
+  unsigned long duration = context.settings.cycleDuration;
+  unsigned long elapsed = context.elapsed - runtime.transitionStart;
+  if (elapsed < duration) {
+    // Blending is still in progress.
+    Easing::q16_t t = Easing::getEasedValueQ16(context.settings.cycleEasing,
+                                               progress(elapsed, duration));
+    // The transition is pre-rendered, so this is just a table lookup.
+    canvas.fill(context.gradients.sample(runtime.previousIndex,
+                                         runtime.colorIndex, t));
+    return;
+  }
+
+  // Transition is complete, move to the next color. Frames that weren't
+  // rendered, e.g. while the fixture was streamed, skip whole transitions.
+  size_t steps = duration > 0 ? elapsed / duration : 1;
+  if (count > 1 && context.isRandom) {
+    runtime.previousIndex = runtime.colorIndex;
+    size_t index;
+    do {
+      index = random(0, count);
+    } while (index == runtime.colorIndex);
+    runtime.colorIndex = index;
+  } else {
+    runtime.colorIndex = (runtime.colorIndex + steps) % count;
+    runtime.previousIndex = (runtime.colorIndex + count - 1) % count;
+  }
+  context.gradients.prepare(runtime.previousIndex, runtime.colorIndex);
+
+  // Stay on the schedule of the start time rather than the frame that
+  // noticed the end, so spotlights sharing a clock stay in step.
+  runtime.transitionStart =
+      context.elapsed - (duration > 0 ? elapsed % duration : 0);
+}
+
+bool Cycle::restore(RecordReader &in, const ColorSpace::fx::LCH &color) {
+  return true;
+}
+
+void Playback::render(Runtime &runtime, const Context &context,
+                      Canvas &canvas) const {
+  if (runtime.done) {
+    refresh(canvas);
+    return;
+  }
+  canvas.fill(context.scene.sample(context.elapsed, entry, runtime.cursor));
+  runtime.done = context.scene.isFinished(context.elapsed);
+}
+
+// Restored scenes start from the dark output.
+bool Playback::restore(RecordReader &in, const ColorSpace::fx::LCH &color) {
+  entry = {0, 0, 0};
+  return true;
+}
+
+void Breathe::render(Runtime &runtime, const Context &context,
+                     Canvas &canvas) const {
+  if (period == 0) {
+    canvas.fill(color);
+    return;
+  }
+  // Starts at full brightness and eases down and back up, a triangle wave
+  // through a sine easing.
+  uint32_t phase = 2 * progress(context.elapsed % period, period);
+  uint32_t t = phase <= Easing::Q16_ONE ? phase : 2 * Easing::Q16_ONE - phase;
+  uint32_t eased = Easing::getEasedValueQ16(Easing::SineInOut, t);
+  uint32_t depth = (255 - minimum) * 257u;
+  canvas.fill(scale(color, 65535 - ((depth * eased) >> 16)));
+}
+
+void Breathe::save(RecordWriter &out) const {
+  putRgb(out, color);
+  out.put32(period);
+  out.put8(minimum);
+}
+
+bool Breathe::restore(RecordReader &in, const ColorSpace::fx::LCH &) {
+  color = getRgb(in);
+  period = in.get32();
+  minimum = in.get8();
+  return true;
+}
+
+void Strobe::render(Runtime &runtime, const Context &context,
+                    Canvas &canvas) const {
+  // On for (duty + 1) / 256 of the period, so 0 is the shortest flash.
+  unsigned long on = static_cast<uint64_t>(period) * (duty + 1u) >> 8;
+  if (period == 0 || context.elapsed % period < on) {
+    canvas.fill(color);
+  } else {
+    canvas.fill({0, 0, 0});
+  }
+}
+
+void Strobe::save(RecordWriter &out) const {
+  putRgb(out, color);
+  out.put32(period);
+  out.put8(duty);
+}
+
+bool Strobe::restore(RecordReader &in, const ColorSpace::fx::LCH &) {
+  color = getRgb(in);
+  period = in.get32();
+  duty = in.get8();
+  return true;
+}
+
+void Candle::render(Runtime &runtime, const Context &context,
+                    Canvas &canvas) const {
+  unsigned long elapsed = context.elapsed - runtime.segmentStart;
+  if (elapsed >= runtime.segmentLength) {
+    // Glide on from where the last flicker ended to a new random dip.
+    runtime.from = runtime.to;
+    uint32_t depth = intensity * 257u;
+    uint32_t dip = static_cast<uint32_t>(random(0, 65536)) * depth >> 16;
+    runtime.to = 65535 - dip;
+    runtime.segmentStart = context.elapsed;
+    runtime.segmentLength = random(Constants::CANDLE_MIN_FLICKER,
+                                   Constants::CANDLE_MAX_FLICKER + 1);
+    elapsed = 0;
+  }
+  int64_t delta = static_cast<int32_t>(runtime.to) - runtime.from;
+  int64_t t = progress(elapsed, runtime.segmentLength);
+  canvas.fill(
+      scale(color, static_cast<uint16_t>(runtime.from + (delta * t >> 16))));
+}
+
+void Candle::save(RecordWriter &out) const {
+  putRgb(out, color);
+  out.put8(intensity);
+}
+
+bool Candle::restore(RecordReader &in, const ColorSpace::fx::LCH &) {
+  color = getRgb(in);
+  intensity = in.get8();
+  return true;
+}
+
+// The dispatch below is instantiated here, next to the effects, so each
+// effect's render() is inlined into its branch.
+void restart(const Slot &slot, Slot::Runtime &runtime) {
+  slot.visit([&runtime](const auto &effect) {
+    runtime.reset<std::decay_t<decltype(effect)>>();
+  });
+}
+
+void render(const Slot &slot, Slot::Runtime &runtime, const Context &context,
+            Canvas &canvas) {
+  slot.visit([&](const auto &effect) {
+    effect.render(runtime.get<std::decay_t<decltype(effect)>>(), context,
+                  canvas);
+  });
+}
+
+bool isIdle(const Slot &slot, const Slot::Runtime &runtime) {
+  bool idle = false;
+  slot.visit([&](const auto &effect) {
+    idle = effect.isIdle(runtime.get<std::decay_t<decltype(effect)>>());
+  });
+  return idle;
+}
+
+void save(const Slot &slot, RecordWriter &out) {
+  uint8_t *end = out.p + RECORD_PARAMS_SIZE;
+  slot.visit([&out](const auto &effect) { effect.save(out); });
+  while (out.p < end) {
+    out.put8(0);
+  }
+}
+
+bool restore(Slot &slot, uint8_t mode, RecordReader &in,
+             const ColorSpace::fx::LCH &color) {
+  const uint8_t *end = in.p + RECORD_PARAMS_SIZE;
+  Slot restored;
+  bool valid = restored.emplaceIndex(
+      mode, [&](auto &effect) { return effect.restore(in, color); });
+  in.p = end;
+  if (valid) {
+    slot = restored;
+  }
+  return valid;
+}
+} // namespace Effects
@@ -0,0 +1,48 @@
+/**
+ * @file Gamma.cpp
+ * @brief Implementation file for the output linearization lookup tables.
+ */
+
+#include "Gamma.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Gamma {
+
+void Table::build(Curve curve, float gamma, float scale, uint16_t pwmRange) {
+  const float maxOutput =
+      static_cast<float>(pwmRange) * (1u << FRACTION_BITS) * scale;
+  for (size_t i = 0; i <= SEGMENTS; ++i) {
+    float v = static_cast<float>(i) / SEGMENTS;
+    float y;
+    switch (curve) {
+    case Curve::Power:
+      y = pow(v, gamma);
+      break;
+    case Curve::Cie1931: {
+      float lightness = v * 100.0f;
+      y = lightness <= 8.0f ? lightness / 903.3f
+                            : pow((lightness + 16.0f) / 116.0f, 3.0f);
+      break;
+    }
+    default:
+      y = v;
+      break;
+    }
+    float out = std::max(0.0f, std::min(y * maxOutput, 65535.0f));
+    _entries[i] = static_cast<uint16_t>(out + 0.5f);
+  }
+}
+
+uint16_t Table::apply(uint16_t value) const {
+  if (value == 0xFFFF) {
+    return _entries[SEGMENTS]; // Full scale maps to the full output.
+  }
+  const uint8_t fracBits = 16 - INDEX_BITS;
+  uint32_t index = value >> fracBits;
+  uint32_t frac = value & ((1u << fracBits) - 1);
+  uint32_t a = _entries[index];
+  uint32_t b = _entries[index + 1];
+  return a + (((b - a) * frac) >> fracBits);
+}
+} // namespace Gamma
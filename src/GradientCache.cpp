@@ -0,0 +1,89 @@
+/**
+ * @file GradientCache.cpp
+ * @brief Implementation file for the pre-rendered color cycle gradients.
+ */
+
+#include "GradientCache.h"
+#include "Easing.h"
+#include <algorithm>
+
+// Constructor
+GradientCache::GradientCache()
+    : _colors(nullptr), _count(0), _precomputed(false),
+      _space(ColorSpace::Interpolation::Hsl), _steps(0) {}
+
+// Sets the palette and renders the ramps.
+void GradientCache::build(const ColorSpace::fx::LCH *colors, size_t count,
+                          bool precompute, ColorSpace::Interpolation space) {
+  _colors = colors;
+  _space = space;
+  _count = std::min(count, Constants::MAX_COLORS);
+  _precomputed = precompute && _count > 1;
+  if (_count < 2) {
+    _steps = 0;
+    return; // There are no transitions to render.
+  }
+
+  size_t ramps = _precomputed ? _count : 1;
+  _steps = std::min<size_t>(MAX_STEPS,
+                            Constants::GRADIENT_CACHE_ENTRIES / ramps - 1);
+  for (size_t i = 0; i < ramps; ++i) {
+    renderRamp(i, i, (i + 1) % _count);
+  }
+}
+
+// Gets the color of a transition for the given eased progress.
+ColorSpace::RGB16 GradientCache::sample(size_t from, size_t to, int32_t t) {
+  if (from == to || _steps == 0 || t < 0 || t > Easing::Q16_ONE) {
+    return convert(from, to, t);
+  }
+
+  size_t ramp = _precomputed ? from : 0;
+  if (_rampFrom[ramp] != from || _rampTo[ramp] != to) {
+    return convert(from, to, t);
+  }
+
+  const ColorSpace::RGB16 *entries = &_entries[ramp * (_steps + 1)];
+  uint32_t position = static_cast<uint32_t>(t) * _steps;
+  uint32_t index = position >> 16;
+  if (index >= _steps) {
+    return entries[_steps];
+  }
+  // 8 bits of interpolation between the entries are plenty and keep the
+  // products within 32 bits.
+  int32_t frac = (position & 0xFFFF) >> 8;
+  const ColorSpace::RGB16 &a = entries[index];
+  const ColorSpace::RGB16 &b = entries[index + 1];
+  return {static_cast<uint16_t>(a.r + (((b.r - a.r) * frac) >> 8)),
+          static_cast<uint16_t>(a.g + (((b.g - a.g) * frac) >> 8)),
+          static_cast<uint16_t>(a.b + (((b.b - a.b) * frac) >> 8))};
+}
+
+// Renders the ramp of a transition that isn't precomputed (random order).
+void GradientCache::prepare(size_t from, size_t to) {
+  if (_precomputed || from == to || _steps == 0) {
+    return;
+  }
+  if (_rampFrom[0] != from || _rampTo[0] != to) {
+    renderRamp(0, from, to);
+  }
+}
+
+// Renders the transition between two palette colors into a ramp.
+void GradientCache::renderRamp(size_t ramp, size_t from, size_t to) {
+  _rampFrom[ramp] = from;
+  _rampTo[ramp] = to;
+  ColorSpace::RGB16 *entries = &_entries[ramp * (_steps + 1)];
+  for (uint16_t i = 0; i <= _steps; ++i) {
+    int32_t t = (static_cast<int32_t>(i) << 16) / _steps;
+    entries[i] = convert(from, to, t);
+  }
+}
+
+// Converts a point of a transition directly, without a ramp.
+ColorSpace::RGB16 GradientCache::convert(size_t from, size_t to,
+                                         int32_t t) const {
+  return ColorSpace::fx::lchToRgb(
+      ColorSpace::fx::interpolate(_colors[from], _colors[to], t, _space),
+      _space);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file GroupControl.cpp
+ * @brief Implementation file for the commands sent to a group of spotlights
+ * at once.
+ */
+
+#include "GroupControl.h"
+#include "Constants.h"
+#include "Log.h"
+#include "Protocol.h"
+#include "Trace.h"
+#include <ESP8266WiFi.h>
+#include <coredecls.h>
+
+namespace {
+const uint8_t COMMAND_MAGIC[2] = {'S', 'G'};
+const uint8_t ACK_MAGIC[2] = {'S', 'A'};
+const uint8_t VERSION = 1;
+const uint8_t FLAG_ACK = 0x01;
+const uint8_t STATUS_APPLIED = 0;
+const uint8_t STATUS_INVALID = 1;
+const size_t HEADER_SIZE = 10;
+const size_t ACK_SIZE = 14;
+
+IPAddress groupAddress() {
+  return IPAddress(Constants::GROUP_ADDRESS[0], Constants::GROUP_ADDRESS[1],
+                   Constants::GROUP_ADDRESS[2], Constants::GROUP_ADDRESS[3]);
+}
+
+uint32_t readU32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void writeU32(uint8_t *p, uint32_t value) {
+  for (size_t i = 0; i < 4; ++i) {
+    p[i] = value >> (8 * i);
+  }
+}
+} // namespace
+
+// Constructor
+GroupControl::GroupControl(Spotlight *spotlight)
+    : _spotlight(spotlight), _id(ESP.getChipId()), _groups(SPOTLIGHT_GROUPS),
+      _joined(false), _lastSequence(0), _lastCommandTime(0) {}
+
+void GroupControl::setGroups(uint32_t groups) { _groups = groups; }
+
+void GroupControl::update() {
+  if (!_joined) {
+    if (WiFi.status() != WL_CONNECTED) {
+      return;
+    }
+    _joined = _udp.beginMulticast(WiFi.localIP(), groupAddress(),
+                                  Constants::GROUP_PORT);
+    if (!_joined) {
+      return;
+    }
+    LOG_INFO("Group control started, groups %08lx",
+             static_cast<unsigned long>(_groups));
+  }
+
+  for (size_t i = 0; i < Constants::GROUP_PACKETS_PER_UPDATE; ++i) {
+    int size = _udp.parsePacket();
+    if (size <= 0) {
+      return;
+    }
+    handlePacket(size);
+  }
+}
+
+void GroupControl::handlePacket(size_t size) {
+  uint8_t packet[HEADER_SIZE + Constants::MAX_BATCH_SIZE];
+  if (size < HEADER_SIZE || size > sizeof(packet) ||
+      _udp.read(packet, size) != static_cast<int>(size)) {
+    return;
+  }
+  if (packet[0] != COMMAND_MAGIC[0] || packet[1] != COMMAND_MAGIC[1] ||
+      packet[2] != VERSION || (readU32(packet + 4) & _groups) == 0) {
+    return;
+  }
+  TRACE_SCOPE(Trace::GroupCommand);
+  uint16_t sequence = packet[8] | (packet[9] << 8);
+  unsigned long now = millis();
+  bool retry = _lastCommandTime != 0 && _udp.remoteIP() == _lastSender &&
+               sequence == _lastSequence &&
+               now - _lastCommandTime < Constants::GROUP_RETRY_WINDOW;
+
+  uint8_t status = STATUS_APPLIED;
+  if (!retry) {
+    if (Protocol::applyBatch(*_spotlight, packet + HEADER_SIZE,
+                             size - HEADER_SIZE)) {
+      _lastSender = _udp.remoteIP();
+      _lastSequence = sequence;
+      _lastCommandTime = now;
+    } else {
+      status = STATUS_INVALID;
+    }
+  }
+  if (packet[3] & FLAG_ACK) {
+    sendAck(sequence, status);
+  }
+}
+
+// Answers the sender of the current packet.
+void GroupControl::sendAck(uint16_t sequence, uint8_t status) {
+  // Shared by all acknowledgements, like the metrics buffer of the server.
+  static uint8_t state[Constants::MAX_STATE_SIZE];
+  size_t length = _spotlight->saveState(state, sizeof(state));
+
+  uint8_t ack[ACK_SIZE] = {ACK_MAGIC[0], ACK_MAGIC[1], VERSION, status,
+                           static_cast<uint8_t>(sequence & 0xFF),
+                           static_cast<uint8_t>(sequence >> 8)};
+  writeU32(ack + 6, _id);
+  writeU32(ack + 10, crc32(state, length));
+  _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
+  _udp.write(ack, sizeof(ack));
+  _udp.endPacket();
+}
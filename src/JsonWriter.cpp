@@ -0,0 +1,29 @@
+/**
+ * @file JsonWriter.cpp
+ * @brief Implementation file for the JSON responses rendered into static
+ * buffers.
+ */
+
+#include "JsonWriter.h"
+#include <cstdarg>
+
+// Constructor
+JsonWriter::JsonWriter(char *buffer, size_t size)
+    : _buffer(buffer), _size(size), _length(0), _overflow(false) {}
+
+void JsonWriter::append(const char *format, ...) {
+  if (_overflow) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(_buffer + _length, _size - _length, format, args);
+  va_end(args);
+  if (written < 0 || static_cast<size_t>(written) >= _size - _length) {
+    _overflow = true;
+    return;
+  }
+  _length += written;
+}
+
+size_t JsonWriter::length() const { return _overflow ? 0 : _length; }
@@ -0,0 +1,141 @@
+/**
+ * @file Latency.cpp
+ * @brief Implementation file for the command-to-photon latency benchmark.
+ */
+
+#include "Latency.h"
+
+#if SPOTLIGHT_LATENCY
+
+#include <algorithm>
+#include <cstdio>
+
+namespace Latency {
+namespace {
+struct Sample {
+  uint32_t received;
+  uint32_t applied;
+  uint32_t written;
+};
+
+// The ring of samples. The sequence numbers count the commands received,
+// applied and written since the last reset; a command's sample is at its
+// sequence number modulo SAMPLES.
+Sample samples[SAMPLES];
+uint32_t receivedCount = 0;
+uint32_t appliedCount = 0;
+uint32_t writtenCount = 0;
+
+// Durations of one stage, sorted for the percentiles.
+uint32_t durations[SAMPLES];
+
+// The samples still in the ring, oldest first.
+uint32_t firstSample() {
+  return receivedCount > SAMPLES ? receivedCount - SAMPLES : 0;
+}
+
+// Appends the percentiles of one stage, returns false if it didn't fit.
+bool appendStage(char *&cursor, size_t &left, const char *name,
+                 uint32_t end, uint32_t Sample::*from, uint32_t Sample::*to) {
+  size_t count = 0;
+  for (uint32_t i = firstSample(); i < end; ++i) {
+    const Sample &sample = samples[i % SAMPLES];
+    durations[count++] = sample.*to - sample.*from;
+  }
+  std::sort(durations, durations + count);
+  uint32_t p50 = count > 0 ? durations[(count - 1) * 50 / 100] : 0;
+  uint32_t p99 = count > 0 ? durations[(count - 1) * 99 / 100] : 0;
+  uint32_t max = count > 0 ? durations[count - 1] : 0;
+  int length =
+      snprintf(cursor, left, ",\"%s\":{\"p50\":%u,\"p99\":%u,\"max\":%u}",
+               name, static_cast<unsigned>(p50), static_cast<unsigned>(p99),
+               static_cast<unsigned>(max));
+  if (length < 0 || static_cast<size_t>(length) >= left) {
+    return false;
+  }
+  cursor += length;
+  left -= length;
+  return true;
+}
+} // namespace
+
+void received() {
+  samples[receivedCount % SAMPLES].received = micros();
+  receivedCount++;
+  // A command that is overwritten before its output was written is lost.
+  uint32_t first = firstSample();
+  appliedCount = std::max(appliedCount, first);
+  writtenCount = std::max(writtenCount, first);
+}
+
+void discard() {
+  if (receivedCount > appliedCount) {
+    receivedCount--;
+  }
+}
+
+void applied() {
+  uint32_t now = micros();
+  for (; appliedCount < receivedCount; ++appliedCount) {
+    samples[appliedCount % SAMPLES].applied = now;
+  }
+}
+
+void written() {
+  if (writtenCount == appliedCount) {
+    return; // The common case: a frame without a new command.
+  }
+  uint32_t now = micros();
+  for (; writtenCount < appliedCount; ++writtenCount) {
+    samples[writtenCount % SAMPLES].written = now;
+  }
+}
+
+void reset() {
+  receivedCount = 0;
+  appliedCount = 0;
+  writtenCount = 0;
+}
+
+size_t toJson(char *buffer, size_t size) {
+  // The rate the commands arrived at, over the samples in the ring.
+  uint32_t first = firstSample();
+  uint32_t span = 0;
+  if (receivedCount > first + 1) {
+    span = samples[(receivedCount - 1) % SAMPLES].received -
+           samples[first % SAMPLES].received;
+  }
+  uint32_t rate = span > 0 ? static_cast<uint64_t>(receivedCount - first - 1) *
+                                  1000000 / span
+                           : 0;
+
+  char *cursor = buffer;
+  size_t left = size;
+  int length = snprintf(cursor, left,
+                        "{\"received\":%u,\"applied\":%u,\"written\":%u,"
+                        "\"commandsPerSecond\":%u",
+                        static_cast<unsigned>(receivedCount),
+                        static_cast<unsigned>(appliedCount),
+                        static_cast<unsigned>(writtenCount),
+                        static_cast<unsigned>(rate));
+  if (length < 0 || static_cast<size_t>(length) >= left) {
+    return 0;
+  }
+  cursor += length;
+  left -= length;
+  if (!appendStage(cursor, left, "apply", appliedCount, &Sample::received,
+                   &Sample::applied) ||
+      !appendStage(cursor, left, "render", writtenCount, &Sample::applied,
+                   &Sample::written) ||
+      !appendStage(cursor, left, "total", writtenCount, &Sample::received,
+                   &Sample::written) ||
+      left < 2) {
+    return 0;
+  }
+  *cursor++ = '}';
+  *cursor = '\0';
+  return cursor - buffer;
+}
+} // namespace Latency
+
+#endif
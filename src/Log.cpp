@@ -0,0 +1,109 @@
+/**
+ * @file Log.cpp
+ * @brief Implementation file for the leveled, buffered logger.
+ */
+
+#include "Log.h"
+#include "Constants.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+
+namespace Log {
+namespace {
+const char kLevelLetters[] = {'-', 'E', 'W', 'I', 'D'};
+const char *const kLevelNames[] = {"none", "error", "warning", "info",
+                                   "debug"};
+
+Level currentLevel =
+    static_cast<Level>(std::min<int>(Info, SPOTLIGHT_LOG_LEVEL));
+
+// The ring buffer. Lines are only ever added whole.
+char ring[Constants::LOG_BUFFER_SIZE];
+size_t ringHead = 0; // Next byte to write to Serial.
+size_t ringUsed = 0;
+uint32_t droppedLines = 0;
+
+void push(const char *data, size_t length) {
+  size_t tail = (ringHead + ringUsed) % sizeof(ring);
+  size_t first = std::min(length, sizeof(ring) - tail);
+  memcpy(ring + tail, data, first);
+  memcpy(ring, data + first, length - first);
+  ringUsed += length;
+}
+
+// Writes up to `limit` bytes of the buffer, returns the number written.
+size_t writeOut(size_t limit) {
+  size_t length = std::min({limit, ringUsed, sizeof(ring) - ringHead});
+  if (length == 0) {
+    return 0;
+  }
+  Serial.write(reinterpret_cast<const uint8_t *>(ring + ringHead), length);
+  ringHead = (ringHead + length) % sizeof(ring);
+  ringUsed -= length;
+  return length;
+}
+} // namespace
+
+void setLevel(Level level) {
+  currentLevel = static_cast<Level>(std::min<int>(level, SPOTLIGHT_LOG_LEVEL));
+}
+
+Level level() { return currentLevel; }
+
+bool levelFromString(const char *name, Level &level) {
+  for (size_t i = 0; i < sizeof(kLevelNames) / sizeof(kLevelNames[0]); ++i) {
+    if (strcasecmp(name, kLevelNames[i]) == 0) {
+      level = static_cast<Level>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void write(Level lineLevel, const char *format, ...) {
+  // Lines are prefixed with the time they were logged, since they may reach
+  // Serial much later.
+  char line[Constants::LOG_LINE_LENGTH];
+  int prefix = snprintf(line, sizeof(line), "%lu %c ", millis(),
+                        kLevelLetters[lineLevel]);
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line + prefix, sizeof(line) - prefix, format, args);
+  va_end(args);
+  size_t total = std::min(static_cast<size_t>(prefix + std::max(length, 0)),
+                          sizeof(line) - 2);
+  line[total++] = '\n';
+
+  if (droppedLines > 0) {
+    char note[40];
+    int noteLength = snprintf(note, sizeof(note), "%lu W %u lines dropped\n",
+                              millis(), static_cast<unsigned>(droppedLines));
+    if (ringUsed + noteLength + total > sizeof(ring)) {
+      droppedLines++;
+      return;
+    }
+    push(note, noteLength);
+    droppedLines = 0;
+  }
+  if (ringUsed + total > sizeof(ring)) {
+    droppedLines++;
+    return;
+  }
+  push(line, total);
+}
+
+void drain() {
+  // The buffer may wrap, which takes two writes.
+  size_t room = Serial.availableForWrite();
+  room -= writeOut(room);
+  writeOut(room);
+}
+
+void flush() {
+  while (ringUsed > 0) {
+    writeOut(ringUsed);
+  }
+  Serial.flush();
+}
+} // namespace Log
@@ -0,0 +1,105 @@
+/**
+ * @file Metrics.cpp
+ * @brief Implementation file for the runtime telemetry served at /metrics.
+ */
+
+#include "Metrics.h"
+#include "JsonWriter.h"
+#include <ESP8266WiFi.h>
+
+void Metrics::Timing::record(uint32_t micros) {
+  count++;
+  windowCount++;
+  windowTotal += micros;
+  if (micros > windowMax) {
+    windowMax = micros;
+  }
+}
+
+void Metrics::Timing::roll() {
+  lastAverage = windowCount > 0 ? windowTotal / windowCount : 0;
+  lastMax = windowMax;
+  windowCount = 0;
+  windowTotal = 0;
+  windowMax = 0;
+}
+
+// Constructor
+Metrics::Metrics()
+    : _windowStart(0), _windowLoops(0), _loopsPerSecond(0), _update{},
+      _handleClient{}, _routes{}, _routeCount(0) {}
+
+// Counts a loop iteration and rolls all timings over at the end of a window.
+void Metrics::countLoop() {
+  _windowLoops++;
+  unsigned long now = millis();
+  unsigned long elapsed = now - _windowStart;
+  if (elapsed < Constants::METRICS_WINDOW) {
+    return;
+  }
+  _loopsPerSecond = static_cast<uint64_t>(_windowLoops) * 1000 / elapsed;
+  _windowLoops = 0;
+  _windowStart = now;
+  _update.roll();
+  _handleClient.roll();
+  for (size_t i = 0; i < _routeCount; ++i) {
+    _routes[i].timing.roll();
+  }
+}
+
+void Metrics::recordUpdate(uint32_t micros) { _update.record(micros); }
+
+void Metrics::recordHandleClient(uint32_t micros) {
+  _handleClient.record(micros);
+}
+
+int Metrics::addRoute(const char *uri) {
+  if (_routeCount >= Constants::METRICS_MAX_ROUTES) {
+    return -1;
+  }
+  _routes[_routeCount].uri = uri;
+  return _routeCount++;
+}
+
+void Metrics::recordRequest(int route, uint32_t micros) {
+  if (route >= 0 && static_cast<size_t>(route) < _routeCount) {
+    _routes[route].timing.record(micros);
+  }
+}
+
+namespace {
+void appendTiming(JsonWriter &json, const char *name,
+                  const Metrics::Timing &timing) {
+  json.append("\"%s\":{\"count\":%u,\"avgUs\":%u,\"maxUs\":%u}", name,
+              static_cast<unsigned>(timing.count),
+              static_cast<unsigned>(timing.lastAverage),
+              static_cast<unsigned>(timing.lastMax));
+}
+} // namespace
+
+size_t Metrics::toJson(char *buffer, size_t size) {
+  JsonWriter json(buffer, size);
+  json.append("{\"uptime\":%lu,\"windowMs\":%lu,", millis() / 1000,
+              Constants::METRICS_WINDOW);
+  json.append("\"heap\":{\"free\":%u,\"maxBlock\":%u,\"fragmentation\":%u},",
+              static_cast<unsigned>(ESP.getFreeHeap()),
+              static_cast<unsigned>(ESP.getMaxFreeBlockSize()),
+              static_cast<unsigned>(ESP.getHeapFragmentation()));
+  json.append("\"rssi\":%d,\"loopsPerSecond\":%u,",
+              static_cast<int>(WiFi.RSSI()),
+              static_cast<unsigned>(_loopsPerSecond));
+  appendTiming(json, "update", _update);
+  json.append(",");
+  appendTiming(json, "handleClient", _handleClient);
+  // Routes are [count, avgUs, maxUs] to keep the response small.
+  json.append(",\"routes\":{");
+  for (size_t i = 0; i < _routeCount; ++i) {
+    const Timing &timing = _routes[i].timing;
+    json.append("%s\"%s\":[%u,%u,%u]", i > 0 ? "," : "", _routes[i].uri,
+                static_cast<unsigned>(timing.count),
+                static_cast<unsigned>(timing.lastAverage),
+                static_cast<unsigned>(timing.lastMax));
+  }
+  json.append("}}");
+  return json.length();
+}
@@ -0,0 +1,123 @@
+/**
+ * @file Output.cpp
+ * @brief Implementation file for the output backends a fixture is drawn on.
+ */
+
+#include "Output.h"
+#include "Constants.h"
+#include <algorithm>
+
+// --- Output ---
+
+Output::Output() : _scale(SCALE_ONE), _load{0, 0, 0}, _channelCurrent{} {
+  setChannelCurrent(SPOTLIGHT_CHANNEL_CURRENT);
+}
+
+// The load of a channel is its duty summed over the pixels, with
+// PWM_RANGE << FRACTION_BITS at full duty.
+void Output::setChannelCurrent(uint16_t red, uint16_t green, uint16_t blue) {
+  const uint16_t milliamps[3] = {red, green, blue};
+  const uint32_t fullDuty = static_cast<uint32_t>(Constants::PWM_RANGE)
+                            << Gamma::FRACTION_BITS;
+  for (size_t i = 0; i < 3; ++i) {
+    _channelCurrent[i] =
+        (static_cast<uint64_t>(milliamps[i]) * 1000 << 16) / fullDuty;
+  }
+}
+
+uint32_t Output::getCurrent(const uint32_t *load) const {
+  uint64_t current = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    current += static_cast<uint64_t>(load[i]) * _channelCurrent[i];
+  }
+  return static_cast<uint32_t>(current >> 16);
+}
+
+// --- PwmOutput ---
+
+PwmOutput::PwmOutput(uint8_t redPin, uint8_t greenPin, uint8_t bluePin)
+    : _pins{redPin, greenPin, bluePin}, _curves(nullptr), _duty{0, 0, 0},
+      _dithering(false), _ditherActive(false), _ditherError{0, 0, 0} {}
+
+void PwmOutput::begin(const Gamma::Table *curves) {
+  _curves = curves;
+  analogWriteRange(Constants::PWM_RANGE);
+  analogWriteFreq(Constants::PWM_FREQUENCY);
+  // Write the initial duty directly, since write() skips duties that don't
+  // change.
+  for (size_t i = 0; i < 3; ++i) {
+    pinMode(_pins[i], OUTPUT);
+    analogWrite(_pins[i], _duty[i]);
+  }
+}
+
+// Maps each channel through its output curve and writes the PWM duty.
+void PwmOutput::write(const ColorSpace::RGB16 *pixels) {
+  const uint16_t values[3] = {pixels[0].r, pixels[0].g, pixels[0].b};
+  _ditherActive = false;
+  resetLoad();
+  for (size_t i = 0; i < 3; ++i) {
+    uint16_t curve = scaleDuty(i, _curves[i].apply(values[i]));
+    uint16_t duty;
+    if (_dithering) {
+      // First order sigma-delta: add the fraction to the error carried over
+      // from the previous frames and emit the integer part.
+      const uint8_t shift = Gamma::FRACTION_BITS - Constants::DITHER_BITS;
+      const uint16_t mask = (1u << Constants::DITHER_BITS) - 1;
+      uint16_t fine = curve >> shift;
+      uint16_t sum = fine + _ditherError[i];
+      duty = sum >> Constants::DITHER_BITS;
+      _ditherError[i] = sum & mask;
+      _ditherActive |= (fine & mask) != 0;
+    } else {
+      const uint16_t half = 1u << (Gamma::FRACTION_BITS - 1);
+      duty = (curve + half) >> Gamma::FRACTION_BITS;
+    }
+    if (duty != _duty[i]) {
+      _duty[i] = duty;
+      analogWrite(_pins[i], duty);
+    }
+  }
+}
+
+void PwmOutput::setDithering(bool enabled) {
+  _dithering = enabled;
+  for (size_t i = 0; i < 3; ++i) {
+    _ditherError[i] = 0;
+  }
+  // Make the next frame rewrite the current color with the new setting.
+  _ditherActive = true;
+}
+
+bool PwmOutput::needsRefresh() const { return _ditherActive; }
+
+// --- Pca9685Output ---
+
+Pca9685Output::Pca9685Output(Pca9685 &driver, uint8_t red, uint8_t green,
+                             uint8_t blue)
+    : _driver(driver), _channels{red, green, blue}, _curves(nullptr) {}
+
+void Pca9685Output::begin(const Gamma::Table *curves) {
+  _curves = curves;
+  uint8_t last = std::max({_channels[0], _channels[1], _channels[2]});
+  // Chips already started by another output on the chain are kept.
+  _driver.begin(last / Pca9685::CHANNELS_PER_CHIP + 1,
+                Constants::PWM_FREQUENCY);
+}
+
+// The duties are only buffered, show() sends them.
+void Pca9685Output::write(const ColorSpace::RGB16 *pixels) {
+  static_assert(Constants::PWM_RANGE == 1023,
+                "The PCA9685 duty assumes 10-bit output curves");
+  const uint16_t values[3] = {pixels[0].r, pixels[0].g, pixels[0].b};
+  // The 12 bits of the PCA9685 take two of the fraction bits. Scaled
+  // rather than shifted, so the top of the curve reaches full scale.
+  const uint32_t top = Constants::PWM_RANGE << Gamma::FRACTION_BITS;
+  resetLoad();
+  for (size_t i = 0; i < 3; ++i) {
+    uint32_t curve = scaleDuty(i, _curves[i].apply(values[i]));
+    _driver.setDuty(_channels[i], (curve * Pca9685::MAX_DUTY + top / 2) / top);
+  }
+}
+
+void Pca9685Output::show() { _driver.flush(); }
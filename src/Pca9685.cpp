@@ -0,0 +1,117 @@
+/**
+ * @file Pca9685.cpp
+ * @brief Implementation file for the PCA9685 I2C PWM driver.
+ */
+
+#include "Pca9685.h"
+#include <Wire.h>
+#include <algorithm>
+
+namespace {
+// Registers, see the PCA9685 datasheet.
+const uint8_t MODE1 = 0x00;
+const uint8_t MODE2 = 0x01;
+const uint8_t LED0_ON_L = 0x06;
+const uint8_t PRESCALE = 0xFE;
+
+const uint8_t MODE1_RESTART = 0x80;
+const uint8_t MODE1_AUTO_INCREMENT = 0x20;
+const uint8_t MODE1_SLEEP = 0x10;
+const uint8_t MODE2_TOTEM_POLE = 0x04;
+
+// Bit 4 of the ON_H and OFF_H registers forces the output on or off.
+const uint8_t FULL = 0x10;
+
+const uint32_t OSCILLATOR_FREQUENCY = 25000000;
+} // namespace
+
+// Constructor
+Pca9685::Pca9685() : _chips(0), _duty{}, _dirty{} {}
+
+// Wakes the chips up with the given PWM frequency, all outputs off. Chips
+// already started are left alone.
+void Pca9685::begin(uint8_t chips, uint16_t frequency) {
+  chips = std::min<uint8_t>(chips, Constants::PCA9685_MAX_CHIPS);
+  if (chips <= _chips) {
+    return;
+  }
+  if (_chips == 0) {
+    Wire.begin();
+    Wire.setClock(Constants::PCA9685_I2C_CLOCK);
+  }
+
+  uint32_t prescale =
+      (OSCILLATOR_FREQUENCY + 2048u * frequency) / (4096u * frequency) - 1;
+  prescale = std::max<uint32_t>(3, std::min<uint32_t>(255, prescale));
+  uint8_t first = _chips;
+  _chips = chips;
+  for (uint8_t chip = first; chip < _chips; ++chip) {
+    // The prescaler can only be set while sleeping.
+    writeRegister(chip, MODE1, MODE1_SLEEP);
+    writeRegister(chip, PRESCALE, prescale);
+    writeRegister(chip, MODE2, MODE2_TOTEM_POLE);
+    writeRegister(chip, MODE1, MODE1_AUTO_INCREMENT);
+    delayMicroseconds(500); // The oscillator needs 500 us to start.
+    writeRegister(chip, MODE1, MODE1_RESTART | MODE1_AUTO_INCREMENT);
+    _dirty[chip] = 0xFFFF;
+  }
+  flush();
+}
+
+void Pca9685::setDuty(uint8_t channel, uint16_t duty) {
+  if (channel >= _chips * CHANNELS_PER_CHIP) {
+    return;
+  }
+  duty = std::min(duty, MAX_DUTY);
+  if (_duty[channel] != duty) {
+    _duty[channel] = duty;
+    _dirty[channel / CHANNELS_PER_CHIP] |= 1u << (channel % CHANNELS_PER_CHIP);
+  }
+}
+
+// Writes each run of changed channels with one auto-incrementing transfer.
+void Pca9685::flush() {
+  for (uint8_t chip = 0; chip < _chips; ++chip) {
+    uint16_t dirty = _dirty[chip];
+    _dirty[chip] = 0;
+    uint8_t channel = 0;
+    while (dirty != 0) {
+      if ((dirty & 1) == 0) {
+        dirty >>= 1;
+        channel++;
+        continue;
+      }
+      uint8_t first = channel;
+      while (dirty & 1) {
+        dirty >>= 1;
+        channel++;
+      }
+      writeChannels(chip, first, channel - first);
+    }
+  }
+}
+
+void Pca9685::writeRegister(uint8_t chip, uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(Constants::PCA9685_ADDRESS + chip);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+void Pca9685::writeChannels(uint8_t chip, uint8_t first, uint8_t count) {
+  // 1 + 16 * 4 bytes fit into the 128 byte buffer of the Wire library.
+  Wire.beginTransmission(Constants::PCA9685_ADDRESS + chip);
+  Wire.write(LED0_ON_L + 4 * first);
+  for (uint8_t i = 0; i < count; ++i) {
+    uint16_t duty = _duty[chip * CHANNELS_PER_CHIP + first + i];
+    // The output turns on at count 0 and off at the duty. The extremes use
+    // the full on/off bits instead.
+    uint16_t on = duty == MAX_DUTY ? FULL << 8 : 0;
+    uint16_t off = duty == MAX_DUTY ? 0 : (duty == 0 ? FULL << 8 : duty);
+    Wire.write(on & 0xFF);
+    Wire.write(on >> 8);
+    Wire.write(off & 0xFF);
+    Wire.write(off >> 8);
+  }
+  Wire.endTransmission();
+}
@@ -0,0 +1,286 @@
+/**
+ * @file Protocol.cpp
+ * @brief Implementation file for the compact binary control protocol.
+ */
+
+#include "Protocol.h"
+
+namespace Protocol {
+namespace {
+uint16_t readU16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+uint32_t readU32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool readEasing(const uint8_t *p, Easing::EasingFunction &easing) {
+  if (p[0] >= Easing::EASING_FUNCTION_COUNT) {
+    return false;
+  }
+  easing = static_cast<Easing::EasingFunction>(p[0]);
+  return true;
+}
+} // namespace
+
+// Values that don't fit into the message anymore are dropped.
+Message &Message::put8(uint8_t value) {
+  if (length < MAX_MESSAGE_SIZE) {
+    data[length++] = value;
+  }
+  return *this;
+}
+
+Message &Message::put16(uint16_t value) {
+  return put8(value & 0xFF).put8(value >> 8);
+}
+
+Message &Message::put32(uint32_t value) {
+  return put16(value & 0xFFFF).put16(value >> 16);
+}
+
+namespace {
+// Decodes a single command. Applies it to the spotlight, or only validates it
+// if there is none.
+bool execute(Spotlight *spotlight, const uint8_t *data, size_t length) {
+  if (length == 0) {
+    return false;
+  }
+  const uint8_t *payload = data + 1;
+  size_t payloadLength = length - 1;
+  Easing::EasingFunction easing;
+
+  switch (data[0]) {
+  case SetRGB:
+    if (payloadLength != 3)
+      return false;
+    if (spotlight)
+      spotlight->setRGB(payload[0], payload[1], payload[2]);
+    return true;
+  case SetKelvin:
+    if (payloadLength != 3)
+      return false;
+    if (spotlight)
+      spotlight->setColorTemperature(readU16(payload), payload[2] / 255.0f);
+    return true;
+  case SetWheelMode:
+    if (payloadLength != 5)
+      return false;
+    if (spotlight)
+      spotlight->enableColorWheelMode(
+          readU32(payload) / 1000.0f,
+          payload[4] ? Spotlight::RotationDirection::CounterClockwise
+                     : Spotlight::RotationDirection::Clockwise);
+    return true;
+  case SetCycleMode: {
+    if (payloadLength < 2)
+      return false;
+    size_t count = payload[1];
+    if (count > Constants::MAX_COLORS || payloadLength != 2 + 3 * count)
+      return false;
+    if (spotlight) {
+      ColorSpace::RGB colors[Constants::MAX_COLORS];
+      for (size_t i = 0; i < count; ++i) {
+        const uint8_t *rgb = payload + 2 + 3 * i;
+        colors[i] = {rgb[0], rgb[1], rgb[2]};
+      }
+      spotlight->enableColorCycleMode(colors, count, payload[0] != 0);
+    }
+    return true;
+  }
+  case SetCycleDuration:
+    if (payloadLength != 4)
+      return false;
+    if (spotlight)
+      spotlight->setCycleDuration(readU32(payload) / 1000.0f);
+    return true;
+  case SetCycleEasing:
+    if (payloadLength != 1 || !readEasing(payload, easing))
+      return false;
+    if (spotlight)
+      spotlight->setCycleEasing(easing);
+    return true;
+  case SetTransitionDuration:
+    if (payloadLength != 4)
+      return false;
+    if (spotlight)
+      spotlight->setTransitionDuration(readU32(payload) / 1000.0f);
+    return true;
+  case SetTransitionEasing:
+    if (payloadLength != 1 || !readEasing(payload, easing))
+      return false;
+    if (spotlight)
+      spotlight->setTransitionEasing(easing);
+    return true;
+  case SelectFixtures:
+    if (payloadLength != 2)
+      return false;
+    if (spotlight)
+      spotlight->selectFixtures(readU16(payload));
+    return true;
+  case SetWheelSpread:
+    if (payloadLength != 2)
+      return false;
+    if (spotlight)
+      spotlight->setWheelSpread(readU16(payload) / 65535.0f);
+    return true;
+  case PlayScene:
+    if (payloadLength != 1 || payload[0] >= Constants::MAX_SCENES)
+      return false;
+    // An empty slot leaves the spotlight unchanged.
+    if (spotlight)
+      spotlight->playScene(payload[0]);
+    return true;
+  case StartAt:
+    if (payloadLength != 4)
+      return false;
+    if (spotlight)
+      spotlight->setStartTime(readU32(payload));
+    return true;
+  case SetInterpolation:
+    if (payloadLength != 1 ||
+        payload[0] > static_cast<uint8_t>(ColorSpace::Interpolation::Oklch))
+      return false;
+    if (spotlight)
+      spotlight->setInterpolation(
+          static_cast<ColorSpace::Interpolation>(payload[0]));
+    return true;
+  case SetBreatheMode:
+    if (payloadLength != 8)
+      return false;
+    if (spotlight)
+      spotlight->enableBreatheMode({payload[0], payload[1], payload[2]},
+                                   readU32(payload + 3) / 1000.0f,
+                                   payload[7] / 255.0f);
+    return true;
+  case SetStrobeMode:
+    if (payloadLength != 8)
+      return false;
+    if (spotlight)
+      spotlight->enableStrobeMode({payload[0], payload[1], payload[2]},
+                                  readU32(payload + 3) / 1000.0f,
+                                  payload[7] / 255.0f);
+    return true;
+  case SetCandleMode:
+    if (payloadLength != 4)
+      return false;
+    if (spotlight)
+      spotlight->enableCandleMode({payload[0], payload[1], payload[2]},
+                                  payload[3] / 255.0f);
+    return true;
+  case SetBrightness:
+    if (payloadLength != 2)
+      return false;
+    if (spotlight)
+      spotlight->setBrightness(readU16(payload) / 65535.0f);
+    return true;
+  case SetStreamSmoothing:
+    if (payloadLength != 4)
+      return false;
+    if (spotlight)
+      spotlight->setStreamSmoothing(readU32(payload) / 1000.0f);
+    return true;
+  default:
+    return false;
+  }
+}
+} // namespace
+
+size_t messageLength(const uint8_t *data, size_t length) {
+  if (length == 0) {
+    return 0;
+  }
+  size_t messageLength;
+  switch (data[0]) {
+  case SetRGB:
+  case SetKelvin:
+    messageLength = 4;
+    break;
+  case SetBreatheMode:
+  case SetStrobeMode:
+    messageLength = 9;
+    break;
+  case SetCandleMode:
+    messageLength = 5;
+    break;
+  case SelectFixtures:
+  case SetWheelSpread:
+  case SetBrightness:
+    messageLength = 3;
+    break;
+  case SetWheelMode:
+    messageLength = 6;
+    break;
+  case SetCycleMode:
+    if (length < 3)
+      return 0;
+    messageLength = 3 + 3 * data[2];
+    break;
+  case SetCycleDuration:
+  case SetTransitionDuration:
+  case StartAt:
+  case SetStreamSmoothing:
+    messageLength = 5;
+    break;
+  case SetCycleEasing:
+  case SetTransitionEasing:
+  case PlayScene:
+  case SetInterpolation:
+    messageLength = 2;
+    break;
+  default:
+    return 0;
+  }
+  return messageLength <= length ? messageLength : 0;
+}
+
+bool validate(const uint8_t *data, size_t length) {
+  return execute(nullptr, data, length);
+}
+
+bool apply(Spotlight &spotlight, const uint8_t *data, size_t length) {
+  return execute(&spotlight, data, length);
+}
+
+bool applyBatch(Spotlight &spotlight, const uint8_t *data, size_t length) {
+  // Check the whole batch first, so it is either applied completely or not
+  // at all.
+  if (length == 0) {
+    return false;
+  }
+  for (size_t offset = 0; offset < length;) {
+    size_t size = messageLength(data + offset, length - offset);
+    if (size == 0 || !validate(data + offset, size)) {
+      return false;
+    }
+    offset += size;
+  }
+
+  // A selection only lasts until the end of its batch.
+  spotlight.beginBatch();
+  spotlight.selectFixtures(Spotlight::ALL_FIXTURES);
+  for (size_t offset = 0; offset < length;) {
+    size_t size = messageLength(data + offset, length - offset);
+    execute(&spotlight, data + offset, size);
+    offset += size;
+  }
+  spotlight.selectFixtures(Spotlight::ALL_FIXTURES);
+  spotlight.endBatch();
+  return true;
+}
+
+size_t encodeColor(const ColorSpace::RGB &color, uint8_t *out) {
+  out[0] = Color;
+  out[1] = color.r;
+  out[2] = color.g;
+  out[3] = color.b;
+  return 4;
+}
+
+size_t encodeError(uint8_t opcode, uint8_t *out) {
+  out[0] = Error;
+  out[1] = opcode;
+  return 2;
+}
+} // namespace Protocol
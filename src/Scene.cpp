@@ -0,0 +1,167 @@
+/**
+ * @file Scene.cpp
+ * @brief Implementation file for the keyframe scenes.
+ */
+
+#include "Scene.h"
+#include <LittleFS.h>
+#include <cstdio>
+
+namespace {
+const uint8_t FLAG_LOOP = 0x01;
+const size_t HEADER_SIZE = 2;
+const size_t KEYFRAME_SIZE = 12;
+static_assert(Constants::MAX_SCENE_SIZE ==
+                  HEADER_SIZE + KEYFRAME_SIZE * Constants::MAX_SCENE_KEYFRAMES,
+              "MAX_SCENE_SIZE doesn't match the scene format");
+
+uint32_t readU32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Scenes are stored next to the web files, e.g. "/scene0.bin".
+void scenePath(uint8_t slot, char *path, size_t size) {
+  snprintf(path, size, "/scene%u.bin", static_cast<unsigned>(slot));
+}
+} // namespace
+
+// Constructor
+Scene::Scene() : _count(0), _loop(false), _duration(0) {}
+
+bool Scene::validate(const uint8_t *data, size_t length) {
+  if (length < HEADER_SIZE) {
+    return false;
+  }
+  size_t count = data[1];
+  if (count == 0 || count > Constants::MAX_SCENE_KEYFRAMES ||
+      length != HEADER_SIZE + KEYFRAME_SIZE * count) {
+    return false;
+  }
+  // The absolute times of the compiled scene have to fit into 32 bits.
+  uint64_t duration = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t *keyframe = data + HEADER_SIZE + KEYFRAME_SIZE * i;
+    if (keyframe[7] >= Easing::EASING_FUNCTION_COUNT) {
+      return false;
+    }
+    duration += readU32(keyframe + 3);
+    duration += readU32(keyframe + 8);
+  }
+  return duration <= UINT32_MAX;
+}
+
+bool Scene::save(uint8_t slot, const uint8_t *data, size_t length) {
+  if (slot >= Constants::MAX_SCENES) {
+    return false;
+  }
+  char path[16];
+  scenePath(slot, path, sizeof(path));
+  File file = LittleFS.open(path, "w");
+  if (!file) {
+    return false;
+  }
+  size_t written = file.write(data, length);
+  file.close();
+  return written == length;
+}
+
+bool Scene::exists(uint8_t slot) {
+  if (slot >= Constants::MAX_SCENES) {
+    return false;
+  }
+  char path[16];
+  scenePath(slot, path, sizeof(path));
+  return LittleFS.exists(path);
+}
+
+bool Scene::load(uint8_t slot) {
+  if (slot >= Constants::MAX_SCENES) {
+    return false;
+  }
+  char path[16];
+  scenePath(slot, path, sizeof(path));
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return false;
+  }
+  uint8_t data[Constants::MAX_SCENE_SIZE];
+  size_t length = file.read(data, sizeof(data));
+  bool truncated = file.available() > 0;
+  file.close();
+  return !truncated && compile(data, length);
+}
+
+// Converts the keyframes to segments with absolute times and fixed point
+// colors, everything playback needs.
+bool Scene::compile(const uint8_t *data, size_t length) {
+  if (!validate(data, length)) {
+    return false;
+  }
+  _loop = (data[0] & FLAG_LOOP) != 0;
+  _count = data[1];
+  uint32_t time = 0;
+  for (size_t i = 0; i < _count; ++i) {
+    const uint8_t *keyframe = data + HEADER_SIZE + KEYFRAME_SIZE * i;
+    Segment &segment = _segments[i];
+    segment.start = time;
+    segment.holdStart = time + readU32(keyframe + 3);
+    segment.end = segment.holdStart + readU32(keyframe + 8);
+    segment.to = ColorSpace::fx::fromLch(
+        ColorSpace::rgbToLch({keyframe[0], keyframe[1], keyframe[2]}));
+    segment.color = ColorSpace::fx::lchToRgb(segment.to);
+    segment.easing = static_cast<Easing::EasingFunction>(keyframe[7]);
+    time = segment.end;
+  }
+  // Only a loop knows the color the first fade starts from, otherwise it's
+  // the entry color passed to sample().
+  for (size_t i = 0; i < _count; ++i) {
+    _segments[i].from = _segments[i == 0 ? _count - 1 : i - 1].to;
+  }
+  _duration = time;
+  return true;
+}
+
+// The same conditions under which sample() returns a fixed color.
+bool Scene::isFinished(unsigned long elapsed) const {
+  if (_count == 0) {
+    return true;
+  }
+  return elapsed >= _duration && (!_loop || _duration == 0);
+}
+
+// Finds the segment of the given time, starting at the one of the previous
+// frame, and blends its colors.
+ColorSpace::RGB16 Scene::sample(unsigned long elapsed,
+                                const ColorSpace::fx::LCH &entry,
+                                uint8_t &cursor) const {
+  if (_count == 0) {
+    return ColorSpace::fx::lchToRgb(entry);
+  }
+  bool firstPass = elapsed < _duration;
+  if (!firstPass) {
+    if (!_loop || _duration == 0) {
+      return _segments[_count - 1].color;
+    }
+    elapsed %= _duration;
+  }
+  if (cursor >= _count || elapsed < _segments[cursor].start) {
+    cursor = 0; // The loop wrapped around.
+  }
+  while (elapsed >= _segments[cursor].end) {
+    cursor++; // Can't pass the last segment, it ends at _duration.
+  }
+
+  const Segment &segment = _segments[cursor];
+  if (elapsed >= segment.holdStart) {
+    return segment.color;
+  }
+  uint32_t fade = segment.holdStart - segment.start;
+  uint32_t t = (static_cast<uint64_t>(elapsed - segment.start) << 16) / fade;
+  Easing::q16_t easedT = Easing::getEasedValueQ16(segment.easing, t);
+  const ColorSpace::fx::LCH &from =
+      firstPass && cursor == 0 ? entry : segment.from;
+  return ColorSpace::fx::lchToRgb(
+      ColorSpace::fx::interpolate(from, segment.to, easedT));
+}
@@ -5,248 +5,990 @@
 
 #include "Spotlight.h"
 #include "Constants.h"
+#include "Latency.h"
+#include "Trace.h"
 #include <algorithm>
 #include <cmath>
 
 // Constructor
+Spotlight::Spotlight(Output *const *outputs, size_t count)
+    : _outputs{}, _fixtureCount(std::min(count, Constants::MAX_FIXTURES)),
+      _selectedFixtures(ALL_FIXTURES), _pinOutput(0, 0, 0), _currentRGB{},
+      _varied{}, _frameInterval(1000000UL / Constants::DEFAULT_FRAME_RATE),
+      _nextFrameTime(0), _renderMode(RenderMode::Loop), _streamChannels{},
+      _streamRGB{}, _resumeRGB{}, _streamFixtures(0), _lastStreamTime(0),
+      _streamSmoothing(Constants::STREAM_SMOOTHING), _streamAlpha(0),
+      _brightness(Output::SCALE_ONE), _outputScale(Output::SCALE_ONE),
+      _fixtureCurrent{}, _requestedCurrent(0),
+      _averageCurrent(0), _powerAlpha(0), _powerSettled(false),
+      _publishedState(0),
+      _batching(false), _batchEdited(false), _batchRestart(0), _sceneSlot(0),
+      _revision(0), _clockOffset(0), _startTime(0), _hasStartTime(false),
+      _renderedGeneration{}, _renderStartTime{}, _startPending{},
+      _effectRuntime{} {
+  std::copy(outputs, outputs + _fixtureCount, _outputs);
+
+  AnimationState &state = _states[0];
+  for (size_t f = 0; f < Constants::MAX_FIXTURES; ++f) {
+    state.generation[f] = 0;
+    state.startTime[f] = 0;
+    state.effect[f].emplace<Effects::Static>();
+    Effects::Settings &settings = state.settings[f];
+    settings.fadeDuration = 200;
+    settings.fadeEasing = Easing::EasingFunction::CubicInOut;
+    settings.cycleDuration = 2000;
+    settings.cycleEasing = Easing::Linear;
+    settings.wheelSpread = 0;
+  }
+  state.colorCycleCount = 0;
+  state.isRandom = false;
+  state.interpolation = Constants::DEFAULT_INTERPOLATION;
+  _states[1] = state;
+  updateStreamAlpha();
+  _powerAlpha = averageStep(Constants::POWER_RELEASE_TIME);
+}
+
 Spotlight::Spotlight(int redPin, int greenPin, int bluePin)
-    : _redPin(redPin), _greenPin(greenPin), _bluePin(bluePin),
-      _isAnimating(false), _currentHue(0.0), _startHue(0.0), _saturation(1.0),
-      _value(1.0), _rotationPeriod(0.0),
-      _rotationDirection(RotationDirection::Clockwise), _colorCycleCount(0),
-      _currentColorIndex(0), _transitionDuration(2.0),
-      _currentEasing(Easing::Linear), _isRandom(false), _isTransitioning(false),
-      _fixedTransitionDuration(0.2),
-      _fixedTransitionEasing(Easing::EasingFunction::CubicInOut) {}
-
-// Initializes the pins.
+    : Spotlight(nullptr, 0) {
+  _pinOutput = PwmOutput(redPin, greenPin, bluePin);
+  _outputs[0] = &_pinOutput;
+  _fixtureCount = 1;
+}
+
+// Initializes the outputs.
 void Spotlight::begin() {
-  pinMode(_redPin, OUTPUT);
-  pinMode(_greenPin, OUTPUT);
-  pinMode(_bluePin, OUTPUT);
+  static_assert((static_cast<uint32_t>(Constants::PWM_RANGE)
+                 << Gamma::FRACTION_BITS) <= 0xFFFF,
+                "PWM_RANGE too large for the output curve tables");
+  static_assert(Constants::MAX_FIXTURES <= sizeof(FixtureMask) * 8,
+                "MAX_FIXTURES doesn't fit into a FixtureMask");
+  for (size_t i = 0; i < 3; ++i) {
+    _outputCurves[i].build(Constants::OUTPUT_CURVE[i],
+                           Constants::OUTPUT_GAMMA[i],
+                           Constants::OUTPUT_SCALE[i], Constants::PWM_RANGE);
+  }
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    _outputs[f]->begin(_outputCurves);
+  }
+  _nextFrameTime = micros();
+}
+
+size_t Spotlight::getFixtureCount() const { return _fixtureCount; }
+
+void Spotlight::selectFixtures(FixtureMask fixtures) {
+  _selectedFixtures = fixtures;
+}
+
+bool Spotlight::isSelected(size_t fixture) const {
+  return (_selectedFixtures >> fixture) & 1;
+}
+
+// Sets the frame rate of the scheduler.
+void Spotlight::setFrameRate(uint16_t hz) {
+  hz = std::max(Constants::MIN_FRAME_RATE,
+                std::min(Constants::MAX_FRAME_RATE, hz));
+  _frameInterval = 1000000UL / hz;
+  updateStreamAlpha(); // The smoothing steps are per frame.
+  _powerAlpha = averageStep(Constants::POWER_RELEASE_TIME);
+  if (_renderMode == RenderMode::Timer) {
+    startRenderTimer(); // Restart with the new interval.
+  }
+}
+
+// Enables or disables temporal dithering.
+void Spotlight::setDithering(bool enabled) {
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    _outputs[f]->setDithering(enabled);
+    // Rewrite the current color with the new setting. Fixtures with varied
+    // pixels are rewritten by their animation anyway.
+    if (!_varied[f]) {
+      writeLeds(f, _currentRGB[f]);
+    }
+  }
+  showOutputs();
+}
+
+// Sets the brightness master, the next frame applies it.
+void Spotlight::setBrightness(float level) {
+  level = std::max(0.0f, std::min(1.0f, level));
+  _brightness = static_cast<uint32_t>(level * Output::SCALE_ONE + 0.5f);
+  _powerSettled = false;
+}
+
+float Spotlight::getBrightness() const {
+  return static_cast<float>(_brightness) / Output::SCALE_ONE;
+}
+
+uint32_t Spotlight::getCurrent() const {
+  return (static_cast<uint64_t>(_requestedCurrent) * _outputScale >> 16) /
+         1000;
+}
 
-  Serial.begin(115200);
+// Selects where frames are rendered.
+bool Spotlight::setRenderMode(RenderMode mode) {
+  if (mode == RenderMode::Timer) {
+    for (size_t f = 0; f < _fixtureCount; ++f) {
+      if (!_outputs[f]->isTimerSafe()) {
+        return false;
+      }
+    }
+  }
+  _renderMode = mode;
+  if (mode == RenderMode::Timer) {
+    startRenderTimer();
+  } else {
+    _ticker.detach();
+    _nextFrameTime = micros();
+  }
+  return true;
+}
+
+// (Re)starts the Ticker that renders the frames in RenderMode::Timer.
+void Spotlight::startRenderTimer() {
+  // The Ticker has millisecond resolution.
+  uint32_t intervalMs = std::max(1UL, (_frameInterval + 500) / 1000);
+  _ticker.detach();
+  _ticker.attach_ms(intervalMs, [this]() { renderFrame(); });
+}
+
+// Writes streamed channels, the renderer shows them from the next frame.
+void Spotlight::streamChannels(size_t offset, Stream &in, size_t length) {
+  if (offset < sizeof(_streamChannels)) {
+    size_t count = std::min(length, sizeof(_streamChannels) - offset);
+    in.readBytes(_streamChannels + offset, count);
+  }
+
+  size_t first = 0;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    size_t pixels = getPixelCount(f);
+    bool written = offset < first + 3 * pixels && offset + length > first;
+    if (written && !((_streamFixtures >> f) & 1)) {
+      // Start smoothing from the color shown, and keep it to go back to.
+      _resumeRGB[f] = _currentRGB[f];
+      size_t firstPixel = first / 3;
+      size_t end = std::min(firstPixel + pixels, Constants::MAX_PIXELS);
+      for (size_t i = firstPixel; i < end; ++i) {
+        _streamRGB[i] = _currentRGB[f];
+      }
+      _streamFixtures |= 1u << f;
+    }
+    first += 3 * pixels;
+  }
+  _lastStreamTime = millis();
+}
+
+// Sets the smoothing of the streamed colors.
+void Spotlight::setStreamSmoothing(float seconds) {
+  _streamSmoothing = toMillis(seconds);
+  updateStreamAlpha();
+}
+
+bool Spotlight::isStreaming() const { return _streamFixtures != 0; }
+
+// The smoothing step of the streamed colors.
+void Spotlight::updateStreamAlpha() {
+  _streamAlpha = averageStep(_streamSmoothing);
+}
+
+// Converts a time constant in ms to the step of an exponential moving
+// average per frame in Q15, so the renderer doesn't need to call expf().
+uint16_t Spotlight::averageStep(unsigned long timeConstant) const {
+  const float one = 1 << 15;
+  float alpha = 1.0f;
+  if (timeConstant > 0) {
+    alpha = 1.0f - expf(-(_frameInterval / 1000.0f) / timeConstant);
+  }
+  return static_cast<uint16_t>(std::max(1.0f, alpha * one + 0.5f));
 }
 
 // Main update method.
 void Spotlight::update() {
-  // --- Smooth Transition for Fixed Colors ---
-  if (_isTransitioning) {
-    unsigned long now = millis();
-    unsigned long elapsedTime = now - _transitionStartTime;
-    float t =
-        static_cast<float>(elapsedTime) / (_fixedTransitionDuration * 1000.0);
-    float easedT = Easing::getEasedValue(_fixedTransitionEasing, t);
-
-    if (t >= 1.0) {
-      // Transition is complete, jump to the final color and stop.
-      writeLeds(ColorSpace::lchToRgb(_fixedEndLCH));
-      _isTransitioning = false;
-    } else {
-      // Blending is still in progress.
-      ColorSpace::LCH interpolatedLCH =
-          _fixedStartLCH + (_fixedEndLCH - _fixedStartLCH) * easedT;
-      writeLeds(ColorSpace::lchToRgb(interpolatedLCH));
-    }
+  TRACE_SCOPE(Trace::Update);
+  if (_renderMode == RenderMode::Timer) {
+    return; // Frames are rendered from the Ticker.
+  }
+
+  // --- Frame Scheduler ---
+  // Only render when the next frame is due. The signed difference keeps
+  // this correct across the micros() overflow.
+  unsigned long nowMicros = micros();
+  if (static_cast<long>(nowMicros - _nextFrameTime) < 0) {
     return;
   }
+  _nextFrameTime += _frameInterval;
+  if (static_cast<long>(nowMicros - _nextFrameTime) >= 0) {
+    // We fell more than a frame behind (e.g. a slow request), so don't try
+    // to catch up with a burst of frames.
+    _nextFrameTime = nowMicros + _frameInterval;
+  }
 
-  if (!_isAnimating) {
+  renderFrame();
+}
+
+// Renders one frame of the published animation state, for all fixtures.
+void Spotlight::renderFrame() {
+  TRACE_SCOPE(Trace::RenderFrame);
+  if (isIdle()) {
     return;
   }
+  const AnimationState &state = _states[_publishedState];
+  unsigned long now = getTime();
+  if (_streamFixtures != 0 &&
+      millis() - _lastStreamTime >= Constants::STREAM_TIMEOUT) {
+    stopStream();
+  }
+  size_t firstPixel = 0;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if ((_streamFixtures >> f) & 1) {
+      renderStream(f, firstPixel);
+    } else {
+      renderFixture(state, f, now);
+    }
+    firstPixel += getPixelCount(f);
+  }
+  limitPower();
+  showOutputs();
+}
 
-  unsigned long now = millis();
-  unsigned long elapsedTime = now - _animationStartTime;
+// Renders the frame of one fixture.
+void Spotlight::renderFixture(const AnimationState &state, size_t f,
+                              unsigned long now) {
+  const Effects::Slot &effect = state.effect[f];
+  if (state.generation[f] != _renderedGeneration[f]) {
+    // A new mode or transition was started, restart from its beginning.
+    _renderedGeneration[f] = state.generation[f];
+    _renderStartTime[f] = state.startTime[f];
+    Effects::restart(effect, _effectRuntime[f]);
+    _startPending[f] = static_cast<long>(now - _renderStartTime[f]) < 0;
+  }
+  if (_startPending[f]) {
+    if (static_cast<long>(now - _renderStartTime[f]) < 0) {
+      return; // Starts later, keep showing the previous colors until then.
+    }
+    _startPending[f] = false;
+  }
 
-  // --- Color Wheel Mode ---
-  if (_rotationPeriod > 0) {
-    float hueDelta = (float)elapsedTime / (_rotationPeriod * 1000.0) * 360.0;
-    if (_rotationDirection == RotationDirection::CounterClockwise) {
-      hueDelta *= -1.0;
+  Effects::Context context = {now - _renderStartTime[f], state.settings[f],
+                              state.interpolation,       _gradientCache,
+                              state.colorCycleCount,     state.isRandom,
+                              _scene};
+  Effects::Canvas canvas(_frame, getPixelCount(f), _currentRGB[f],
+                         _outputs[f]->needsRefresh());
+  Effects::render(effect, _effectRuntime[f], context, canvas);
+  switch (canvas.result()) {
+  case Effects::Canvas::Result::Filled:
+    writeLeds(f, canvas.color());
+    break;
+  case Effects::Canvas::Result::Pixels:
+    writeFrame(f);
+    break;
+  default:
+    break;
+  }
+}
+
+namespace {
+// Moves a channel one smoothing step towards its target. Rounding away from
+// the channel keeps it moving until it reaches the target exactly.
+uint16_t smoothTowards(uint16_t channel, uint16_t target, uint16_t alpha) {
+  // The difference times a Q15 step fits into 32 bits.
+  int32_t step = (static_cast<int32_t>(target) - channel) * alpha;
+  const int32_t round = (1 << 15) - 1;
+  step = step > 0 ? (step + round) >> 15 : -((round - step) >> 15);
+  return channel + step;
+}
+} // namespace
+
+// Renders the streamed colors of a fixture, smoothed towards the last ones
+// received.
+void Spotlight::renderStream(size_t f, size_t firstPixel) {
+  size_t pixels = getPixelCount(f);
+  uint16_t alpha = _streamAlpha;
+  for (size_t i = 0; i < pixels; ++i) {
+    size_t pixel = firstPixel + i;
+    if (pixel >= Constants::MAX_PIXELS) {
+      _frame[i] = {0, 0, 0}; // Not covered by the stream buffer.
+      continue;
     }
+    const uint8_t *channels = _streamChannels + 3 * pixel;
+    ColorSpace::RGB16 target =
+        ColorSpace::fx::toRgb16({channels[0], channels[1], channels[2]});
+    ColorSpace::RGB16 &color = _streamRGB[pixel];
+    color.r = smoothTowards(color.r, target.r, alpha);
+    color.g = smoothTowards(color.g, target.g, alpha);
+    color.b = smoothTowards(color.b, target.b, alpha);
+    _frame[i] = color;
+  }
+  if (pixels == 1) {
+    writeLeds(f, _frame[0]);
+  } else {
+    writeFrame(f);
+  }
+}
 
-    _currentHue = fmod(_startHue + hueDelta, 360.0);
-    if (_currentHue < 0) {
-      _currentHue += 360.0;
+// Hands the fixtures back to their modes once the stream timed out.
+void Spotlight::stopStream() {
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if ((_streamFixtures >> f) & 1) {
+      // Static colors aren't rendered again, write the one they show. The
+      // modes kept their runtime and start time, so animations continue
+      // where they would be without the stream.
+      writeLeds(f, _resumeRGB[f]);
     }
+  }
+  _streamFixtures = 0;
+}
+
+// Converts a duration given in seconds to milliseconds.
+unsigned long Spotlight::toMillis(float seconds) {
+  return seconds > 0.0f ? static_cast<unsigned long>(seconds * 1000.0f) : 0;
+}
 
-    writeLeds(ColorSpace::hsvToRgb(_currentHue, _saturation, _value));
+// The pixels of a fixture, limited to the frame buffer.
+size_t Spotlight::getPixelCount(size_t fixture) const {
+  return std::min(_outputs[fixture]->getPixelCount(), Constants::MAX_PIXELS);
+}
+
+// Sends what was written to the outputs. Outputs sharing a bus send their
+// changes together.
+void Spotlight::showOutputs() {
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    _outputs[f]->show();
   }
+}
 
-  // --- Color Cycle Mode ---
-  else if (_colorCycleCount > 0) {
-    if (elapsedTime >= _transitionDuration * 1000.0) {
-      // Transition is complete, move to the next color.
-      _startLCH = _colorCycleList[_currentColorIndex];
+// Writes the given RGB color to all pixels of a fixture. The color is a
+// copy, callers pass colors from the buffers this updates.
+void Spotlight::writeLeds(size_t fixture, ColorSpace::RGB16 color) {
+  TRACE_SCOPE(Trace::WriteLeds);
+  if (color == _currentRGB[fixture] && !_varied[fixture] &&
+      !_outputs[fixture]->needsRefresh()) {
+    return; // The output didn't change, skip the update.
+  }
+  limitInrush(fixture, color);
+  _currentRGB[fixture] = color;
+  _varied[fixture] = false;
+  _outputs[fixture]->fill(color);
+  updateCurrent(fixture);
+  LATENCY_WRITTEN();
+}
 
-      // Move to the next index, handling randomness if enabled.
-      if (_colorCycleCount > 1 && _isRandom) {
-        size_t newIndex;
-        do {
-          newIndex = random(0, _colorCycleCount);
-        } while (newIndex == _currentColorIndex);
-        _currentColorIndex = newIndex;
-      } else {
-        _currentColorIndex = (_currentColorIndex + 1) % _colorCycleCount;
-      }
+// Writes the pixels rendered into the frame buffer to a fixture.
+void Spotlight::writeFrame(size_t fixture) {
+  TRACE_SCOPE(Trace::WriteLeds);
+  _currentRGB[fixture] = _frame[0];
+  _varied[fixture] = true;
+  _outputs[fixture]->write(_frame);
+  updateCurrent(fixture);
+  LATENCY_WRITTEN();
+}
+
+// Idle fixtures render nothing new. The stream, a mode that hasn't started
+// yet and dithering need frames, as does the power limit until it settled.
+bool Spotlight::isIdle() const {
+  if (_streamFixtures != 0 || !_powerSettled) {
+    return false;
+  }
+  const AnimationState &state = _states[_publishedState];
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (state.generation[f] != _renderedGeneration[f] || _startPending[f] ||
+        _outputs[f]->needsRefresh() ||
+        !Effects::isIdle(state.effect[f], _effectRuntime[f])) {
+      return false;
+    }
+  }
+  return true;
+}
 
-      _animationStartTime = now;
+// Estimates the current of a fixture from the load of the frame written to
+// it, keeping the total up to date.
+void Spotlight::updateCurrent(size_t fixture) {
+  uint32_t microamps = _outputs[fixture]->getCurrent();
+  _requestedCurrent += microamps - _fixtureCurrent[fixture];
+  _fixtureCurrent[fixture] = microamps;
+}
+
+// Applies the brightness and the power budget to the outputs. The estimates
+// are kept up to date by the writes, so this is a few integer operations per
+// frame, unless the scale changes.
+void Spotlight::limitPower() {
+  _powerSettled = true;
+  if (SPOTLIGHT_POWER_BUDGET > 0) {
+    uint32_t current =
+        static_cast<uint64_t>(_requestedCurrent) * _brightness >> 16;
+    _powerSettled = current == _averageCurrent;
+    if (current >= _averageCurrent) {
+      _averageCurrent = current;
     } else {
-      // Blending is still in progress.
-      float t = (float)elapsedTime / (_transitionDuration * 1000.0);
-      float easedT = Easing::getEasedValue(_currentEasing, t);
+      // Rounded up, so the average reaches the current.
+      uint64_t step = static_cast<uint64_t>(_averageCurrent - current) *
+                      _powerAlpha;
+      _averageCurrent -= (step + (1u << 15) - 1) >> 15;
+    }
+  }
+  applyScale(powerScale());
+}
+
+// Lowers the scale before a fixture is written with a color that would
+// exceed the budget, rather than letting the next frame do it. Fixtures
+// with varied pixels keep their frame until they are rendered again.
+void Spotlight::limitInrush(size_t fixture, ColorSpace::RGB16 color) {
+  if (SPOTLIGHT_POWER_BUDGET == 0) {
+    return;
+  }
+  uint32_t pixels = getPixelCount(fixture);
+  const uint32_t load[3] = {_outputCurves[0].apply(color.r) * pixels,
+                            _outputCurves[1].apply(color.g) * pixels,
+                            _outputCurves[2].apply(color.b) * pixels};
+  uint32_t requested = _requestedCurrent - _fixtureCurrent[fixture] +
+                       _outputs[fixture]->getCurrent(load);
+  uint32_t current = static_cast<uint64_t>(requested) * _brightness >> 16;
+  if (current > _averageCurrent) {
+    _averageCurrent = current; // As limitPower() would in the next frame.
+    applyScale(powerScale());
+  }
+}
+
+// The scale of the outputs, the brightness limited to the budget.
+uint32_t Spotlight::powerScale() const {
+  const uint32_t budget = SPOTLIGHT_POWER_BUDGET * 1000UL;
+  if (SPOTLIGHT_POWER_BUDGET > 0 && _averageCurrent > budget) {
+    return static_cast<uint64_t>(_brightness) * budget / _averageCurrent;
+  }
+  return _brightness;
+}
 
-      ColorSpace::LCH start = _startLCH;
-      ColorSpace::LCH end = _colorCycleList[_currentColorIndex];
+// Sets a new scale on the outputs.
+void Spotlight::applyScale(uint32_t scale) {
+  if (scale == _outputScale) {
+    return;
+  }
+  _powerSettled = false;
+  _outputScale = scale;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    _outputs[f]->setScale(scale);
+    // Fixtures with varied pixels are rendered every frame, the others are
+    // written again with the new scale.
+    if (!_varied[f]) {
+      _outputs[f]->fill(_currentRGB[f]);
+    }
+  }
+}
 
-      // Use the new overloaded operators for simplified interpolation.
-      ColorSpace::LCH interpolatedLCH = start + (end - start) * easedT;
+// Returns the state not read by the renderer, as a copy of the published
+// one, for a setter to modify. Within a batch all setters share one copy.
+Spotlight::AnimationState &Spotlight::editState() {
+  uint8_t back = 1 - _publishedState;
+  if (!_batchEdited) {
+    _states[back] = _states[_publishedState];
+    _batchEdited = _batching;
+  }
+  return _states[back];
+}
 
-      writeLeds(ColorSpace::lchToRgb(interpolatedLCH));
+// Makes the state returned by editState() the one the renderer reads. Within
+// a batch this is deferred to endBatch().
+void Spotlight::publishState(FixtureMask restart) {
+  if (_batching) {
+    _batchRestart |= restart;
+    return;
+  }
+  uint8_t back = 1 - _publishedState;
+  unsigned long start = _hasStartTime ? _startTime : getTime();
+  _hasStartTime = false;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if ((restart >> f) & 1) {
+      _states[back].generation[f]++;
+      _states[back].startTime[f] = start;
     }
   }
+  _publishedState = back;
+  _revision++;
+  LATENCY_APPLIED();
 }
 
-// Writes the given RGB color to the LED pins.
-void Spotlight::writeLeds(const ColorSpace::RGB &color) {
-  _currentRGB = color;
-  analogWrite(_redPin, color.r);
-  analogWrite(_greenPin, color.g);
-  analogWrite(_bluePin, color.b);
+// Starts deferring the publication of changes.
+void Spotlight::beginBatch() {
+  _batching = true;
+  _batchEdited = false;
+  _batchRestart = 0;
 }
 
-// Stops all running animations/modes.
-void Spotlight::stopAllAnimations() {
-  _isAnimating = false;
-  _isTransitioning = false;
-  _rotationPeriod = 0.0;
-  _colorCycleCount = 0;
+// Publishes all changes of the batch at once.
+void Spotlight::endBatch() {
+  if (!_batching) {
+    return;
+  }
+  _batching = false;
+  if (_batchEdited) {
+    _batchEdited = false;
+    publishState(_batchRestart);
+  }
+  _hasStartTime = false; // Only lasts until the end of its batch.
 }
 
-// Gets the current color, regardless of the active mode.
-ColorSpace::RGB Spotlight::getCurrentRGB() {
-  if (_isTransitioning) {
-    unsigned long now = millis();
-    unsigned long elapsedTime = now - _transitionStartTime;
-    float t =
-        static_cast<float>(elapsedTime) / (_fixedTransitionDuration * 1000.0);
-    t = std::min(1.0f, t); // Clamp to prevent overshooting
-    float easedT = Easing::getEasedValue(_fixedTransitionEasing, t);
+unsigned long Spotlight::getTime() const { return millis() + _clockOffset; }
 
-    ColorSpace::LCH interpolatedLCH =
-        _fixedStartLCH + (_fixedEndLCH - _fixedStartLCH) * easedT;
-    return ColorSpace::lchToRgb(interpolatedLCH);
-  } else if (_rotationPeriod > 0) {
-    return ColorSpace::hsvToRgb(_currentHue, _saturation, _value);
-  } else if (_colorCycleCount > 0) {
-    unsigned long now = millis();
-    unsigned long elapsedTime = now - _animationStartTime;
-    float t = static_cast<float>(elapsedTime) / (_transitionDuration * 1000.0);
-    t = std::min(1.0f, t);
-    float easedT = Easing::getEasedValue(_currentEasing, t);
+void Spotlight::setClockOffset(unsigned long offset) { _clockOffset = offset; }
 
-    ColorSpace::LCH start = _startLCH;
-    ColorSpace::LCH end = _colorCycleList[_currentColorIndex];
-    ColorSpace::LCH interpolatedLCH = start + (end - start) * easedT;
+void Spotlight::setStartTime(unsigned long time) {
+  _startTime = time;
+  _hasStartTime = true;
+}
 
-    return ColorSpace::lchToRgb(interpolatedLCH);
-  } else {
-    return _currentRGB;
+// Gets the current color of a fixture, regardless of the active mode. This is
+// the color of the last rendered frame.
+ColorSpace::RGB Spotlight::getColor(size_t fixture) {
+  if (fixture >= _fixtureCount) {
+    return {0, 0, 0};
   }
+  return ColorSpace::fx::toRgb8(_currentRGB[fixture]);
 }
 
 // Sets a fixed RGB color with a smooth transition.
 void Spotlight::setRGB(uint8_t r, uint8_t g, uint8_t b) {
-  ColorSpace::RGB startColor = getCurrentRGB();
-
-  stopAllAnimations(); // This will also stop the current transition.
+  AnimationState &state = editState();
+  ColorSpace::fx::LCH endLCH =
+      ColorSpace::fx::fromRgb({r, g, b}, state.interpolation);
 
-  _fixedStartLCH = ColorSpace::rgbToLch(startColor);
-  _fixedEndLCH = ColorSpace::rgbToLch({r, g, b});
-
-  _isTransitioning = true;
-  _transitionStartTime = millis();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (!isSelected(f)) {
+      continue;
+    }
+    state.effect[f].emplace<Effects::Fade>(
+        ColorSpace::fx::fromRgb(ColorSpace::fx::toRgb8(_currentRGB[f]),
+                                state.interpolation),
+        endLCH);
+  }
+  publishState(_selectedFixtures);
 }
 
 // Sets color based on Kelvin temperature.
 void Spotlight::setColorTemperature(float kelvin, float brightness) {
-  stopAllAnimations();
-  ColorSpace::RGB rgb = ColorSpace::kelvinToRgb(kelvin);
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Static>();
+    }
+  }
+  publishState(_selectedFixtures);
 
-  // Apply brightness scalar.
-  rgb.r = static_cast<uint8_t>(rgb.r * brightness);
-  rgb.g = static_cast<uint8_t>(rgb.g * brightness);
-  rgb.b = static_cast<uint8_t>(rgb.b * brightness);
+  ColorSpace::RGB16 rgb =
+      ColorSpace::fx::toRgb16(ColorSpace::kelvinToRgb(kelvin));
 
-  _currentRGB = rgb;
-  writeLeds(_currentRGB);
+  // Apply brightness scalar.
+  brightness = std::max(0.0f, std::min(1.0f, brightness));
+  rgb.r = static_cast<uint16_t>(rgb.r * brightness);
+  rgb.g = static_cast<uint16_t>(rgb.g * brightness);
+  rgb.b = static_cast<uint16_t>(rgb.b * brightness);
+
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (!isSelected(f)) {
+      continue;
+    }
+    if ((_streamFixtures >> f) & 1) {
+      _resumeRGB[f] = rgb; // Shown once the stream ends.
+    } else {
+      writeLeds(f, rgb);
+    }
+  }
+  showOutputs();
 }
 
 // Enables continuous color wheel mode.
 void Spotlight::enableColorWheelMode(float periodSeconds,
                                      RotationDirection direction) {
-  stopAllAnimations();
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (!isSelected(f)) {
+      continue;
+    }
+    float h, s, v;
+    ColorSpace::rgbToHsv(ColorSpace::fx::toRgb8(_currentRGB[f]), h, s, v);
+    state.effect[f].emplace<Effects::Wheel>(
+        ColorSpace::fx::hueFromDegrees(h), toMillis(periodSeconds),
+        direction == RotationDirection::CounterClockwise);
+  }
+  publishState(_selectedFixtures);
+}
 
-  ColorSpace::RGB startColor = getCurrentRGB();
-  float h, s, v;
-  ColorSpace::rgbToHsv(startColor, h, s, v);
-  _startHue = h;
-  _rotationPeriod = periodSeconds;
-  _rotationDirection = direction;
-  _isAnimating = true;
-  _animationStartTime = millis();
+// Sets how much of the color wheel the pixels of a fixture show at once.
+void Spotlight::setWheelSpread(float spread) {
+  spread = std::max(0.0f, std::min(1.0f, spread));
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.settings[f].wheelSpread =
+          static_cast<uint16_t>(spread * 65535.0f + 0.5f);
+    }
+  }
+  publishState(0);
 }
 
 // Enables color cycle mode.
 void Spotlight::enableColorCycleMode(const ColorSpace::RGB *colors,
                                      size_t count, bool isRandom) {
-  stopAllAnimations();
-
-  // Populate fixed-size array and convert colors to LCH.
-  _colorCycleCount = std::min(count, Constants::MAX_COLORS);
-  _isRandom = isRandom;
-  for (size_t i = 0; i < _colorCycleCount; ++i) {
-    _colorCycleList[i] = ColorSpace::rgbToLch(colors[i]);
+  AnimationState &state = editState();
+  // The palette is shared, so the fixtures already cycling restart with the
+  // new one too.
+  FixtureMask restart = _selectedFixtures;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Static>();
+    } else if (state.effect[f].is<Effects::Cycle>()) {
+      restart |= 1u << f;
+    }
   }
 
-  if (_colorCycleCount == 0) {
+  // Populate fixed-size array and convert the colors to the interpolation
+  // space. This is the expensive part, so it's only done here.
+  size_t colorCount = std::min(count, Constants::MAX_COLORS);
+  state.colorCycleCount = colorCount;
+  if (colorCount == 0) {
+    publishState(restart);
     return; // Nothing to animate.
   }
+  for (size_t i = 0; i < colorCount; ++i) {
+    _colorCycleList[i] =
+        ColorSpace::fx::fromRgb(colors[i], state.interpolation);
+  }
 
   // Manual shuffle using Arduino's random() function.
-  if (_isRandom) {
-    for (size_t i = 0; i < _colorCycleCount - 1; ++i) {
-      size_t j = random(i, _colorCycleCount);
+  if (isRandom) {
+    for (size_t i = 0; i < colorCount - 1; ++i) {
+      size_t j = random(i, colorCount);
       if (i != j) {
         // Swap elements.
-        ColorSpace::LCH temp = _colorCycleList[i];
+        ColorSpace::fx::LCH temp = _colorCycleList[i];
         _colorCycleList[i] = _colorCycleList[j];
         _colorCycleList[j] = temp;
       }
     }
   }
 
-  _currentColorIndex = 0;
-  _startLCH = _colorCycleList[_currentColorIndex];
+  // Pre-render the transitions. Random order can't know the next color, so
+  // its transitions are rendered as they start.
+  _gradientCache.build(_colorCycleList, colorCount, !isRandom,
+                       state.interpolation);
 
-  _isAnimating = true;
-  _animationStartTime = millis();
+  state.isRandom = isRandom;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Cycle>();
+    }
+  }
+  publishState(restart);
+}
+
+// Plays a stored keyframe scene.
+bool Spotlight::playScene(uint8_t slot) {
+  if (!_scene.load(slot)) {
+    return false;
+  }
+  _sceneSlot = slot;
+
+  AnimationState &state = editState();
+  // The scene is shared, so the fixtures already playing restart with the
+  // new one too.
+  FixtureMask restart = _selectedFixtures;
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Playback>(ColorSpace::fx::fromLch(
+          ColorSpace::rgbToLch(ColorSpace::fx::toRgb8(_currentRGB[f]))));
+    } else if (state.effect[f].is<Effects::Playback>()) {
+      restart |= 1u << f;
+    }
+  }
+  publishState(restart);
+  return true;
+}
+
+// Enables the breathing brightness pulse.
+void Spotlight::enableBreatheMode(const ColorSpace::RGB &color,
+                                  float periodSeconds, float minimum) {
+  minimum = std::max(0.0f, std::min(1.0f, minimum));
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Breathe>(
+          ColorSpace::fx::toRgb16(color), toMillis(periodSeconds),
+          static_cast<uint8_t>(minimum * 255.0f + 0.5f));
+    }
+  }
+  publishState(_selectedFixtures);
+}
+
+// Enables the strobe flashes.
+void Spotlight::enableStrobeMode(const ColorSpace::RGB &color,
+                                 float periodSeconds, float duty) {
+  duty = std::max(0.0f, std::min(1.0f, duty));
+  // The effect is on for (duty + 1) / 256 of the period.
+  uint8_t onTime =
+      static_cast<uint8_t>(std::max(0.0f, duty * 256.0f - 0.5f));
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Strobe>(
+          ColorSpace::fx::toRgb16(color), toMillis(periodSeconds), onTime);
+    }
+  }
+  publishState(_selectedFixtures);
+}
+
+// Enables the candle flicker.
+void Spotlight::enableCandleMode(const ColorSpace::RGB &color,
+                                 float intensity) {
+  intensity = std::max(0.0f, std::min(1.0f, intensity));
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.effect[f].emplace<Effects::Candle>(
+          ColorSpace::fx::toRgb16(color),
+          static_cast<uint8_t>(intensity * 255.0f + 0.5f));
+    }
+  }
+  publishState(_selectedFixtures);
 }
 
 // Sets the duration for each color cycle transition.
 void Spotlight::setCycleDuration(float duration) {
-  _transitionDuration = duration;
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.settings[f].cycleDuration = toMillis(duration);
+    }
+  }
+  publishState(0);
 }
 
 // Sets the easing function for each color cycle transition.
 void Spotlight::setCycleEasing(Easing::EasingFunction easing) {
-  _currentEasing = easing;
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.settings[f].cycleEasing = easing;
+    }
+  }
+  publishState(0);
 }
 
 void Spotlight::setTransitionDuration(float duration) {
-  _fixedTransitionDuration = duration;
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.settings[f].fadeDuration = toMillis(duration);
+    }
+  }
+  publishState(0);
 }
 
 void Spotlight::setTransitionEasing(Easing::EasingFunction easing) {
-  _fixedTransitionEasing = easing;
+  AnimationState &state = editState();
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (isSelected(f)) {
+      state.settings[f].fadeEasing = easing;
+    }
+  }
+  publishState(0);
+}
+
+// Converts the stored colors to another interpolation space.
+void Spotlight::setInterpolation(ColorSpace::Interpolation space) {
+  AnimationState &state = editState();
+  ColorSpace::Interpolation previous = state.interpolation;
+  if (space == previous) {
+    publishState(0);
+    return;
+  }
+  // Through RGB, like the colors were converted when they were set.
+  auto convert = [previous, space](const ColorSpace::fx::LCH &lch) {
+    return ColorSpace::fx::fromRgb(
+        ColorSpace::fx::toRgb8(ColorSpace::fx::lchToRgb(lch, previous)),
+        space);
+  };
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    if (state.effect[f].is<Effects::Fade>()) {
+      Effects::Fade &fade = state.effect[f].get<Effects::Fade>();
+      fade.start = convert(fade.start);
+      fade.end = convert(fade.end);
+    }
+  }
+  for (size_t i = 0; i < state.colorCycleCount; ++i) {
+    _colorCycleList[i] = convert(_colorCycleList[i]);
+  }
+  _gradientCache.build(_colorCycleList, state.colorCycleCount,
+                       !state.isRandom, space);
+  state.interpolation = space;
+  publishState(0);
+}
+
+uint32_t Spotlight::getRevision() const { return _revision; }
+
+const Effects::Slot &Spotlight::getEffect(size_t fixture) const {
+  return _states[_publishedState].effect[fixture];
+}
+
+const Effects::Settings &Spotlight::getSettings(size_t fixture) const {
+  return _states[_publishedState].settings[fixture];
+}
+
+ColorSpace::Interpolation Spotlight::getInterpolation() const {
+  return _states[_publishedState].interpolation;
+}
+
+// Converts the palette back from the interpolation space.
+size_t Spotlight::getPalette(ColorSpace::RGB *colors, bool &isRandom) const {
+  const AnimationState &state = _states[_publishedState];
+  for (size_t i = 0; i < state.colorCycleCount; ++i) {
+    colors[i] = ColorSpace::fx::toRgb8(
+        ColorSpace::fx::lchToRgb(_colorCycleList[i], state.interpolation));
+  }
+  isRandom = state.isRandom;
+  return state.colorCycleCount;
+}
+
+uint8_t Spotlight::getSceneSlot() const { return _sceneSlot; }
+
+namespace {
+// Bump when the record layout changes, older records are ignored then.
+const uint8_t RECORD_VERSION = 3;
+const uint8_t FLAG_RANDOM = 0x01;
+const uint8_t FLAG_OKLCH = 0x02; // The colors are OKLCH, see Interpolation.
+const size_t RECORD_HEADER_SIZE = 5;
+const size_t RECORD_FIXTURE_SIZE = 19 + Effects::RECORD_PARAMS_SIZE;
+const size_t RECORD_COLOR_SIZE = 6;
+static_assert(Constants::MAX_STATE_SIZE ==
+                  RECORD_HEADER_SIZE +
+                      RECORD_FIXTURE_SIZE * Constants::MAX_FIXTURES +
+                      RECORD_COLOR_SIZE * Constants::MAX_COLORS,
+              "MAX_STATE_SIZE doesn't match the state record");
+
+// Offsets in the record of a fixture. The mode is the index of its effect in
+// Effects::Slot, followed by the color it shows or fades to, the settings
+// and the parameters of the effect.
+const size_t RECORD_FADE_EASING = 11;
+const size_t RECORD_CYCLE_EASING = 18;
+const size_t RECORD_PARAMS = 19;
+} // namespace
+
+// Writes the settings of the published state, not its raw memory, so the
+// record only holds the configured fixtures and colors.
+size_t Spotlight::saveState(uint8_t *out, size_t size) const {
+  const AnimationState &state = _states[_publishedState];
+  size_t colorCount = state.colorCycleCount;
+  size_t length = RECORD_HEADER_SIZE + RECORD_FIXTURE_SIZE * _fixtureCount +
+                  RECORD_COLOR_SIZE * colorCount;
+  if (_batching || length > size) {
+    return 0;
+  }
+
+  Effects::RecordWriter writer = {out};
+  writer.put8(RECORD_VERSION);
+  writer.put8(static_cast<uint8_t>(_fixtureCount));
+  writer.put8(static_cast<uint8_t>(colorCount));
+  bool oklch = state.interpolation == ColorSpace::Interpolation::Oklch;
+  writer.put8((state.isRandom ? FLAG_RANDOM : 0) | (oklch ? FLAG_OKLCH : 0));
+  writer.put8(_sceneSlot);
+  for (size_t f = 0; f < _fixtureCount; ++f) {
+    const Effects::Slot &effect = state.effect[f];
+    const Effects::Settings &settings = state.settings[f];
+    // Static colors, e.g. from setColorTemperature(), aren't in the state.
+    // They are stored as a fade to the color shown, which has no parameters
+    // either.
+    ColorSpace::fx::LCH color =
+        effect.is<Effects::Fade>()
+            ? effect.get<Effects::Fade>().end
+            : ColorSpace::fx::fromRgb(ColorSpace::fx::toRgb8(_currentRGB[f]),
+                                      state.interpolation);
+    writer.put8(effect.is<Effects::Static>()
+                    ? Effects::Slot::indexOf<Effects::Fade>()
+                    : effect.index());
+    writer.putLch(color);
+    writer.put32(settings.fadeDuration);
+    writer.put8(static_cast<uint8_t>(settings.fadeEasing));
+    writer.put16(settings.wheelSpread);
+    writer.put32(settings.cycleDuration);
+    writer.put8(static_cast<uint8_t>(settings.cycleEasing));
+    Effects::save(effect, writer);
+  }
+  for (size_t i = 0; i < colorCount; ++i) {
+    writer.putLch(_colorCycleList[i]);
+  }
+  return length;
+}
+
+bool Spotlight::restoreState(const uint8_t *data, size_t length) {
+  if (_batching || length < RECORD_HEADER_SIZE ||
+      data[0] != RECORD_VERSION) {
+    return false;
+  }
+  Effects::RecordReader reader = {data + 1};
+  size_t fixtureCount = reader.get8();
+  size_t colorCount = reader.get8();
+  uint8_t flags = reader.get8();
+  uint8_t sceneSlot = reader.get8();
+  if (colorCount > Constants::MAX_COLORS ||
+      length != RECORD_HEADER_SIZE + RECORD_FIXTURE_SIZE * fixtureCount +
+                    RECORD_COLOR_SIZE * colorCount) {
+    return false;
+  }
+  // Check everything first, so an invalid record changes nothing.
+  const uint8_t playback = Effects::Slot::indexOf<Effects::Playback>();
+  bool scene = false;
+  for (size_t f = 0; f < fixtureCount; ++f) {
+    const uint8_t *fixture =
+        data + RECORD_HEADER_SIZE + RECORD_FIXTURE_SIZE * f;
+    Effects::Slot effect;
+    Effects::RecordReader params = {fixture + RECORD_PARAMS};
+    if (fixture[RECORD_FADE_EASING] >= Easing::EASING_FUNCTION_COUNT ||
+        fixture[RECORD_CYCLE_EASING] >= Easing::EASING_FUNCTION_COUNT ||
+        !Effects::restore(effect, fixture[0], params, {0, 0, 0})) {
+      return false;
+    }
+    scene = scene || (f < _fixtureCount && fixture[0] == playback);
+  }
+  bool sceneLoaded = scene && _scene.load(sceneSlot);
+  if (sceneLoaded) {
+    _sceneSlot = sceneSlot;
+  }
+
+  // The back state is free outside of a batch, it starts from the published
+  // one so fixtures missing from the record keep their settings.
+  AnimationState &state = _states[1 - _publishedState];
+  state = _states[_publishedState];
+  for (size_t f = 0; f < fixtureCount; ++f) {
+    uint8_t mode = reader.get8();
+    ColorSpace::fx::LCH color = reader.getLch();
+    Effects::Settings settings;
+    settings.fadeDuration = reader.get32();
+    settings.fadeEasing = static_cast<Easing::EasingFunction>(reader.get8());
+    settings.wheelSpread = reader.get16();
+    settings.cycleDuration = reader.get32();
+    settings.cycleEasing = static_cast<Easing::EasingFunction>(reader.get8());
+    Effects::Slot effect;
+    Effects::restore(effect, mode, reader, color);
+    if (f >= _fixtureCount) {
+      continue; // Saved with more fixtures than configured now.
+    }
+
+    if (effect.is<Effects::Playback>() && !sceneLoaded) {
+      // The slot was emptied, fade in the color shown instead.
+      effect.emplace<Effects::Fade>(ColorSpace::fx::LCH{0, 0, 0}, color);
+    }
+    state.effect[f] = effect;
+    state.settings[f] = settings;
+  }
+
+  for (size_t i = 0; i < colorCount; ++i) {
+    _colorCycleList[i] = reader.getLch();
+  }
+  state.colorCycleCount = colorCount;
+  state.isRandom = (flags & FLAG_RANDOM) != 0;
+  state.interpolation = (flags & FLAG_OKLCH) != 0
+                            ? ColorSpace::Interpolation::Oklch
+                            : ColorSpace::Interpolation::Hsl;
+  _gradientCache.build(_colorCycleList, colorCount, !state.isRandom,
+                       state.interpolation);
+  publishState(ALL_FIXTURES);
+  return true;
 }
@@ -6,21 +6,220 @@
 #include "SpotlightServer.h"
 #include "ColorSpace.h"
 #include "Easing.h"
+#include "Latency.h"
+#include "Log.h"
+#include "Protocol.h"
+#include "Scene.h"
+#include "Trace.h"
 #include "config.h"
 #include <ESP8266mDNS.h>
 #include <LittleFS.h>
+#include <coredecls.h>
+#include <algorithm>
+#include <cstring>
+
+// --- Request wrappers for the server backends ---
+// Arguments and headers are looked up by index, which hands out the
+// backend's own strings. Looking them up by name would construct a String
+// for every lookup.
+
+namespace {
+#if SPOTLIGHT_ASYNC_SERVER
+class AsyncRequest : public HttpRequest {
+public:
+  AsyncRequest(AsyncWebServerRequest *request) : _request(request) {}
+
+  const char *uri() override { return _request->url().c_str(); }
+
+  const char *arg(const char *name) override {
+    for (size_t i = 0; i < _request->args(); ++i) {
+      if (strcmp(_request->argName(i).c_str(), name) == 0) {
+        return _request->arg(i).c_str();
+      }
+    }
+    return nullptr;
+  }
+
+  // The body is collected by onPost(), after a byte that is set if it was
+  // too large.
+  const char *body() override {
+    const char *body = static_cast<const char *>(_request->_tempObject);
+    return body != nullptr ? body + 1 : "";
+  }
+
+  bool isBodyTooLarge() override {
+    const char *body = static_cast<const char *>(_request->_tempObject);
+    return body != nullptr && body[0] != 0;
+  }
+
+  const char *header(const char *name) override {
+    for (size_t i = 0; i < _request->headers(); ++i) {
+      AsyncWebHeader *header = _request->getHeader(i);
+      if (strcasecmp(header->name().c_str(), name) == 0) {
+        return header->value().c_str();
+      }
+    }
+    return nullptr;
+  }
+
+  void send(int code, const char *contentType, const char *content) override {
+    _request->send(code, contentType, content);
+  }
+
+  // The file is sent in chunks from the TCP callbacks, without blocking.
+  bool sendFile(const char *path, const char *contentType, bool gzipped,
+                const char *etag) override {
+    AsyncWebServerResponse *response =
+        _request->beginResponse(LittleFS, path, contentType);
+    if (gzipped) {
+      response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", Constants::ASSET_CACHE_CONTROL);
+    _request->send(response);
+    return true;
+  }
+
+  void sendNotModified(const char *etag) override {
+    AsyncWebServerResponse *response = _request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", Constants::ASSET_CACHE_CONTROL);
+    _request->send(response);
+  }
+
+  void sendTagged(const char *contentType, const char *content,
+                  const char *etag) override {
+    AsyncWebServerResponse *response =
+        _request->beginResponse(200, contentType, content);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    _request->send(response);
+  }
+
+private:
+  AsyncWebServerRequest *_request;
+};
+#else
+class SyncRequest : public HttpRequest {
+public:
+  SyncRequest(ESP8266WebServer &server) : _server(server) {}
+
+  const char *uri() override { return _server.uri().c_str(); }
+
+  const char *arg(const char *name) override {
+    for (int i = 0; i < _server.args(); ++i) {
+      if (strcmp(_server.argName(i).c_str(), name) == 0) {
+        return _server.arg(i).c_str();
+      }
+    }
+    return nullptr;
+  }
+
+  // The server keeps the body of a POST request as the "plain" argument.
+  const char *body() override {
+    const char *body = arg("plain");
+    return body != nullptr ? body : "";
+  }
+
+  bool isBodyTooLarge() override {
+    return strlen(body()) > Constants::MAX_BODY_SIZE;
+  }
+
+  const char *header(const char *name) override {
+    for (int i = 0; i < _server.headers(); ++i) {
+      if (strcasecmp(_server.headerName(i).c_str(), name) == 0) {
+        return _server.header(i).c_str();
+      }
+    }
+    return nullptr;
+  }
+
+  void send(int code, const char *contentType, const char *content) override {
+    _server.send(code, contentType, content);
+  }
+
+  // streamFile() adds the Content-Encoding header for *.gz files itself.
+  bool sendFile(const char *path, const char *contentType, bool gzipped,
+                const char *etag) override {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      return false;
+    }
+    _server.sendHeader("ETag", etag);
+    _server.sendHeader("Cache-Control", Constants::ASSET_CACHE_CONTROL);
+    _server.streamFile(file, contentType);
+    file.close();
+    return true;
+  }
+
+  void sendNotModified(const char *etag) override {
+    _server.sendHeader("ETag", etag);
+    _server.sendHeader("Cache-Control", Constants::ASSET_CACHE_CONTROL);
+    _server.send(304);
+  }
+
+  void sendTagged(const char *contentType, const char *content,
+                  const char *etag) override {
+    _server.sendHeader("ETag", etag);
+    _server.sendHeader("Cache-Control", "no-cache");
+    _server.send(200, contentType, content);
+  }
+
+private:
+  ESP8266WebServer &_server;
+};
+#endif
+
+// Checks whether a string ends with the given suffix.
+bool endsWith(const char *text, const char *suffix) {
+  size_t textLength = strlen(text);
+  size_t suffixLength = strlen(suffix);
+  return textLength >= suffixLength &&
+         strcmp(text + textLength - suffixLength, suffix) == 0;
+}
+
+// The access point of the last connection. Connecting to a known BSSID and
+// channel skips the scan, which takes most of the connection time.
+const char *const WIFI_CACHE_PATH = "/wifi.bin";
+
+struct WifiCache {
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+bool loadWifiCache(WifiCache &cache) {
+  File file = LittleFS.open(WIFI_CACHE_PATH, "r");
+  if (!file) {
+    return false;
+  }
+  size_t length = file.read(reinterpret_cast<uint8_t *>(&cache), sizeof(cache));
+  file.close();
+  return length == sizeof(cache) && cache.channel != 0;
+}
+
+void saveWifiCache(const WifiCache &cache) {
+  File file = LittleFS.open(WIFI_CACHE_PATH, "w");
+  if (file) {
+    file.write(reinterpret_cast<const uint8_t *>(&cache), sizeof(cache));
+    file.close();
+  }
+}
+} // namespace
 
 // --- Helper functions for the web server ---
 
 /**
  * @brief Gets a float value from a web server argument, with a default value.
+ * @param request The request to read the argument from.
  * @param name The name of the argument.
  * @param defaultValue The value to return if the argument is not found.
  * @return The float value of the argument, or the default value.
  */
-float SpotlightServer::getFloatArg(const String &name, float defaultValue) {
-  if (_server.hasArg(name)) {
-    return _server.arg(name).toFloat();
+float SpotlightServer::getFloatArg(HttpRequest &request, const char *name,
+                                   float defaultValue) {
+  const char *value = request.arg(name);
+  if (value != nullptr) {
+    return strtof(value, nullptr);
   }
   return defaultValue;
 }
@@ -28,263 +227,1123 @@ float SpotlightServer::getFloatArg(const String &name, float defaultValue) {
 /**
  * @brief Gets an integer value from a web server argument, with a default
  * value.
+ * @param request The request to read the argument from.
  * @param name The name of the argument.
  * @param defaultValue The value to return if the argument is not found.
  * @return The integer value of the argument, or the default value.
  */
-int SpotlightServer::getIntArg(const String &name, int defaultValue) {
-  if (_server.hasArg(name)) {
-    return _server.arg(name).toInt();
+int SpotlightServer::getIntArg(HttpRequest &request, const char *name,
+                               int defaultValue) {
+  const char *value = request.arg(name);
+  if (value != nullptr) {
+    return strtol(value, nullptr, 10);
   }
   return defaultValue;
 }
 
-// --- API Endpoint Handlers ---
+// Every command of a request is preceded by its fixture selection.
+bool SpotlightServer::beginMessage(HttpRequest &request,
+                                   Protocol::Message &message) {
+  const char *value = request.arg("fixture");
+  Spotlight::FixtureMask fixtures = 0;
+  if (value == nullptr || strcasecmp(value, "all") == 0) {
+    fixtures = Spotlight::ALL_FIXTURES;
+  } else {
+    const char *cursor = value;
+    do {
+      char *end;
+      long index = strtol(cursor, &end, 10);
+      if (end == cursor || index < 0 ||
+          static_cast<size_t>(index) >= _spotlight->getFixtureCount() ||
+          (*end != ',' && *end != '\0')) {
+        request.send(400, "text/plain", "Invalid fixture");
+        return false;
+      }
+      fixtures |= 1u << index;
+      cursor = *end == ',' ? end + 1 : end;
+    } while (*cursor != '\0');
+  }
+  message.put8(Protocol::SelectFixtures).put16(fixtures);
+
+  const char *start = request.arg("start");
+  if (start != nullptr) {
+    char *end;
+    unsigned long time = strtoul(start, &end, 10);
+    if (end == start || *end != '\0') {
+      request.send(400, "text/plain", "Invalid start");
+      return false;
+    }
+    message.put8(Protocol::StartAt).put32(time);
+  }
+  return true;
+}
 
-void SpotlightServer::handleSetRGB() {
-  Serial.print("handleSetRGB() called: ");
-  uint8_t r = getIntArg("r", 0);
-  uint8_t g = getIntArg("g", 0);
-  uint8_t b = getIntArg("b", 0);
-  Serial.printf("decoded rgb: %d, %d, %d\n", r, g, b);
-  _spotlight->setRGB(r, g, b);
-  _server.send(200, "text/plain", "OK");
+// Converts seconds from a request argument to the milliseconds of the
+// protocol.
+static uint32_t toMillis(float seconds) {
+  return seconds > 0.0f ? static_cast<uint32_t>(seconds * 1000.0f + 0.5f) : 0;
 }
 
-void SpotlightServer::handleSetKelvin() {
-  Serial.print("handleSetKelvin() called: ");
-  float kelvin = getFloatArg("kelvin", 6500.0);
-  float brightness = getFloatArg("brightness", 1.0);
+// Handlers are timed per route for /metrics.
+void SpotlightServer::on(const char *uri, Handler handler) {
+  int route = _metrics->addRoute(uri);
+#if SPOTLIGHT_ASYNC_SERVER
+  _server.on(uri, HTTP_GET, [this, handler, route](AsyncWebServerRequest *r) {
+    unsigned long start = micros();
+    AsyncRequest request(r);
+    (this->*handler)(request);
+    _metrics->recordRequest(route, micros() - start);
+  });
+#else
+  _server.on(uri, HTTP_GET, [this, handler, route]() {
+    unsigned long start = micros();
+    SyncRequest request(_server);
+    (this->*handler)(request);
+    _metrics->recordRequest(route, micros() - start);
+  });
+#endif
+}
 
-  Serial.printf("decoded kelvin: %f, decoded brightness %f\n", kelvin,
-                brightness);
-  _spotlight->setColorTemperature(kelvin, brightness);
-  _server.send(200, "text/plain", "OK");
+void SpotlightServer::onPost(const char *uri, Handler handler) {
+  int route = _metrics->addRoute(uri);
+#if SPOTLIGHT_ASYNC_SERVER
+  _server.on(
+      uri, HTTP_POST,
+      [this, handler, route](AsyncWebServerRequest *r) {
+        unsigned long start = micros();
+        AsyncRequest request(r);
+        (this->*handler)(request);
+        _metrics->recordRequest(route, micros() - start);
+      },
+      nullptr,
+      // Collect the body, it's freed together with the request. A body too
+      // large is only flagged in the first byte (see AsyncRequest).
+      [](AsyncWebServerRequest *r, uint8_t *data, size_t length, size_t index,
+         size_t total) {
+        bool fits = total <= Constants::MAX_BODY_SIZE;
+        if (index == 0) {
+          r->_tempObject = calloc(fits ? total + 2 : 2, 1);
+          if (r->_tempObject != nullptr && !fits) {
+            static_cast<char *>(r->_tempObject)[0] = 1;
+          }
+        }
+        if (r->_tempObject != nullptr && fits) {
+          memcpy(static_cast<char *>(r->_tempObject) + 1 + index, data,
+                 length);
+        }
+      });
+#else
+  _server.on(uri, HTTP_POST, [this, handler, route]() {
+    unsigned long start = micros();
+    SyncRequest request(_server);
+    (this->*handler)(request);
+    _metrics->recordRequest(route, micros() - start);
+  });
+#endif
 }
 
-void SpotlightServer::handleSetWheelMode() {
-  Serial.print("handleSetWheelMode() called: ");
-  float period = getFloatArg("period", 10.0);
-  String directionStr =
-      _server.hasArg("direction") ? _server.arg("direction") : "clockwise";
+void SpotlightServer::submit(HttpRequest &request, const uint8_t *data,
+                             size_t length) {
+  LATENCY_RECEIVED();
+  // Both servers take the same requests: valid commands, no more than the
+  // async server can queue.
+  size_t count = 0;
+  for (size_t offset = 0; offset < length; ++count) {
+    size_t size = Protocol::messageLength(data + offset, length - offset);
+    if (size == 0 || !Protocol::validate(data + offset, size)) {
+      LATENCY_DISCARD();
+      request.send(400, "text/plain", "Invalid command");
+      return;
+    }
+    offset += size;
+  }
+  if (count == 0) {
+    LATENCY_DISCARD();
+    request.send(400, "text/plain", "Invalid command");
+    return;
+  }
+  if (count > Constants::MAX_BATCH_COMMANDS) {
+    LATENCY_DISCARD();
+    request.send(413, "text/plain", "Too many commands");
+    return;
+  }
+#if SPOTLIGHT_ASYNC_SERVER
+  // Queue the commands one by one, but only if all of them fit. update()
+  // applies everything queued as one batch.
+  size_t used = (_commandQueueTail + Constants::COMMAND_QUEUE_LENGTH -
+                 _commandQueueHead) %
+                Constants::COMMAND_QUEUE_LENGTH;
+  // The queue is applied in one go, so a request that doesn't select its
+  // fixtures itself (a batch) mustn't inherit the selection of the one
+  // before it.
+  bool selectAll = data[0] != Protocol::SelectFixtures;
+  if (used + count + selectAll >= Constants::COMMAND_QUEUE_LENGTH) {
+    LATENCY_DISCARD();
+    request.send(503, "text/plain", "Busy");
+    return;
+  }
+  if (selectAll) {
+    Protocol::Message &message = _commandQueue[_commandQueueTail];
+    message.length = 0;
+    message.put8(Protocol::SelectFixtures).put16(Spotlight::ALL_FIXTURES);
+    _commandQueueTail =
+        (_commandQueueTail + 1) % Constants::COMMAND_QUEUE_LENGTH;
+  }
+  for (size_t offset = 0; offset < length;) {
+    Protocol::Message &message = _commandQueue[_commandQueueTail];
+    message.length = Protocol::messageLength(data + offset, length - offset);
+    memcpy(message.data, data + offset, message.length);
+    offset += message.length;
+    _commandQueueTail =
+        (_commandQueueTail + 1) % Constants::COMMAND_QUEUE_LENGTH;
+  }
+#else
+  if (!Protocol::applyBatch(*_spotlight, data, length)) {
+    LATENCY_DISCARD();
+    request.send(400, "text/plain", "Invalid command");
+    return;
+  }
+#endif
+  request.send(200, "text/plain", "OK");
+}
 
-  Serial.printf("period: %f, direction %s\n", period,
-                directionStr.c_str());
-  Spotlight::RotationDirection direction =
-      Spotlight::RotationDirection::Clockwise;
-  if (directionStr.equalsIgnoreCase("counterclockwise")) {
-    direction = Spotlight::RotationDirection::CounterClockwise;
+// --- API Endpoint Handlers ---
+
+void SpotlightServer::handleSetRGB(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetRGB);
+  uint8_t r = getIntArg(request, "r", 0);
+  uint8_t g = getIntArg(request, "g", 0);
+  uint8_t b = getIntArg(request, "b", 0);
+  LOG_DEBUG("rgb: %d, %d, %d", r, g, b);
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
   }
-  _spotlight->enableColorWheelMode(period, direction);
-  _server.send(200, "text/plain", "OK");
+  message.put8(Protocol::SetRGB).put8(r).put8(g).put8(b);
+  submit(request, message.data, message.length);
 }
 
-void SpotlightServer::handleSetCycleMode() {
-  Serial.print("handleSetCycleMode() called: ");
-  if (!_server.hasArg("colors")) {
-    _server.send(400, "text/plain", "Missing colors parameter");
+void SpotlightServer::handleSetKelvin(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetKelvin);
+  float kelvin = getFloatArg(request, "kelvin", 6500.0);
+  float brightness = getFloatArg(request, "brightness", 1.0);
+  LOG_DEBUG("kelvin: %f, brightness %f", kelvin, brightness);
+  kelvin = std::max(0.0f, std::min(65535.0f, kelvin));
+  brightness = std::max(0.0f, std::min(1.0f, brightness));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
     return;
   }
+  message.put8(Protocol::SetKelvin)
+      .put16(static_cast<uint16_t>(kelvin + 0.5f))
+      .put8(static_cast<uint8_t>(brightness * 255.0f + 0.5f));
+  submit(request, message.data, message.length);
+}
 
-  String colorsStr = _server.arg("colors");
-  bool isRandom = _server.hasArg("random") &&
-                  _server.arg("random").equalsIgnoreCase("true");
+void SpotlightServer::handleSetWheelMode(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetWheelMode);
+  float period = getFloatArg(request, "period", 10.0);
+  const char *directionStr = request.arg("direction");
+  if (directionStr == nullptr) {
+    directionStr = "clockwise";
+  }
+  float spread = getFloatArg(request, "spread", 0.0);
+  LOG_DEBUG("wheel period: %f, direction %s, spread %f", period, directionStr,
+            spread);
+  bool counterClockwise = strcasecmp(directionStr, "counterclockwise") == 0;
+  spread = std::max(0.0f, std::min(1.0f, spread));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetWheelSpread)
+      .put16(static_cast<uint16_t>(spread * 65535.0f + 0.5f));
+  message.put8(Protocol::SetWheelMode)
+      .put32(toMillis(period))
+      .put8(counterClockwise ? 1 : 0);
+  submit(request, message.data, message.length);
+}
 
-  Serial.printf("colors: %s, isRandom %d\n", colorsStr.c_str(),
-      isRandom);
+void SpotlightServer::handleSetBreatheMode(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetEffectMode);
+  uint8_t r = getIntArg(request, "r", 255);
+  uint8_t g = getIntArg(request, "g", 255);
+  uint8_t b = getIntArg(request, "b", 255);
+  float period = getFloatArg(request, "period", 4.0);
+  float minimum = getFloatArg(request, "minimum", 0.1);
+  LOG_DEBUG("breathe: %d, %d, %d, period %f, minimum %f", r, g, b, period,
+            minimum);
+  minimum = std::max(0.0f, std::min(1.0f, minimum));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetBreatheMode).put8(r).put8(g).put8(b);
+  message.put32(toMillis(period))
+      .put8(static_cast<uint8_t>(minimum * 255.0f + 0.5f));
+  submit(request, message.data, message.length);
+}
 
+void SpotlightServer::handleSetStrobeMode(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetEffectMode);
+  uint8_t r = getIntArg(request, "r", 255);
+  uint8_t g = getIntArg(request, "g", 255);
+  uint8_t b = getIntArg(request, "b", 255);
+  float period = getFloatArg(request, "period", 0.1);
+  float duty = getFloatArg(request, "duty", 0.5);
+  LOG_DEBUG("strobe: %d, %d, %d, period %f, duty %f", r, g, b, period, duty);
+  duty = std::max(0.0f, std::min(1.0f, duty));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetStrobeMode).put8(r).put8(g).put8(b);
+  message.put32(toMillis(period))
+      .put8(static_cast<uint8_t>(duty * 255.0f + 0.5f));
+  submit(request, message.data, message.length);
+}
 
-  ColorSpace::RGB colors[Constants::MAX_COLORS];
-  size_t count = 0;
+void SpotlightServer::handleSetCandleMode(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetEffectMode);
+  // A warm white flame by default.
+  uint8_t r = getIntArg(request, "r", 255);
+  uint8_t g = getIntArg(request, "g", 147);
+  uint8_t b = getIntArg(request, "b", 41);
+  float intensity = getFloatArg(request, "intensity", 0.5);
+  LOG_DEBUG("candle: %d, %d, %d, intensity %f", r, g, b, intensity);
+  intensity = std::max(0.0f, std::min(1.0f, intensity));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetCandleMode).put8(r).put8(g).put8(b);
+  message.put8(static_cast<uint8_t>(intensity * 255.0f + 0.5f));
+  submit(request, message.data, message.length);
+}
+
+void SpotlightServer::handleSetCycleMode(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetCycleMode);
+  const char *colorsStr = request.arg("colors");
+  if (colorsStr == nullptr) {
+    request.send(400, "text/plain", "Missing colors parameter");
+    return;
+  }
+
+  const char *randomStr = request.arg("random");
+  bool isRandom = randomStr != nullptr && strcasecmp(randomStr, "true") == 0;
+  LOG_DEBUG("cycle colors: %s, isRandom %d", colorsStr, isRandom);
 
   // Parse the comma-separated hex values
-  size_t lastIndex = 0;
-  int commaIndex = colorsStr.indexOf(',');
-  while (commaIndex >= 0 && count < Constants::MAX_COLORS) {
-    String hex = colorsStr.substring(lastIndex, commaIndex);
-    colors[count++] = ColorSpace::hexToRgb(hex);
-    lastIndex = commaIndex + 1;
-    commaIndex = colorsStr.indexOf(',', lastIndex);
+  ColorSpace::RGB colors[Constants::MAX_COLORS];
+  size_t count =
+      ColorSpace::hexListToRgb(colorsStr, colors, Constants::MAX_COLORS);
+
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetCycleMode).put8(isRandom ? 1 : 0).put8(count);
+  for (size_t i = 0; i < count; ++i) {
+    message.put8(colors[i].r).put8(colors[i].g).put8(colors[i].b);
+  }
+  submit(request, message.data, message.length);
+}
+
+void SpotlightServer::handleSetCycleDuration(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetCycleDuration);
+  float duration = getFloatArg(request, "duration", 2.0);
+  LOG_DEBUG("cycle duration: %f", duration);
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetCycleDuration).put32(toMillis(duration));
+  submit(request, message.data, message.length);
+}
+
+void SpotlightServer::handleSetCycleEasing(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetCycleEasing);
+  const char *easingStr = request.arg("easing");
+  if (easingStr == nullptr) {
+    easingStr = "linear";
+  }
+  LOG_DEBUG("cycle easing: %s", easingStr);
+  Easing::EasingFunction easing =
+      Easing::easingFromString(easingStr, strlen(easingStr));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetCycleEasing).put8(easing);
+  submit(request, message.data, message.length);
+}
+
+void SpotlightServer::handleSetTransitionDuration(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetTransitionDuration);
+  float duration = getFloatArg(request, "duration", 0.2);
+  LOG_DEBUG("transition duration: %f", duration);
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetTransitionDuration).put32(toMillis(duration));
+  submit(request, message.data, message.length);
+}
+
+void SpotlightServer::handleSetTransitionEasing(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetTransitionEasing);
+  const char *easingStr = request.arg("easing");
+  if (easingStr == nullptr) {
+    easingStr = "cubic-in-out";
+  }
+  LOG_DEBUG("transition easing: %s", easingStr);
+  Easing::EasingFunction easing =
+      Easing::easingFromString(easingStr, strlen(easingStr));
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::SetTransitionEasing).put8(easing);
+  submit(request, message.data, message.length);
+}
+
+void SpotlightServer::handleSetInterpolation(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetInterpolation);
+  const char *space = request.arg("space");
+  if (space == nullptr) {
+    space = "oklch";
+  }
+  LOG_DEBUG("interpolation: %s", space);
+  ColorSpace::Interpolation interpolation;
+  if (strcasecmp(space, "oklch") == 0) {
+    interpolation = ColorSpace::Interpolation::Oklch;
+  } else if (strcasecmp(space, "hsl") == 0) {
+    interpolation = ColorSpace::Interpolation::Hsl;
+  } else {
+    request.send(400, "text/plain", "Invalid space");
+    return;
   }
-  if (lastIndex < colorsStr.length() && count < Constants::MAX_COLORS) {
-    colors[count++] = ColorSpace::hexToRgb(colorsStr.substring(lastIndex));
+  // Applies to all fixtures, so the fixture argument isn't needed.
+  Protocol::Message message;
+  message.put8(Protocol::SetInterpolation).put8(
+      static_cast<uint8_t>(interpolation));
+  submit(request, message.data, message.length);
+}
+
+// Sets the brightness master, e.g. "/setBrightness?level=0.5".
+void SpotlightServer::handleSetBrightness(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetBrightness);
+  float level = getFloatArg(request, "level", 1.0);
+  LOG_DEBUG("brightness: %f", level);
+  level = std::max(0.0f, std::min(1.0f, level));
+  // Applies to all fixtures, so the fixture argument isn't needed.
+  Protocol::Message message;
+  message.put8(Protocol::SetBrightness)
+      .put16(static_cast<uint16_t>(level * 65535.0f + 0.5f));
+  submit(request, message.data, message.length);
+}
+
+// Sets the smoothing time constant of streamed colors, e.g.
+// "/setStreamSmoothing?duration=0.1".
+void SpotlightServer::handleSetStreamSmoothing(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleSetStreamSmoothing);
+  float duration = getFloatArg(request, "duration", 0.0);
+  LOG_DEBUG("stream smoothing: %f", duration);
+  // Applies to all fixtures, so the fixture argument isn't needed.
+  Protocol::Message message;
+  message.put8(Protocol::SetStreamSmoothing).put32(toMillis(duration));
+  submit(request, message.data, message.length);
+}
+
+bool SpotlightServer::readHexBody(HttpRequest &request, uint8_t *out,
+                                  size_t size, size_t &length) {
+  const char *body = request.body();
+  length = 0;
+  if (request.isBodyTooLarge()) {
+    request.send(413, "text/plain", "Body too large");
+    return false;
+  }
+  int high = -1;
+  for (const char *cursor = body; *cursor != '\0'; ++cursor) {
+    char c = *cursor;
+    int nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else if (isspace(c)) {
+      continue;
+    } else {
+      request.send(400, "text/plain", "Invalid hex");
+      return false;
+    }
+    if (high < 0) {
+      high = nibble;
+    } else if (length < size) {
+      out[length++] = (high << 4) | nibble;
+      high = -1;
+    } else {
+      request.send(413, "text/plain", "Body too large");
+      return false;
+    }
+  }
+  if (high >= 0) {
+    request.send(400, "text/plain", "Invalid hex");
+    return false;
   }
+  return true;
+}
+
+// Applies several commands at once. The body is the batch in the binary
+// protocol, hex encoded (e.g. "0105000007d0" for a 2 s cycle duration).
+void SpotlightServer::handleBatch(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleBatch);
+  LOG_DEBUG("batch: %s", request.body());
 
-  _spotlight->enableColorCycleMode(colors, count, isRandom);
-  _server.send(200, "text/plain", "OK");
+  uint8_t batch[Constants::MAX_BATCH_SIZE];
+  size_t length;
+  if (!readHexBody(request, batch, sizeof(batch), length)) {
+    return;
+  }
+  submit(request, batch, length);
 }
 
-void SpotlightServer::handleSetCycleDuration() {
-  Serial.print("handleSetCycleDuration() called: ");
-  float duration = getFloatArg("duration", 2.0);
-  Serial.printf("duration: %f\n", duration);
-  _spotlight->setCycleDuration(duration);
-  _server.send(200, "text/plain", "OK");
+// Stores a keyframe scene, e.g. "/scene?slot=0". The body is the scene in
+// the binary format of Scene.h, hex encoded.
+void SpotlightServer::handleUploadScene(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleUploadScene);
+  int slot = getIntArg(request, "slot", -1);
+  LOG_DEBUG("scene upload: slot %d", slot);
+  if (slot < 0 || slot >= static_cast<int>(Constants::MAX_SCENES)) {
+    request.send(400, "text/plain", "Invalid slot");
+    return;
+  }
+
+  uint8_t scene[Constants::MAX_SCENE_SIZE];
+  size_t length;
+  if (!readHexBody(request, scene, sizeof(scene), length)) {
+    return;
+  }
+  if (!Scene::validate(scene, length)) {
+    request.send(400, "text/plain", "Invalid scene");
+    return;
+  }
+  if (!Scene::save(slot, scene, length)) {
+    LOG_ERROR("Failed to store scene %d", slot);
+    request.send(500, "text/plain", "Failed to store scene");
+    return;
+  }
+  request.send(200, "text/plain", "OK");
 }
 
-void SpotlightServer::handleSetCycleEasing() {
-  Serial.print("handleSetCycleEasing() called: ");
-  String easingStr =
-      _server.hasArg("easing") ? _server.arg("easing") : "linear";
-  Serial.printf("easing: %s\n", easingStr.c_str());
-  Easing::EasingFunction easing = Easing::easingFromString(easingStr);
-  _spotlight->setCycleEasing(easing);
-  _server.send(200, "text/plain", "OK");
+// Plays a stored scene, e.g. "/playScene?slot=0&fixture=1,2".
+void SpotlightServer::handlePlayScene(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandlePlayScene);
+  int slot = getIntArg(request, "slot", 0);
+  LOG_DEBUG("play scene: slot %d", slot);
+  if (slot < 0 || slot >= static_cast<int>(Constants::MAX_SCENES)) {
+    request.send(400, "text/plain", "Invalid slot");
+    return;
+  }
+  if (!Scene::exists(slot)) {
+    request.send(404, "text/plain", "No scene in slot");
+    return;
+  }
+  Protocol::Message message;
+  if (!beginMessage(request, message)) {
+    return;
+  }
+  message.put8(Protocol::PlayScene).put8(slot);
+  submit(request, message.data, message.length);
 }
 
-void SpotlightServer::handleSetTransitionDuration() {
-  Serial.print("handleSetTransitionDuration() called: ");
-  float duration = getFloatArg("duration", 0.2);
-  Serial.printf("duration: %f\n", duration);
-  _spotlight->setTransitionDuration(duration);
-  _server.send(200, "text/plain", "OK");
+// Serves the shared clock, so a controller can schedule a start time.
+void SpotlightServer::handleTime(HttpRequest &request) {
+  char buffer[12];
+  snprintf(buffer, sizeof(buffer), "%lu", _spotlight->getTime());
+  request.send(200, "text/plain", buffer);
 }
 
-void SpotlightServer::handleSetTransitionEasing() {
-  Serial.print("handleSetTransitionEasing() called: ");
-  String easingStr =
-      _server.hasArg("easing") ? _server.arg("easing") : "cubic-in-out";
-  Serial.printf("easing: %s\n", easingStr.c_str());
-  Easing::EasingFunction easing = Easing::easingFromString(easingStr);
-  _spotlight->setTransitionEasing(easing);
-  _server.send(200, "text/plain", "OK");
+// Serves the telemetry as compact JSON, rendered into a static buffer.
+void SpotlightServer::handleMetrics(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleMetrics);
+  static char buffer[Constants::METRICS_BUFFER_SIZE];
+  if (_metrics->toJson(buffer, sizeof(buffer)) == 0) {
+    request.send(500, "text/plain", "Metrics buffer too small");
+    return;
+  }
+  request.send(200, "application/json", buffer);
 }
 
-// Private helper to serve files from LittleFS
-bool SpotlightServer::handleFileRequest(const String &path) {
-  Serial.print("handleFileRequest called for path: ");
-  Serial.println(path);
+// Serves the cached state. Pollers send the entity tag back and get a 304
+// until a setter ran, which costs no rendering either.
+void SpotlightServer::handleState(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleState);
+  const char *json = _snapshot.json();
+  if (json[0] == '\0') {
+    request.send(500, "text/plain", "State buffer too small");
+    return;
+  }
+  const char *match = request.header("If-None-Match");
+  if (match != nullptr && strcmp(match, _snapshot.etag()) == 0) {
+    request.sendNotModified(_snapshot.etag());
+    return;
+  }
+  request.sendTagged("application/json", json, _snapshot.etag());
+}
 
-  String fullPath = path;
-  if (fullPath.endsWith("/")) {
-    fullPath += "index.html"; // Serve index.html for root requests
+// Selects the log level at runtime, e.g. "/setLogLevel?level=debug".
+void SpotlightServer::handleSetLogLevel(HttpRequest &request) {
+  const char *levelStr = request.arg("level");
+  Log::Level level;
+  if (levelStr == nullptr || !Log::levelFromString(levelStr, level)) {
+    request.send(400, "text/plain", "Invalid level");
+    return;
   }
+  Log::setLevel(level);
+  request.send(200, "text/plain", "OK");
+}
 
-  Serial.print("Checking for file at fullPath: ");
-  Serial.println(fullPath);
+#if SPOTLIGHT_LATENCY
+// Serves the command latency percentiles (see Latency.h), only in latency
+// benchmark builds.
+void SpotlightServer::handleLatency(HttpRequest &request) {
+  static char buffer[Constants::LATENCY_BUFFER_SIZE];
+  if (Latency::toJson(buffer, sizeof(buffer)) == 0) {
+    request.send(500, "text/plain", "Latency buffer too small");
+    return;
+  }
+  request.send(200, "application/json", buffer);
+}
 
-  // Check if the file exists and has a content type
-  String contentType = getContentType(fullPath);
-  if (LittleFS.exists(fullPath)) {
-    Serial.println("File exists!");
-    File file = LittleFS.open(fullPath, "r");
-    if (!file) {
-      Serial.println("Failed to open file for reading.");
-      return false;
+void SpotlightServer::handleResetLatency(HttpRequest &request) {
+  Latency::reset();
+  request.send(200, "text/plain", "OK");
+}
+#endif
+
+#if SPOTLIGHT_TRACE
+// Dumps the trace histograms (see Trace.h), only in tracing builds.
+void SpotlightServer::handleTrace(HttpRequest &request) {
+  static char buffer[Constants::TRACE_BUFFER_SIZE];
+  Trace::dump(buffer, sizeof(buffer));
+  request.send(200, "text/plain", buffer);
+}
+#endif
+
+// --- WebSocket Control Channel ---
+
+void SpotlightServer::handleWebSocketEvent(uint8_t num, WStype_t type,
+                                           uint8_t *payload, size_t length) {
+  TRACE_SCOPE(Trace::HandleWebSocket);
+  uint8_t reply[4];
+  switch (type) {
+  case WStype_CONNECTED:
+    // Let the new client know what the light currently shows.
+    _webSocket.sendBIN(
+        num, reply, Protocol::encodeColor(_spotlight->getColor(), reply));
+    break;
+  case WStype_BIN:
+    LATENCY_RECEIVED();
+    if (!Protocol::applyBatch(*_spotlight, payload, length)) {
+      LATENCY_DISCARD();
+      uint8_t opcode = length > 0 ? payload[0] : 0;
+      _webSocket.sendBIN(num, reply, Protocol::encodeError(opcode, reply));
     }
-    _server.streamFile(file, contentType);
-    file.close();
-    Serial.println("File served successfully.");
+    break;
+  default:
+    break;
+  }
+}
+
+// Broadcasts the shown color whenever it changed, at most every
+// STATE_PUSH_INTERVAL milliseconds.
+void SpotlightServer::pushState() {
+  unsigned long now = millis();
+  if (now - _lastPushTime < Constants::STATE_PUSH_INTERVAL) {
+    return;
+  }
+  ColorSpace::RGB color = _spotlight->getColor();
+  if (color == _pushedColor || _webSocket.connectedClients() == 0) {
+    return;
+  }
+  uint8_t message[4];
+  _webSocket.broadcastBIN(message, Protocol::encodeColor(color, message));
+  _pushedColor = color;
+  _lastPushTime = now;
+}
+
+// --- Server-sent events ---
+// Dashboards watching the light keep an EventSource on /events instead of
+// polling /state. Each change is sent as a "state" event with the snapshot
+// as its data and the revision as its id.
+
+void SpotlightServer::beginEvents() {
+#if SPOTLIGHT_ASYNC_SERVER
+  // Runs in the TCP callbacks like the handlers, so the snapshot is read
+  // between two updates.
+  _events.onConnect([this](AsyncEventSourceClient *client) {
+    if (_events.count() > Constants::MAX_EVENT_CLIENTS) {
+      client->close();
+      return;
+    }
+    const char *json = _snapshot.json();
+    if (json[0] != '\0') {
+      client->send(json, "state", _snapshot.revision());
+    }
+  });
+  _server.addHandler(&_events);
+#else
+  _server.on("/events", HTTP_GET, [this]() { openEventStream(); });
+#endif
+}
+
+#if !SPOTLIGHT_ASYNC_SERVER
+namespace {
+const char *const EVENT_STREAM_HEADER = "HTTP/1.1 200 OK\r\n"
+                                        "Content-Type: text/event-stream\r\n"
+                                        "Cache-Control: no-cache\r\n"
+                                        "Connection: keep-alive\r\n\r\n";
+const char *const EVENT_END = "\n\n";
+} // namespace
+
+// Takes the connection over from the web server.
+void SpotlightServer::openEventStream() {
+  EventStream *stream = nullptr;
+  for (EventStream &candidate : _eventStreams) {
+    if (!candidate.client.connected()) {
+      stream = &candidate;
+      break;
+    }
+  }
+  if (stream == nullptr) {
+    _server.send(503, "text/plain", "Too many event clients");
+    return;
+  }
+  stream->client = _server.client();
+  // Without its client the server doesn't wait for this connection to
+  // close, and goes on with the next request right away.
+  _server.client() = WiFiClient();
+  startEvent(*stream, EVENT_STREAM_HEADER, true);
+  if (!continueEvent(*stream)) {
+    stream->client.stop();
+    stream->busy = false;
+  }
+  if (stream->busy) {
+    _snapshot.hold(true);
+  }
+}
+
+// Starts sending an event, the state if withState or a comment otherwise.
+// pushEvents() holds the snapshot until all clients have their event.
+void SpotlightServer::startEvent(EventStream &stream, const char *preamble,
+                                 bool withState) {
+  stream.preamble = preamble;
+  stream.withState = withState && _snapshot.json()[0] != '\0';
+  int length =
+      stream.withState
+          ? snprintf(stream.fields, sizeof(stream.fields),
+                     "event: state\nid: %u\ndata: ",
+                     static_cast<unsigned>(_snapshot.revision()))
+          : snprintf(stream.fields, sizeof(stream.fields), ":\n\n");
+  // Clamped to what was written, should the id ever not fit.
+  stream.fieldsLength = static_cast<uint8_t>(
+      std::min<size_t>(std::max(length, 0), sizeof(stream.fields) - 1));
+  stream.sent = 0;
+  stream.busy = true;
+  stream.started = millis();
+}
+
+// Writes as much of the event as the client takes without blocking. Returns
+// false if the client should be dropped.
+bool SpotlightServer::continueEvent(EventStream &stream) {
+  const char *json = stream.withState ? _snapshot.json() : "";
+  const char *parts[] = {stream.preamble != nullptr ? stream.preamble : "",
+                         stream.fields, json,
+                         stream.withState ? EVENT_END : ""};
+  const size_t lengths[] = {strlen(parts[0]), stream.fieldsLength,
+                            strlen(json), strlen(parts[3])};
+  size_t offset = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    if (stream.sent < offset + lengths[i]) {
+      size_t skip = stream.sent - offset;
+      size_t count = std::min<size_t>(lengths[i] - skip,
+                                      stream.client.availableForWrite());
+      size_t written =
+          count > 0 ? stream.client.write(parts[i] + skip, count) : 0;
+      stream.sent += written;
+      if (written < lengths[i] - skip) {
+        break; // Full, go on in the next loop.
+      }
+    }
+    offset += lengths[i];
+  }
+  if (offset == lengths[0] + lengths[1] + lengths[2] + lengths[3]) {
+    stream.busy = false;
     return true;
   }
+  return stream.client.connected() &&
+         millis() - stream.started < Constants::EVENT_SEND_TIMEOUT;
+}
+#endif
 
-  Serial.println("File does NOT exist.");
-  return false;
+// Sends the state to the event clients after a setter ran, at most every
+// STATE_PUSH_INTERVAL milliseconds, so a burst of changes is one event.
+void SpotlightServer::pushEvents() {
+  unsigned long now = millis();
+#if SPOTLIGHT_ASYNC_SERVER
+  if (now - _lastEventTime < Constants::STATE_PUSH_INTERVAL) {
+    return;
+  }
+  bool changed = _spotlight->getRevision() != _eventRevision;
+  if (changed && _events.count() > 0) {
+    const char *json = _snapshot.json();
+    if (json[0] != '\0') {
+      _events.send(json, "state", _snapshot.revision());
+    }
+    _lastEventTime = now;
+  }
+#else
+  // Go on with the events not sent completely. The next one starts once all
+  // clients have theirs, so the snapshot stays the same meanwhile.
+  bool pending = false;
+  for (EventStream &stream : _eventStreams) {
+    if (stream.busy && !continueEvent(stream)) {
+      stream.client.stop();
+      stream.busy = false;
+    }
+    pending = pending || stream.busy;
+  }
+  _snapshot.hold(pending);
+  if (pending || now - _lastEventTime < Constants::STATE_PUSH_INTERVAL) {
+    return;
+  }
+  bool changed = _spotlight->getRevision() != _eventRevision;
+  // Idle streams get a comment now and then, writing to a client that went
+  // away is what notices it.
+  bool keepAlive = now - _lastKeepAlive >= Constants::EVENT_KEEPALIVE_INTERVAL;
+  if (!changed && !keepAlive) {
+    return;
+  }
+  for (EventStream &stream : _eventStreams) {
+    if (!stream.client.connected()) {
+      continue;
+    }
+    startEvent(stream, nullptr, changed);
+    if (!continueEvent(stream)) {
+      stream.client.stop();
+      stream.busy = false;
+    }
+    pending = pending || stream.busy;
+  }
+  _snapshot.hold(pending);
+  _lastKeepAlive = now;
+  _lastEventTime = now;
+#endif
+  // Without clients nothing is rendered, the next one gets the state when
+  // it connects.
+  _eventRevision = _spotlight->getRevision();
+}
+
+// Private helper to serve files from LittleFS. Prefers the gzipped copy made
+// by scripts/compress_data.py and answers revalidations with a 304.
+bool SpotlightServer::handleFileRequest(HttpRequest &request) {
+  TRACE_SCOPE(Trace::HandleFileRequest);
+  // The path is assembled in a fixed buffer (see MAX_PATH_LENGTH).
+  char path[Constants::MAX_PATH_LENGTH];
+  const char *uri = request.uri();
+  const char *index = endsWith(uri, "/") ? "index.html" : "";
+  int pathLength = snprintf(path, sizeof(path), "%s%s.gz", uri, index);
+  if (pathLength < 0 || static_cast<size_t>(pathLength) >= sizeof(path)) {
+    return false;
+  }
+
+  // All browsers accept gzip, so there's no uncompressed fallback for
+  // clients that don't.
+  bool gzipped = LittleFS.exists(path);
+  path[pathLength - 3] = '\0'; // Strip the ".gz" again.
+  const char *contentType = getContentType(path);
+  if (gzipped) {
+    path[pathLength - 3] = '.';
+  } else if (!LittleFS.exists(path)) {
+    LOG_DEBUG("File not found: %s", path);
+    return false;
+  }
+
+  const char *etag = getEtag(path);
+  const char *ifNoneMatch = request.header("If-None-Match");
+  if (etag[0] != '\0' && ifNoneMatch != nullptr &&
+      strcmp(ifNoneMatch, etag) == 0) {
+    request.sendNotModified(etag);
+    return true;
+  }
+  if (!request.sendFile(path, contentType, gzipped, etag)) {
+    LOG_WARNING("Failed to open file for reading: %s", path);
+    return false;
+  }
+  LOG_DEBUG("Served %s", path);
+  return true;
+}
+
+// Private helper to get the entity tag of a file, a CRC32 of its content.
+// Returns an empty string if the file can't be read.
+const char *SpotlightServer::getEtag(const char *path) {
+  for (const CachedEtag &cached : _etags) {
+    if (strcmp(cached.path, path) == 0) {
+      return cached.etag;
+    }
+  }
+
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return "";
+  }
+  uint8_t buffer[256];
+  uint32_t crc = 0xFFFFFFFF;
+  size_t length;
+  while ((length = file.read(buffer, sizeof(buffer))) > 0) {
+    crc = crc32(buffer, length, crc);
+  }
+  file.close();
+
+  CachedEtag &cached = _etags[_nextEtag];
+  _nextEtag = (_nextEtag + 1) % Constants::ETAG_CACHE_ENTRIES;
+  strlcpy(cached.path, path, sizeof(cached.path));
+  snprintf(cached.etag, sizeof(cached.etag), "\"%08x\"",
+           static_cast<unsigned>(crc));
+  return cached.etag;
 }
 
 // Private helper to get content type from file extension
-String SpotlightServer::getContentType(const String &filename) {
-  if (filename.endsWith(".html"))
+const char *SpotlightServer::getContentType(const char *filename) {
+  if (endsWith(filename, ".html"))
     return "text/html";
-  if (filename.endsWith(".css"))
+  if (endsWith(filename, ".css"))
     return "text/css";
-  if (filename.endsWith(".js"))
+  if (endsWith(filename, ".js"))
     return "application/javascript";
-  if (filename.endsWith(".json"))
+  if (endsWith(filename, ".json"))
     return "application/json";
-  if (filename.endsWith(".png"))
+  if (endsWith(filename, ".png"))
     return "image/png";
-  if (filename.endsWith(".jpg"))
+  if (endsWith(filename, ".jpg"))
     return "image/jpeg";
-  if (filename.endsWith(".gif"))
+  if (endsWith(filename, ".gif"))
     return "image/gif";
   return "text/plain";
 }
 
 // Constructor
-SpotlightServer::SpotlightServer(Spotlight *spotlightInstance)
-    : _server(80), _spotlight(spotlightInstance) {}
+SpotlightServer::SpotlightServer(Spotlight *spotlightInstance,
+                                 Metrics *metrics)
+    : _server(80),
+#if SPOTLIGHT_ASYNC_SERVER
+      _commandQueueHead(0), _commandQueueTail(0),
+#endif
+      _webSocket(Constants::WEBSOCKET_PORT), _spotlight(spotlightInstance),
+      _metrics(metrics), _snapshot(spotlightInstance),
+      _networkState(NetworkState::Connecting), _fastConnect(false),
+      _connectStart(0), _mdnsStarted(false), _etags{}, _nextEtag(0),
+      _pushedColor{0, 0, 0}, _lastPushTime(0),
+#if SPOTLIGHT_ASYNC_SERVER
+      _events("/events"),
+#else
+      _eventStreams{}, _lastKeepAlive(0),
+#endif
+      _eventRevision(0), _lastEventTime(0) {}
 
-// Initializes the pins and sets up WiFi and WebServer
+// Sets up the WebServer and starts connecting to WiFi
 void SpotlightServer::begin() {
-  Serial.begin(115200);
-
-  // Initialize the file system first
+  // The file system holds the web files and the WiFi cache.
   if (!LittleFS.begin()) {
-    Serial.println("An Error has occurred while mounting LittleFS");
+    LOG_ERROR("An Error has occurred while mounting LittleFS");
     return;
   }
-  // List all files on the file system for debugging purposes
-  listDir("/", 0);
 
-  // Connect to WiFi
-  Serial.print("Connecting to ");
-  Serial.println(WIFI_SSID);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  Serial.println("");
-  Serial.println("WiFi connected!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
+  startWifi();
 
-  // Initialize mDNS to resolve the hostname "spotlight.local"
-  if (MDNS.begin("spotlight")) {
-    Serial.println("mDNS responder started");
-  } else {
-    Serial.println("Error setting up mDNS responder!");
-  }
-  MDNS.addService("http", "tcp", 80);
-
-  // Register API endpoints. The std::bind() is used to pass the member
-  // function and the 'this' pointer to the server.
-  _server.on("/rgb", HTTP_GET, std::bind(&SpotlightServer::handleSetRGB, this));
-  _server.on("/kelvin", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetKelvin, this));
-  _server.on("/wheel", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetWheelMode, this));
-  _server.on("/cycle", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetCycleMode, this));
-  _server.on("/setCycleDuration", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetCycleDuration, this));
-  _server.on("/setCycleEasing", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetCycleEasing, this));
-  _server.on("/setTransitionDuration", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetTransitionDuration, this));
-  _server.on("/setTransitionEasing", HTTP_GET,
-             std::bind(&SpotlightServer::handleSetTransitionEasing, this));
+  // Register API endpoints.
+  on("/rgb", &SpotlightServer::handleSetRGB);
+  on("/kelvin", &SpotlightServer::handleSetKelvin);
+  on("/wheel", &SpotlightServer::handleSetWheelMode);
+  on("/breathe", &SpotlightServer::handleSetBreatheMode);
+  on("/strobe", &SpotlightServer::handleSetStrobeMode);
+  on("/candle", &SpotlightServer::handleSetCandleMode);
+  on("/cycle", &SpotlightServer::handleSetCycleMode);
+  on("/setCycleDuration", &SpotlightServer::handleSetCycleDuration);
+  on("/setCycleEasing", &SpotlightServer::handleSetCycleEasing);
+  on("/setTransitionDuration", &SpotlightServer::handleSetTransitionDuration);
+  on("/setTransitionEasing", &SpotlightServer::handleSetTransitionEasing);
+  on("/setInterpolation", &SpotlightServer::handleSetInterpolation);
+  on("/setBrightness", &SpotlightServer::handleSetBrightness);
+  on("/setStreamSmoothing", &SpotlightServer::handleSetStreamSmoothing);
+  onPost("/batch", &SpotlightServer::handleBatch);
+  onPost("/scene", &SpotlightServer::handleUploadScene);
+  on("/playScene", &SpotlightServer::handlePlayScene);
+  on("/time", &SpotlightServer::handleTime);
+  on("/metrics", &SpotlightServer::handleMetrics);
+  on("/state", &SpotlightServer::handleState);
+  on("/setLogLevel", &SpotlightServer::handleSetLogLevel);
+#if SPOTLIGHT_TRACE
+  on("/trace", &SpotlightServer::handleTrace);
+#endif
+#if SPOTLIGHT_LATENCY
+  on("/latency", &SpotlightServer::handleLatency);
+  on("/resetLatency", &SpotlightServer::handleResetLatency);
+#endif
+  beginEvents();
 
   // catch-all handler for all GET requests to serve files from LittleFS
-  _server.onNotFound([this]() {
-    if (!handleFileRequest(_server.uri())) {
-      _server.send(404, "text/plain", "404: Not Found");
+  int fileRoute = _metrics->addRoute("files");
+#if SPOTLIGHT_ASYNC_SERVER
+  _server.onNotFound([this, fileRoute](AsyncWebServerRequest *r) {
+    unsigned long start = micros();
+    AsyncRequest request(r);
+#else
+  const char *collectedHeaders[] = {"If-None-Match"};
+  _server.collectHeaders(collectedHeaders, 1);
+  _server.onNotFound([this, fileRoute]() {
+    unsigned long start = micros();
+    SyncRequest request(_server);
+#endif
+    if (!handleFileRequest(request)) {
+      request.send(404, "text/plain", "404: Not Found");
     }
+    _metrics->recordRequest(fileRoute, micros() - start);
   });
 
   _server.begin();
-  Serial.println("Web server started!");
+  LOG_INFO("Web server started!");
+
+  // Persistent control channel, so the UI doesn't need a HTTP request per
+  // change.
+  _webSocket.begin();
+  _webSocket.onEvent(
+      [this](uint8_t num, WStype_t type, uint8_t *payload, size_t length) {
+        handleWebSocketEvent(num, type, payload, length);
+      });
 }
 
-// Main update method.
-void SpotlightServer::update() {
-  // Handle incoming client requests
-  _server.handleClient();
-  MDNS.update();
+// Starts connecting without waiting for the connection, updateNetwork()
+// follows it up.
+void SpotlightServer::startWifi() {
+  // The credentials come from config.h, there's no need to write them to
+  // flash on every boot.
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  // The radio sleeps between beacons of the access point while the loop is
+  // idle. Light sleep would also stop the timer the PWM outputs run on.
+  WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+#ifdef WIFI_STATIC_IP
+  // Skips DHCP.
+  WiFi.config(IPAddress(WIFI_STATIC_IP), IPAddress(WIFI_GATEWAY),
+              IPAddress(WIFI_SUBNET), IPAddress(WIFI_GATEWAY));
+#endif
+
+  LOG_INFO("Connecting to %s", WIFI_SSID);
+  WifiCache cache;
+  _fastConnect = loadWifiCache(cache);
+  if (_fastConnect) {
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD, cache.channel, cache.bssid);
+  } else {
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  }
+  _networkState = NetworkState::Connecting;
+  _connectStart = millis();
 }
 
-void SpotlightServer::listDir(const char *dirname, uint8_t numTabs) {
-  Serial.printf("Listing directory: %s\n", dirname);
+// Follows the WiFi connection.
+void SpotlightServer::updateNetwork() {
+  bool connected = WiFi.status() == WL_CONNECTED;
+  switch (_networkState) {
+  case NetworkState::Connecting:
+    if (connected) {
+      onConnected();
+    } else if (_fastConnect && millis() - _connectStart >=
+                                   Constants::WIFI_FAST_CONNECT_TIMEOUT) {
+      // The access point moved or changed its channel, scan for it.
+      LOG_WARNING("Fast connect failed, scanning for %s", WIFI_SSID);
+      _fastConnect = false;
+      WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    }
+    break;
+  case NetworkState::Online:
+    if (!connected) {
+      // Auto reconnect is retrying in the background.
+      LOG_WARNING("WiFi connection lost");
+      _networkState = NetworkState::Connecting;
+      _fastConnect = false;
+    } else {
+      MDNS.update();
+    }
+    break;
+  }
+}
 
-  Dir root = LittleFS.openDir(dirname);
+// Announces the spotlight once the connection is up.
+void SpotlightServer::onConnected() {
+  LOG_INFO("WiFi connected after %lu ms! IP Address: %s",
+           millis() - _connectStart, WiFi.localIP().toString().c_str());
 
-  while (root.next()) {
-    File f = root.openFile("r");
-    for (uint8_t i = 0; i < numTabs; i++) {
-      Serial.print('\t');
+  WifiCache cache;
+  WifiCache current;
+  memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+  current.channel = static_cast<uint8_t>(WiFi.channel());
+  if (!loadWifiCache(cache) || memcmp(&cache, &current, sizeof(cache)) != 0) {
+    saveWifiCache(current);
+  }
+
+  // Initialize mDNS to resolve the hostname "spotlight.local". Only done on
+  // the first connection, the responder follows reconnects by itself.
+  if (!_mdnsStarted) {
+    if (MDNS.begin("spotlight")) {
+      LOG_INFO("mDNS responder started");
+      MDNS.addService("http", "tcp", 80);
+      MDNS.addService("ws", "tcp", Constants::WEBSOCKET_PORT);
+      MDNS.addService("spotlight", "udp", Constants::GROUP_PORT);
+      _mdnsStarted = true;
+    } else {
+      LOG_ERROR("Error setting up mDNS responder!");
     }
-    Serial.printf(" - %s, size: %u\n", f.name(), f.size());
-    f.close();
   }
+  _networkState = NetworkState::Online;
+}
+
+// Main update method.
+bool SpotlightServer::hasPendingRequest() {
+#if SPOTLIGHT_ASYNC_SERVER
+  return _commandQueueHead != _commandQueueTail;
+#else
+  return _server.client().available() > 0;
+#endif
+}
+
+void SpotlightServer::update() {
+  unsigned long start = micros();
+#if SPOTLIGHT_ASYNC_SERVER
+  // Apply the commands received since the last update. Each request queued
+  // its fixture selection first (see submit()).
+  if (_commandQueueHead != _commandQueueTail) {
+    _spotlight->beginBatch();
+    while (_commandQueueHead != _commandQueueTail) {
+      const Protocol::Message &message = _commandQueue[_commandQueueHead];
+      Protocol::apply(*_spotlight, message.data, message.length);
+      _commandQueueHead =
+          (_commandQueueHead + 1) % Constants::COMMAND_QUEUE_LENGTH;
+    }
+    _spotlight->selectFixtures(Spotlight::ALL_FIXTURES);
+    _spotlight->endBatch();
+  }
+#else
+  // Handle incoming client requests
+  _server.handleClient();
+#endif
+  _webSocket.loop();
+  _metrics->recordHandleClient(micros() - start);
+  pushState();
+  pushEvents();
+  updateNetwork();
 }
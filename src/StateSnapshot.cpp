@@ -0,0 +1,136 @@
+/**
+ * @file StateSnapshot.cpp
+ * @brief Implementation file for the JSON view of the light's state served
+ * at /state.
+ */
+
+#include "StateSnapshot.h"
+#include "JsonWriter.h"
+
+namespace {
+void appendColor(JsonWriter &json, const ColorSpace::RGB &rgb) {
+  json.append("\"color\":\"#%02x%02x%02x\",", rgb.r, rgb.g, rgb.b);
+}
+
+void appendColor(JsonWriter &json, const ColorSpace::RGB16 &color) {
+  appendColor(json, ColorSpace::fx::toRgb8(color));
+}
+
+// Writes the mode of a fixture and its parameters, in the units the
+// endpoints setting them take.
+struct EffectWriter {
+  JsonWriter &json;
+  ColorSpace::RGB shown;
+  ColorSpace::Interpolation interpolation;
+
+  void operator()(const Effects::Static &) const {
+    json.append("\"mode\":\"static\",");
+    appendColor(json, shown);
+  }
+
+  void operator()(const Effects::Fade &effect) const {
+    json.append("\"mode\":\"fade\",");
+    appendColor(json, ColorSpace::fx::lchToRgb(effect.end, interpolation));
+  }
+
+  void operator()(const Effects::Wheel &effect) const {
+    json.append("\"mode\":\"wheel\",\"periodMs\":%lu,\"direction\":\"%s\",",
+                effect.period,
+                effect.counterClockwise ? "counterclockwise" : "clockwise");
+  }
+
+  void operator()(const Effects::Cycle &) const {
+    json.append("\"mode\":\"cycle\",");
+  }
+
+  void operator()(const Effects::Playback &) const {
+    json.append("\"mode\":\"scene\",");
+  }
+
+  void operator()(const Effects::Breathe &effect) const {
+    json.append("\"mode\":\"breathe\",");
+    appendColor(json, effect.color);
+    json.append("\"periodMs\":%lu,\"minimum\":%.3f,", effect.period,
+                effect.minimum / 255.0f);
+  }
+
+  void operator()(const Effects::Strobe &effect) const {
+    json.append("\"mode\":\"strobe\",");
+    appendColor(json, effect.color);
+    json.append("\"periodMs\":%lu,\"duty\":%.3f,", effect.period,
+                (effect.duty + 1) / 256.0f);
+  }
+
+  void operator()(const Effects::Candle &effect) const {
+    json.append("\"mode\":\"candle\",");
+    appendColor(json, effect.color);
+    json.append("\"intensity\":%.3f,", effect.intensity / 255.0f);
+  }
+};
+} // namespace
+
+// Constructor
+StateSnapshot::StateSnapshot(Spotlight *spotlight)
+    : _spotlight(spotlight), _built(false), _held(false), _revision(0),
+      _bootId(static_cast<uint32_t>(random(0x7FFFFFFF))), _etag{}, _json{} {}
+
+const char *StateSnapshot::json() {
+  if (isStale()) {
+    build();
+  }
+  return _json;
+}
+
+uint32_t StateSnapshot::revision() const { return _revision; }
+
+const char *StateSnapshot::etag() const { return _etag; }
+
+bool StateSnapshot::isStale() const {
+  return !_built || (!_held && _revision != _spotlight->getRevision());
+}
+
+void StateSnapshot::hold(bool held) { _held = held; }
+
+void StateSnapshot::build() {
+  _revision = _spotlight->getRevision();
+  _built = true;
+  snprintf(_etag, sizeof(_etag), "\"%08x-%08x\"",
+           static_cast<unsigned>(_bootId), static_cast<unsigned>(_revision));
+
+  JsonWriter json(_json, sizeof(_json));
+  ColorSpace::Interpolation interpolation = _spotlight->getInterpolation();
+  json.append("{\"revision\":%u,\"interpolation\":\"%s\",\"scene\":%u,",
+              static_cast<unsigned>(_revision),
+              interpolation == ColorSpace::Interpolation::Oklch ? "oklch"
+                                                                : "hsl",
+              _spotlight->getSceneSlot());
+
+  ColorSpace::RGB colors[Constants::MAX_COLORS];
+  bool isRandom;
+  size_t colorCount = _spotlight->getPalette(colors, isRandom);
+  json.append("\"palette\":{\"random\":%s,\"colors\":[",
+              isRandom ? "true" : "false");
+  for (size_t i = 0; i < colorCount; ++i) {
+    json.append("%s\"#%02x%02x%02x\"", i > 0 ? "," : "", colors[i].r,
+                colors[i].g, colors[i].b);
+  }
+  json.append("]},\"fixtures\":[");
+
+  for (size_t f = 0; f < _spotlight->getFixtureCount(); ++f) {
+    json.append(f > 0 ? ",{" : "{");
+    _spotlight->getEffect(f).visit(
+        EffectWriter{json, _spotlight->getColor(f), interpolation});
+    const Effects::Settings &settings = _spotlight->getSettings(f);
+    json.append("\"transitionMs\":%lu,\"transitionEasing\":\"%s\","
+                "\"cycleMs\":%lu,\"cycleEasing\":\"%s\",\"spread\":%.3f}",
+                settings.fadeDuration, Easing::easingName(settings.fadeEasing),
+                settings.cycleDuration,
+                Easing::easingName(settings.cycleEasing),
+                settings.wheelSpread / 65535.0f);
+  }
+  json.append("]}");
+
+  if (json.length() == 0) {
+    _json[0] = '\0'; // Don't serve a truncated document.
+  }
+}
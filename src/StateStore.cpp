@@ -0,0 +1,313 @@
+/**
+ * @file StateStore.cpp
+ * @brief Implementation file for the persistence of the spotlight state.
+ */
+
+#include "StateStore.h"
+#include "Log.h"
+#include <LittleFS.h>
+#include <coredecls.h>
+#include <spi_flash.h>
+#include <algorithm>
+#include <cstddef>
+
+// End of the file system and start of the sector of the EEPROM library, from
+// the linker script.
+extern "C" uint32_t _FS_end;
+extern "C" uint32_t _EEPROM_start;
+
+namespace {
+const uint16_t RECORD_MAGIC = 0x5354;
+// Flash reads as all ones where nothing was programmed since the erase.
+const uint32_t ERASED_WORD = 0xFFFFFFFF;
+// Where the flash is mapped into the address space.
+const uint32_t FLASH_MAPPED_ADDRESS = 0x40200000;
+
+static_assert(Constants::STATE_LOG_SIZE == SPI_FLASH_SEC_SIZE,
+              "The state log is kept in flash sectors");
+
+size_t alignToWord(size_t length) { return (length + 3) & ~size_t(3); }
+
+uint32_t flashAddress(const uint32_t &symbol) {
+  return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&symbol)) -
+         FLASH_MAPPED_ADDRESS;
+}
+
+// The log takes the sectors from the end of the file system up to and
+// including the EEPROM sector. The core rounds the end of a file system
+// with 8 KB blocks down, which leaves a free sector before the EEPROM one.
+uint32_t firstSector() {
+  uint32_t end = flashAddress(_FS_end) / SPI_FLASH_SEC_SIZE;
+  return std::min(end, flashAddress(_EEPROM_start) / SPI_FLASH_SEC_SIZE);
+}
+
+size_t sectorCount() {
+  return flashAddress(_EEPROM_start) / SPI_FLASH_SEC_SIZE - firstSector() + 1;
+}
+
+// The flash address of a sector of the log.
+uint32_t logAddress(size_t sector) {
+  return (firstSector() + sector) * SPI_FLASH_SEC_SIZE;
+}
+
+size_t nextSector(size_t sector) { return (sector + 1) % sectorCount(); }
+
+bool isErased(size_t sector) {
+  uint32_t words[16];
+  for (size_t offset = 0; offset < Constants::STATE_LOG_SIZE;
+       offset += sizeof(words)) {
+    if (!ESP.flashRead(logAddress(sector) + offset, words, sizeof(words))) {
+      return false;
+    }
+    for (uint32_t word : words) {
+      if (word != ERASED_WORD) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool eraseSector(size_t sector) {
+  return ESP.flashEraseSector(firstSector() + sector);
+}
+} // namespace
+
+// Constructor
+StateStore::StateStore(Spotlight *spotlight)
+    : _spotlight(spotlight), _sequence(0), _logSector(0), _logSize(0),
+      _nextErased(false), _seenRevision(0), _rtcRevision(0),
+      _savedRevision(0), _changeTime(0), _buffer{} {}
+
+bool StateStore::begin() {
+  // Restored scenes are played from LittleFS.
+  if (!LittleFS.begin()) {
+    LOG_ERROR("An Error has occurred while mounting LittleFS");
+  }
+  if (sectorCount() < 2) {
+    LOG_WARNING("The state log has one sector, a power loss while it is "
+                "erased loses the saved state");
+  }
+
+  // The RTC copy is newer after a reset, the log after a power loss.
+  bool rtc = readRtc();
+  uint32_t rtcSequence = header().sequence;
+  bool found;
+  if (readLog() && (!rtc || header().sequence > rtcSequence)) {
+    found = true;
+  } else {
+    found = rtc && readRtc(); // Reading the log overwrote the buffer.
+  }
+
+  bool restored = false;
+  if (found) {
+    _sequence = std::max(header().sequence, rtc ? rtcSequence : 0);
+    restored = _spotlight->restoreState(
+        reinterpret_cast<const uint8_t *>(_buffer) + sizeof(RecordHeader),
+        header().length);
+    if (!restored) {
+      LOG_WARNING("Ignoring the saved state, it doesn't match this firmware");
+    }
+  }
+  // The restore itself isn't a change to save.
+  _savedRevision = _spotlight->getRevision();
+  _rtcRevision = _savedRevision;
+  _seenRevision = _savedRevision;
+  return restored;
+}
+
+void StateStore::update() {
+  uint32_t revision = _spotlight->getRevision();
+  unsigned long now = millis();
+  if (revision != _seenRevision) {
+    _seenRevision = revision;
+    _changeTime = now;
+    return;
+  }
+
+  bool saveRtc = revision != _rtcRevision &&
+                 now - _changeTime >= Constants::STATE_RTC_SAVE_DELAY;
+  bool saveLog = revision != _savedRevision &&
+                 now - _changeTime >= Constants::STATE_SAVE_DELAY;
+  if (!saveRtc && !saveLog) {
+    return;
+  }
+  size_t length = encode();
+  if (length == 0) {
+    return; // Within a batch, try again on the next update().
+  }
+  if (saveRtc) {
+    // The record may not fit, the log keeps it in that case.
+    writeRtc(length);
+    _rtcRevision = revision;
+  }
+  if (saveLog) {
+    if (appendLog(length)) {
+      _savedRevision = revision;
+    } else {
+      LOG_ERROR("Failed to save the state");
+      _changeTime = now; // Retry after another delay.
+    }
+  }
+}
+
+StateStore::RecordHeader &StateStore::header() {
+  return *reinterpret_cast<RecordHeader *>(_buffer);
+}
+
+// Writes the current state into the buffer, returns the length of header and
+// record.
+size_t StateStore::encode() {
+  uint8_t *record = reinterpret_cast<uint8_t *>(_buffer) + sizeof(RecordHeader);
+  size_t length = _spotlight->saveState(record, Constants::MAX_STATE_SIZE);
+  if (length == 0) {
+    return 0;
+  }
+  RecordHeader &frame = header();
+  frame.magic = RECORD_MAGIC;
+  frame.length = static_cast<uint16_t>(length);
+  frame.sequence = ++_sequence;
+  frame.crc = crc32(record, length,
+                    crc32(&frame, offsetof(RecordHeader, crc)));
+  return sizeof(RecordHeader) + length;
+}
+
+// Checks the header and the record in the buffer. available is the number of
+// bytes that could be read into it.
+bool StateStore::isValid(size_t available) {
+  const RecordHeader &frame = header();
+  if (available < sizeof(RecordHeader) || frame.magic != RECORD_MAGIC ||
+      frame.length > Constants::MAX_STATE_SIZE ||
+      available < sizeof(RecordHeader) + frame.length) {
+    return false;
+  }
+  const uint8_t *record =
+      reinterpret_cast<const uint8_t *>(_buffer) + sizeof(RecordHeader);
+  return frame.crc == crc32(record, frame.length,
+                            crc32(&frame, offsetof(RecordHeader, crc)));
+}
+
+bool StateStore::readRtc() {
+  // The header tells how much of the record to read, RTC memory is slow.
+  if (!ESP.rtcUserMemoryRead(Constants::STATE_RTC_OFFSET, _buffer,
+                             sizeof(RecordHeader))) {
+    return false;
+  }
+  const RecordHeader &frame = header();
+  size_t size = alignToWord(sizeof(RecordHeader) + frame.length);
+  if (frame.magic != RECORD_MAGIC || size > Constants::STATE_RTC_SIZE ||
+      frame.length > Constants::MAX_STATE_SIZE) {
+    return false; // Not written since the power was lost.
+  }
+  return ESP.rtcUserMemoryRead(Constants::STATE_RTC_OFFSET, _buffer, size) &&
+         isValid(size);
+}
+
+bool StateStore::writeRtc(size_t length) {
+  size_t size = alignToWord(length);
+  return size <= Constants::STATE_RTC_SIZE &&
+         ESP.rtcUserMemoryWrite(Constants::STATE_RTC_OFFSET, _buffer, size);
+}
+
+// Reads the newest valid record of the log into the buffer, by the sequence
+// numbers of all sectors. Appending continues in its sector.
+bool StateStore::readLog() {
+  bool found = false;
+  uint32_t sequence = 0;
+  size_t offset = 0;
+  _logSector = 0;
+  for (size_t sector = 0; sector < sectorCount(); ++sector) {
+    size_t candidates[2];
+    scanSector(sector, candidates);
+    for (size_t candidate : candidates) {
+      if (candidate != SIZE_MAX && readLogRecord(sector, candidate)) {
+        if (!found || header().sequence > sequence) {
+          found = true;
+          sequence = header().sequence;
+          _logSector = sector;
+          offset = candidate;
+        }
+        break; // The previous record is older.
+      }
+    }
+  }
+  size_t candidates[2];
+  _logSize = scanSector(_logSector, candidates);
+  _nextErased = sectorCount() > 1 && isErased(nextSector(_logSector));
+  return found && readLogRecord(_logSector, offset);
+}
+
+// Follows the headers of a sector to its last two records, the newest first.
+// Only the last one can be torn, the one before it is complete then. Returns
+// where the next record can be appended.
+size_t StateStore::scanSector(size_t sector, size_t (&candidates)[2]) {
+  size_t offset = 0;
+  size_t newest = SIZE_MAX;
+  size_t previous = SIZE_MAX;
+  RecordHeader frame;
+  while (offset + sizeof(frame) <= Constants::STATE_LOG_SIZE &&
+         ESP.flashRead(logAddress(sector) + offset,
+                       reinterpret_cast<uint32_t *>(&frame), sizeof(frame)) &&
+         frame.magic == RECORD_MAGIC &&
+         frame.length <= Constants::MAX_STATE_SIZE &&
+         offset + alignToWord(sizeof(frame) + frame.length) <=
+             Constants::STATE_LOG_SIZE) {
+    previous = newest;
+    newest = offset;
+    offset += alignToWord(sizeof(frame) + frame.length);
+  }
+  candidates[0] = newest;
+  candidates[1] = previous;
+  // Records can only be appended to erased flash. Anything else after the
+  // last record, like a torn header, has the log move on with the next
+  // record.
+  uint32_t word = ERASED_WORD;
+  if (offset < Constants::STATE_LOG_SIZE) {
+    ESP.flashRead(logAddress(sector) + offset, &word, sizeof(word));
+  }
+  return word == ERASED_WORD ? offset : Constants::STATE_LOG_SIZE;
+}
+
+// Reads the record at an offset of a sector into the buffer, if it's valid.
+bool StateStore::readLogRecord(size_t sector, size_t offset) {
+  uint32_t address = logAddress(sector) + offset;
+  if (!ESP.flashRead(address, _buffer, sizeof(RecordHeader))) {
+    return false;
+  }
+  size_t size = alignToWord(sizeof(RecordHeader) + header().length);
+  return size <= sizeof(_buffer) && ESP.flashRead(address, _buffer, size) &&
+         isValid(size);
+}
+
+// Once a sector is full the log moves on to the next one. The newest record
+// stays in the full sector until it was written to the next, and the sector
+// after that is only erased then, ready for the next move.
+bool StateStore::appendLog(size_t length) {
+  // Flash is programmed in words, the padding after the record isn't read.
+  size_t size = alignToWord(length);
+  size_t sector = _logSector;
+  size_t offset = _logSize;
+  bool move = offset + size > Constants::STATE_LOG_SIZE;
+  if (move) {
+    sector = nextSector(_logSector);
+    offset = 0;
+    // The preparing erase was lost, e.g. to a reset. The full sector still
+    // has the newest record, except in a log of one sector.
+    if (!_nextErased && !eraseSector(sector)) {
+      return false;
+    }
+    _nextErased = false;
+  }
+  if (!ESP.flashWrite(logAddress(sector) + offset, _buffer, size)) {
+    if (sector == _logSector) {
+      _logSize = Constants::STATE_LOG_SIZE; // Move on with the next one.
+    }
+    return false;
+  }
+  _logSector = sector;
+  _logSize = offset + size;
+  if (move && sectorCount() > 1) {
+    _nextErased = eraseSector(nextSector(sector));
+  }
+  return true;
+}
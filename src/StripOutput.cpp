@@ -0,0 +1,75 @@
+/**
+ * @file StripOutput.cpp
+ * @brief Implementation file for the addressable LED strip output.
+ */
+
+#include "StripOutput.h"
+#include "Constants.h"
+#include <algorithm>
+
+namespace {
+// Rounds a duty of the output curves to the 8 bits of the strip. The curves
+// have 10 + FRACTION_BITS bits.
+uint8_t toByte(uint16_t duty) {
+  static_assert(Constants::PWM_RANGE == 1023,
+                "The strip colors assume 10-bit output curves");
+  const uint8_t shift = Gamma::FRACTION_BITS + 2;
+  uint32_t byte = (duty + (1u << (shift - 1))) >> shift;
+  return std::min<uint32_t>(byte, 255);
+}
+} // namespace
+
+StripOutput::StripOutput(uint16_t pixels)
+    : _strip(std::min<size_t>(pixels, Constants::MAX_PIXELS)),
+      _curves(nullptr), _dirty(false) {}
+
+void StripOutput::begin(const Gamma::Table *curves) {
+  _curves = curves;
+  _strip.Begin();
+  _strip.ClearTo(RgbColor(0));
+  _strip.Show();
+}
+
+size_t StripOutput::getPixelCount() const { return _strip.PixelCount(); }
+
+// The pixels are encoded into the strip's buffer, show() starts the DMA.
+void StripOutput::write(const ColorSpace::RGB16 *pixels) {
+  uint16_t count = _strip.PixelCount();
+  resetLoad();
+  for (uint16_t i = 0; i < count; ++i) {
+    const ColorSpace::RGB16 &pixel = pixels[i];
+    RgbColor color(toByte(scaleDuty(0, _curves[0].apply(pixel.r))),
+                   toByte(scaleDuty(1, _curves[1].apply(pixel.g))),
+                   toByte(scaleDuty(2, _curves[2].apply(pixel.b))));
+    if (_strip.GetPixelColor(i) != color) {
+      _strip.SetPixelColor(i, color);
+      _dirty = true;
+    }
+  }
+}
+
+// The curves are applied once, the load still adds up over the pixels.
+void StripOutput::fill(const ColorSpace::RGB16 &color) {
+  uint16_t count = _strip.PixelCount();
+  const uint16_t duties[3] = {_curves[0].apply(color.r),
+                              _curves[1].apply(color.g),
+                              _curves[2].apply(color.b)};
+  resetLoad();
+  for (uint16_t i = 0; i < count; ++i) {
+    RgbColor pixel(toByte(scaleDuty(0, duties[0])),
+                   toByte(scaleDuty(1, duties[1])),
+                   toByte(scaleDuty(2, duties[2])));
+    if (_strip.GetPixelColor(i) != pixel) {
+      _strip.SetPixelColor(i, pixel);
+      _dirty = true;
+    }
+  }
+}
+
+// Only sends frames that changed.
+void StripOutput::show() {
+  if (_dirty) {
+    _dirty = false;
+    _strip.Show();
+  }
+}
@@ -0,0 +1,172 @@
+/**
+ * @file Trace.cpp
+ * @brief Implementation file for the compile-time switchable hot path
+ * tracing.
+ */
+
+#include "Trace.h"
+
+#if SPOTLIGHT_TRACE
+
+namespace Trace {
+namespace {
+const char *const kPointNames[POINT_COUNT] = {
+    "update",
+    "renderFrame",
+    "writeLeds",
+    "kelvinToRgb",
+    "hsvToRgb",
+    "rgbToLch",
+    "lchToRgb",
+    "rgbToHsl",
+    "hslToRgb",
+    "rgbToHsv",
+    "fx::lchToRgb",
+    "fx::hslToRgb",
+    "fx::hsvToRgb",
+    "fx::interpolate",
+    "rgbToOklch",
+    "oklchToRgb",
+    "fx::oklchToRgb",
+    "getEasedValue",
+    "getEasedValueQ16",
+    "handleSetRGB",
+    "handleSetKelvin",
+    "handleSetWheelMode",
+    "handleSetEffectMode",
+    "handleSetCycleMode",
+    "handleSetCycleDuration",
+    "handleSetCycleEasing",
+    "handleSetTransitionDuration",
+    "handleSetTransitionEasing",
+    "handleSetInterpolation",
+    "handleSetBrightness",
+    "handleSetStreamSmoothing",
+    "handleBatch",
+    "handleUploadScene",
+    "handlePlayScene",
+    "handleMetrics",
+    "handleState",
+    "handleFileRequest",
+    "handleWebSocket",
+    "streamPacket",
+    "groupCommand",
+};
+
+struct Histogram {
+  uint32_t count;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+struct Sample {
+  Point point;
+  uint32_t cycles;
+};
+
+Histogram histograms[POINT_COUNT];
+Sample ring[RING_SIZE];
+size_t ringNext = 0;
+size_t ringCount = 0;
+
+// A Print writing into a fixed buffer, for the HTTP dump.
+class BufferPrint : public Print {
+public:
+  BufferPrint(char *buffer, size_t size)
+      : _buffer(buffer), _size(size), _length(0) {}
+
+  size_t write(uint8_t c) override {
+    if (_length + 1 >= _size) {
+      return 0;
+    }
+    _buffer[_length++] = c;
+    _buffer[_length] = '\0';
+    return 1;
+  }
+
+  size_t length() const { return _length; }
+
+private:
+  char *_buffer;
+  size_t _size;
+  size_t _length;
+};
+} // namespace
+
+void record(Point point, uint32_t cycles) {
+  Histogram &histogram = histograms[point];
+  histogram.count++;
+  histogram.totalCycles += cycles;
+  if (cycles > histogram.maxCycles) {
+    histogram.maxCycles = cycles;
+  }
+  size_t bucket = cycles == 0 ? 0 : 32 - __builtin_clz(cycles);
+  if (bucket >= HISTOGRAM_BUCKETS) {
+    bucket = HISTOGRAM_BUCKETS - 1;
+  }
+  histogram.buckets[bucket]++;
+
+  ring[ringNext] = {point, cycles};
+  ringNext = (ringNext + 1) % RING_SIZE;
+  if (ringCount < RING_SIZE) {
+    ringCount++;
+  }
+}
+
+void reset() {
+  memset(histograms, 0, sizeof(histograms));
+  ringNext = 0;
+  ringCount = 0;
+}
+
+void dump(Print &out) {
+  out.printf("# trace (%u MHz), point: count avg max | log2 buckets\n",
+             static_cast<unsigned>(ESP.getCpuFreqMHz()));
+  for (size_t i = 0; i < POINT_COUNT; ++i) {
+    const Histogram &histogram = histograms[i];
+    if (histogram.count == 0) {
+      continue;
+    }
+    out.printf("%s: %u %u %u |", kPointNames[i],
+               static_cast<unsigned>(histogram.count),
+               static_cast<unsigned>(histogram.totalCycles / histogram.count),
+               static_cast<unsigned>(histogram.maxCycles));
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+      out.printf(" %u", static_cast<unsigned>(histogram.buckets[b]));
+    }
+    out.print('\n');
+  }
+  out.print("# recent, oldest first\n");
+  for (size_t i = 0; i < ringCount; ++i) {
+    const Sample &sample =
+        ring[(ringNext + RING_SIZE - ringCount + i) % RING_SIZE];
+    out.printf("%s %u\n", kPointNames[sample.point],
+               static_cast<unsigned>(sample.cycles));
+  }
+}
+
+size_t dump(char *buffer, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  buffer[0] = '\0';
+  BufferPrint out(buffer, size);
+  dump(out);
+  return out.length();
+}
+
+void pollSerial() {
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == 't') {
+      dump(Serial);
+    } else if (c == 'r') {
+      reset();
+      Serial.println("trace reset");
+    }
+  }
+}
+} // namespace Trace
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file UdpStream.cpp
+ * @brief Implementation file for the real-time color stream over UDP.
+ */
+
+#include "UdpStream.h"
+#include "Constants.h"
+#include "Trace.h"
+
+namespace {
+const size_t HEADER_SIZE = 10;
+const size_t TIMECODE_SIZE = 4;
+const uint8_t FLAG_VERSION_MASK = 0xC0;
+const uint8_t FLAG_VERSION_1 = 0x40;
+const uint8_t FLAG_TIMECODE = 0x10;
+// Storage, reply and query packets carry no colors.
+const uint8_t FLAG_NOT_DATA = 0x08 | 0x04 | 0x02;
+const uint8_t TYPE_UNDEFINED = 0x00;
+const uint8_t TYPE_RGB8 = 0x0B;
+const uint8_t DESTINATION_OUTPUT = 1;
+const uint8_t DESTINATION_ALL = 255;
+// Packets dropped in a row before following the sender anyway, e.g. after it
+// restarted its numbering.
+const uint8_t MAX_REJECTED = 3;
+
+uint32_t readU32BE(const uint8_t *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+} // namespace
+
+// Constructor
+UdpStream::UdpStream(Spotlight *spotlight)
+    : _spotlight(spotlight), _lastSequence(0), _rejected(0) {}
+
+void UdpStream::begin() { _udp.begin(Constants::STREAM_PORT); }
+
+void UdpStream::update() {
+  for (size_t i = 0; i < Constants::STREAM_PACKETS_PER_UPDATE; ++i) {
+    int size = _udp.parsePacket();
+    if (size <= 0) {
+      return;
+    }
+    handlePacket(size);
+  }
+}
+
+void UdpStream::handlePacket(size_t size) {
+  uint8_t header[HEADER_SIZE];
+  if (size < HEADER_SIZE ||
+      _udp.read(header, HEADER_SIZE) != static_cast<int>(HEADER_SIZE)) {
+    return;
+  }
+  uint8_t flags = header[0];
+  if ((flags & FLAG_VERSION_MASK) != FLAG_VERSION_1 ||
+      (flags & FLAG_NOT_DATA) != 0 ||
+      (header[2] != TYPE_UNDEFINED && header[2] != TYPE_RGB8) ||
+      (header[3] != DESTINATION_OUTPUT && header[3] != DESTINATION_ALL)) {
+    return;
+  }
+  size_t dataStart = HEADER_SIZE;
+  if (flags & FLAG_TIMECODE) {
+    // Frames are shown as they arrive, the timecode isn't needed.
+    uint8_t timecode[TIMECODE_SIZE];
+    if (_udp.read(timecode, TIMECODE_SIZE) !=
+        static_cast<int>(TIMECODE_SIZE)) {
+      return;
+    }
+    dataStart += TIMECODE_SIZE;
+  }
+  size_t length = (header[8] << 8) | header[9];
+  if (length > size - dataStart || !acceptSequence(header[1] & 0x0F)) {
+    return;
+  }
+  TRACE_SCOPE(Trace::StreamPacket);
+  _spotlight->streamChannels(readU32BE(header + 4), _udp, length);
+}
+
+// Checks that a packet is newer than the last one applied. The numbers
+// count 1-15 and wrap around, so half of the cycle counts as ahead.
+bool UdpStream::acceptSequence(uint8_t sequence) {
+  if (sequence == 0 || _lastSequence == 0 || !_spotlight->isStreaming() ||
+      _rejected >= MAX_REJECTED) {
+    _lastSequence = sequence;
+    _rejected = 0;
+    return true;
+  }
+  uint8_t ahead = (sequence + 15 - _lastSequence) % 15;
+  if (ahead == 0 || ahead > 7) {
+    _rejected++; // A duplicate or a late packet.
+    return false;
+  }
+  _lastSequence = sequence;
+  _rejected = 0;
+  return true;
+}
@@ -7,22 +7,55 @@
  */
 
 #include <Arduino.h>
+#include "Log.h"
+#include "Metrics.h"
+#include "Output.h"
 #include "Spotlight.h"
 #include "SpotlightServer.h"
+#include "StateStore.h"
+#include "StripOutput.h"
+#include "Trace.h"
+#include "ClockSync.h"
+#include "GroupControl.h"
+#include "UdpStream.h"
 #include "pins_arduino.h"
 
-// Define the pins for your RGB LEDs.
+// Define the outputs of your RGB LEDs, one per fixture.
 // You must connect the anodes of the LEDs to VCC and the cathodes to the
-// respective pins through a resistor.
-const int RED_PIN = D5;
-const int GREEN_PIN = D6;
-const int BLUE_PIN = D7;
+// respective pins through a resistor. Fixtures on PCA9685 boards (SDA D2,
+// SCL D1) are given by channel, counted across the chain of boards. A
+// WS2812 strip takes its data from the RX pin.
+PwmOutput spotOutput(D5, D6, D7);
+// Pca9685 pca9685;
+// Pca9685Output pcaOutput(pca9685, 0, 1, 2);
+// StripOutput stripOutput(60);
+
+Output *const OUTPUTS[] = {
+    &spotOutput,
+    // &pcaOutput,
+    // &stripOutput,
+};
 
 // Create instances of the Spotlight and SpotlightServer classes.
 // The SpotlightServer is passed a reference to the Spotlight object
-// so it can control the hardware.
-Spotlight spotlight(RED_PIN, GREEN_PIN, BLUE_PIN);
-SpotlightServer spotlightServer(&spotlight);
+// so it can control the hardware, and to the metrics it serves at /metrics.
+Metrics metrics;
+Spotlight spotlight(OUTPUTS, sizeof(OUTPUTS) / sizeof(OUTPUTS[0]));
+SpotlightServer spotlightServer(&spotlight, &metrics);
+// Keeps the state of the spotlight across reboots.
+StateStore stateStore(&spotlight);
+// Real-time colors streamed by show control software over DDP.
+UdpStream udpStream(&spotlight);
+// Keeps the modes in phase with the other spotlights on the network.
+ClockSync clockSync(&spotlight);
+// Applies the commands sent to the whole fleet, or groups of it.
+GroupControl groupControl(&spotlight);
+
+// Checks whether the network has input for the next pass of the loop.
+bool hasPendingInput() {
+  return spotlightServer.hasPendingRequest() || udpStream.hasPacket() ||
+         clockSync.hasPacket() || groupControl.hasPacket();
+}
 
 /**
  * @brief Arduino setup function.
@@ -31,18 +64,26 @@ SpotlightServer spotlightServer(&spotlight);
  * serial communication, the spotlight hardware, and the web server.
  */
 void setup() {
-  // Initialize Serial communication for debugging output.
+  // Initialize Serial communication for debugging output. This has to come
+  // before spotlight.begin(), a strip output takes over the RX pin.
   Serial.begin(115200);
-  Serial.println("\nSpotlight Controller starting up...");
+  Serial.println();
+  LOG_INFO("Spotlight Controller starting up...");
 
-  // Initialize the spotlight's hardware pins.
+  // Initialize the spotlight's outputs.
   spotlight.begin();
 
-  // Start the web server and connect to WiFi.
-  // This function also initializes LittleFS and mDNS.
+  // Restore the state before the first frame, so the light fades back in
+  // right away instead of waiting for WiFi.
+  stateStore.begin();
+
+  // Start the web server. WiFi and mDNS come up in the background, from
+  // spotlightServer.update().
   spotlightServer.begin();
+  udpStream.begin();
 
-  Serial.println("Setup complete. Ready to serve clients.");
+  LOG_INFO("Setup complete. Ready to serve clients.");
+  Log::flush();
 }
 
 /**
@@ -56,7 +97,37 @@ void loop() {
   // Handle any incoming HTTP requests. This must be called frequently.
   spotlightServer.update();
 
+  // Read the streamed colors, they are shown from the next frame.
+  udpStream.update();
+  clockSync.update();
+  groupControl.update();
+
   // Update the spotlight's animation state. This handles all
   // smooth color transitions and animations without using delay().
+  // Frames are rendered at a fixed rate, so most calls return immediately
+  // and leave the CPU to the web server.
+  unsigned long start = micros();
   spotlight.update();
+  metrics.recordUpdate(micros() - start);
+
+  metrics.countLoop();
+
+  // Save the state once it stopped changing.
+  stateStore.update();
+
+  // Write the buffered log lines that fit into the UART FIFO.
+  Log::drain();
+
+  // Dump the traces on request, in tracing builds only (see Trace.h).
+  TRACE_POLL_SERIAL();
+
+  // Nothing moves, so there's no frame to keep up with. Hand the CPU to the
+  // SDK for a while instead of spinning, the network is served meanwhile.
+  // The delay ends early once a packet or a request is waiting.
+  if (spotlight.isIdle()) {
+    for (unsigned long i = 0;
+         i < Constants::IDLE_LOOP_DELAY && !hasPendingInput(); ++i) {
+      delay(1);
+    }
+  }
 }
@@ -0,0 +1,38 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal stand-in for the Arduino core in the native test builds.
+ *
+ * Only provides what ColorSpace and Easing use, so they compile unchanged on
+ * the host (see env:native in platformio.ini).
+ */
+
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+// Flash and RAM share one address space on the host.
+#define PROGMEM
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t *>(addr))
+#define pgm_read_dword(addr) (*reinterpret_cast<const uint32_t *>(addr))
+
+class String {
+public:
+  String(const char *s = "") : _s(s) {}
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return _s.length(); }
+
+private:
+  std::string _s;
+};
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file test_main.cpp
+ * @brief Accuracy tests of the fixed point and lookup table fast paths
+ * against the float reference implementations.
+ *
+ * Runs on the host (`pio test -e native`) and on the device
+ * (`pio test -e nodemcuv2_bench`).
+ */
+
+#include "ColorSpace.h"
+#include "Easing.h"
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace ColorSpace;
+
+namespace {
+// Largest allowed difference of an 8-bit channel. The fast paths round
+// where the float code truncates, which costs up to one step.
+const int kMaxChannelError = 1;
+
+// Largest allowed difference of an eased value per function, at the
+// default EASING_TABLE_BITS. The linear interpolation between the table
+// entries is worst where a curve bends sharply: circ is vertical at the
+// midpoint and bounce has a kink at each bounce.
+const float kMaxEasingError[Easing::EASING_FUNCTION_COUNT] = {
+    0.0001f, // linear
+    0.0005f, // sine-in-out
+    0.0005f, // quad-in-out
+    0.0005f, // cubic-in-out
+    0.0005f, // quart-in-out
+    0.0005f, // quint-in-out
+    0.02f,   // circ-in-out
+    0.001f,  // elastic-in-out
+    0.0005f, // back-in-out
+    0.01f    // bounce-in-out
+};
+
+// A deterministic spread of test colors, including the corners of the cube.
+RGB testColor(uint32_t i) {
+  static const RGB corners[] = {{0, 0, 0},     {255, 255, 255}, {255, 0, 0},
+                                {0, 255, 0},   {0, 0, 255},     {255, 255, 0},
+                                {0, 255, 255}, {255, 0, 255}};
+  const size_t cornerCount = sizeof(corners) / sizeof(corners[0]);
+  if (i < cornerCount) {
+    return corners[i];
+  }
+  uint32_t x = i * 2654435761u;
+  return {static_cast<uint8_t>(x >> 24), static_cast<uint8_t>(x >> 16),
+          static_cast<uint8_t>(x >> 8)};
+}
+
+// A deterministic spread of LCH colors the float lchToRgb() is defined for,
+// i.e. whose chroma maps to a saturation of at most 1.
+LCH testLch(uint32_t i) {
+  uint32_t x = i * 2654435761u;
+  float l = (x >> 24) / 255.0f;
+  float maxChroma = 2.0f * std::min(l, 1.0f - l);
+  float c = maxChroma * ((x >> 16) & 0xFF) / 255.0f;
+  float h = 360.0f * ((x >> 4) & 0xFFF) / 4096.0f;
+  return {l, c, h};
+}
+
+int channelError(const RGB &a, const RGB &b) {
+  return std::max({std::abs(a.r - b.r), std::abs(a.g - b.g),
+                   std::abs(a.b - b.b)});
+}
+
+void reportError(const char *name, double error) {
+  char message[64];
+  snprintf(message, sizeof(message), "%s: max error %.5f", name, error);
+  TEST_MESSAGE(message);
+}
+} // namespace
+
+void test_fx_lch_to_rgb_matches_float() {
+  int maxError = 0;
+  for (uint32_t i = 0; i < 4096; ++i) {
+    LCH lch = testLch(i);
+    RGB reference = lchToRgb(lch);
+    RGB fast = fx::toRgb8(fx::lchToRgb(fx::fromLch(lch)));
+    maxError = std::max(maxError, channelError(reference, fast));
+  }
+  reportError("fx::lchToRgb", maxError);
+  TEST_ASSERT_LESS_OR_EQUAL_INT(kMaxChannelError, maxError);
+}
+
+void test_fx_hsv_to_rgb_matches_float() {
+  int maxError = 0;
+  for (uint32_t i = 0; i < 4096; ++i) {
+    float h, s, v;
+    rgbToHsv(testColor(i), h, s, v);
+    RGB reference = hsvToRgb(h, s, v);
+    RGB fast = fx::toRgb8(fx::hsvToRgb(
+        fx::hueFromDegrees(h), static_cast<uint16_t>(s * 65535.0f + 0.5f),
+        static_cast<uint16_t>(v * 65535.0f + 0.5f)));
+    maxError = std::max(maxError, channelError(reference, fast));
+  }
+  reportError("fx::hsvToRgb", maxError);
+  TEST_ASSERT_LESS_OR_EQUAL_INT(kMaxChannelError, maxError);
+}
+
+void test_fx_interpolate_matches_float() {
+  // Compared at the RGB output, the way the renderer uses it.
+  int maxError = 0;
+  for (uint32_t i = 0; i < 512; ++i) {
+    LCH a = testLch(i);
+    LCH b = testLch(i + 512);
+    fx::LCH fa = fx::fromLch(a);
+    fx::LCH fb = fx::fromLch(b);
+    for (int32_t step = 0; step <= 16; ++step) {
+      float t = step / 16.0f;
+      LCH mixed = a + (b - a) * t;
+      RGB reference = fx::toRgb8(fx::lchToRgb(fx::fromLch(mixed)));
+      RGB fast = fx::toRgb8(fx::lchToRgb(
+          fx::interpolate(fa, fb, step * (Easing::Q16_ONE / 16))));
+      maxError = std::max(maxError, channelError(reference, fast));
+    }
+  }
+  reportError("fx::interpolate", maxError);
+  TEST_ASSERT_LESS_OR_EQUAL_INT(kMaxChannelError, maxError);
+}
+
+void test_fx_oklch_to_rgb_matches_float() {
+  // Spread over the whole fixed point range, including colors outside of
+  // the gamut, which both clip.
+  int maxError = 0;
+  for (uint32_t i = 0; i < 4096; ++i) {
+    uint32_t x = i * 2654435761u;
+    LCH lch = {(x >> 24) / 255.0f,
+               OKLCH_MAX_CHROMA * ((x >> 16) & 0xFF) / 255.0f,
+               360.0f * ((x >> 4) & 0xFFF) / 4096.0f};
+    if (lch.c < 0.002f) {
+      continue; // Taken as gray by fx::fromOklch().
+    }
+    RGB reference = oklchToRgb(lch);
+    RGB fast = fx::toRgb8(fx::oklchToRgb(fx::fromOklch(lch)));
+    maxError = std::max(maxError, channelError(reference, fast));
+  }
+  reportError("fx::oklchToRgb", maxError);
+  TEST_ASSERT_LESS_OR_EQUAL_INT(kMaxChannelError, maxError);
+}
+
+void test_fx_oklch_round_trip() {
+  // The colors set with setRGB() must come out again at the end of their
+  // transition.
+  int maxError = 0;
+  for (uint32_t i = 0; i < 4096; ++i) {
+    RGB rgb = testColor(i);
+    RGB back = fx::toRgb8(
+        fx::lchToRgb(fx::fromRgb(rgb, Interpolation::Oklch),
+                     Interpolation::Oklch));
+    maxError = std::max(maxError, channelError(rgb, back));
+  }
+  reportError("fx::fromRgb+oklchToRgb", maxError);
+  TEST_ASSERT_LESS_OR_EQUAL_INT(kMaxChannelError, maxError);
+}
+
+void test_fx_interpolate_oklch_hue() {
+  fx::LCH red = fx::fromRgb({255, 0, 0}, Interpolation::Oklch);
+  fx::LCH blue = fx::fromRgb({0, 0, 255}, Interpolation::Oklch);
+  fx::LCH white = fx::fromRgb({255, 255, 255}, Interpolation::Oklch);
+  TEST_ASSERT_EQUAL_INT(0, white.c);
+
+  // Red (29 degrees) to blue (264 degrees) goes the shorter way, through
+  // magenta.
+  fx::LCH mid = fx::interpolateOklch(red, blue, Easing::Q16_ONE / 2);
+  int16_t expected = static_cast<int16_t>(
+      red.h + static_cast<int16_t>(blue.h - red.h) / 2);
+  TEST_ASSERT_LESS_OR_EQUAL_INT(
+      1, std::abs(static_cast<int16_t>(mid.h - expected)));
+  RGB magenta = fx::toRgb8(fx::oklchToRgb(mid));
+  TEST_ASSERT_TRUE(magenta.r > magenta.g && magenta.b > magenta.g);
+
+  // Fading to white keeps the hue of the color.
+  for (int32_t step = 1; step < 16; ++step) {
+    mid = fx::interpolateOklch(red, white, step * (Easing::Q16_ONE / 16));
+    TEST_ASSERT_EQUAL_INT(red.h, mid.h);
+  }
+}
+
+void test_fx_rgb16_round_trip() {
+  for (uint32_t i = 0; i < 256; ++i) {
+    RGB rgb = testColor(i);
+    RGB back = fx::toRgb8(fx::toRgb16(rgb));
+    TEST_ASSERT_EQUAL_INT(0, channelError(rgb, back));
+  }
+}
+
+void test_easing_tables_match_float() {
+  static const char *const names[Easing::EASING_FUNCTION_COUNT] = {
+      "linear",        "sine-in-out",    "quad-in-out",  "cubic-in-out",
+      "quart-in-out",  "quint-in-out",   "circ-in-out",  "elastic-in-out",
+      "back-in-out",   "bounce-in-out"};
+  const uint32_t samples = 4096;
+  for (size_t f = 0; f < Easing::EASING_FUNCTION_COUNT; ++f) {
+    Easing::EasingFunction func = static_cast<Easing::EasingFunction>(f);
+    float maxError = 0.0f;
+    for (uint32_t i = 0; i <= samples; ++i) {
+      uint32_t tQ16 = i * (Easing::Q16_ONE / samples);
+      float reference =
+          Easing::getEasedValue(func, static_cast<float>(tQ16) / 65536.0f);
+      float fast = Easing::getEasedValueQ16(func, tQ16) / 65536.0f;
+      maxError = std::max(maxError, std::fabs(reference - fast));
+    }
+    reportError(names[f], maxError);
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(kMaxEasingError[f], maxError);
+  }
+}
+
+void test_easing_tables_hit_endpoints() {
+  for (size_t f = 0; f < Easing::EASING_FUNCTION_COUNT; ++f) {
+    Easing::EasingFunction func = static_cast<Easing::EasingFunction>(f);
+    TEST_ASSERT_EQUAL_INT32(0, Easing::getEasedValueQ16(func, 0));
+    TEST_ASSERT_EQUAL_INT32(Easing::Q16_ONE,
+                            Easing::getEasedValueQ16(func, Easing::Q16_ONE));
+    // Values past the end are clamped.
+    TEST_ASSERT_EQUAL_INT32(
+        Easing::Q16_ONE, Easing::getEasedValueQ16(func, 2 * Easing::Q16_ONE));
+  }
+}
+
+void test_easing_names_round_trip() {
+  for (size_t f = 0; f < Easing::EASING_FUNCTION_COUNT; ++f) {
+    Easing::EasingFunction func = static_cast<Easing::EasingFunction>(f);
+    const char *name = Easing::easingName(func);
+    TEST_ASSERT_EQUAL_INT(func, Easing::easingFromString(name, strlen(name)));
+  }
+}
+
+int runTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fx_lch_to_rgb_matches_float);
+  RUN_TEST(test_fx_hsv_to_rgb_matches_float);
+  RUN_TEST(test_fx_interpolate_matches_float);
+  RUN_TEST(test_fx_oklch_to_rgb_matches_float);
+  RUN_TEST(test_fx_oklch_round_trip);
+  RUN_TEST(test_fx_interpolate_oklch_hue);
+  RUN_TEST(test_fx_rgb16_round_trip);
+  RUN_TEST(test_easing_tables_match_float);
+  RUN_TEST(test_easing_tables_hit_endpoints);
+  RUN_TEST(test_easing_names_round_trip);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+  // Give the test runner time to open the serial port.
+  delay(2000);
+  runTests();
+}
+
+void loop() {}
+#else
+int main() { return runTests(); }
+#endif
@@ -0,0 +1,221 @@
+/**
+ * @file test_main.cpp
+ * @brief Throughput benchmarks of the color conversions and easing
+ * functions.
+ *
+ * On the host (`pio test -e native -v`) each result is reported in ns/op
+ * and ops/s, on the device (`pio test -e nodemcuv2_bench -v`) in CPU cycles
+ * per call. On the device, where floating point math is emulated, the fast
+ * paths must also beat the float code they replace.
+ */
+
+#include "ColorSpace.h"
+#include "Easing.h"
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace ColorSpace;
+
+namespace {
+#ifdef ARDUINO
+// Soft float conversions take thousands of cycles, so fewer iterations keep
+// each benchmark well below the watchdog timeout.
+const uint32_t kIterations = 2000;
+
+uint32_t now() { return ESP.getCycleCount(); }
+
+void report(const char *name, uint32_t ticks) {
+  char message[80];
+  snprintf(message, sizeof(message), "%-28s %8.1f cycles/call", name,
+           static_cast<double>(ticks) / kIterations);
+  TEST_MESSAGE(message);
+  yield();
+}
+#else
+const uint32_t kIterations = 1000000;
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void report(const char *name, uint64_t ticks) {
+  double nsPerOp = static_cast<double>(ticks) / kIterations;
+  char message[80];
+  snprintf(message, sizeof(message), "%-28s %8.2f ns/op %12.0f ops/s", name,
+           nsPerOp, 1e9 / nsPerOp);
+  TEST_MESSAGE(message);
+}
+#endif
+
+// Inputs are cycled through a small table, so the compiler can't fold the
+// calls and the branches see realistic data.
+const size_t kInputCount = 64;
+RGB rgbInputs[kInputCount];
+LCH lchInputs[kInputCount];
+fx::LCH fxLchInputs[kInputCount];
+LCH oklchInputs[kInputCount];
+fx::LCH fxOklchInputs[kInputCount];
+float hueInputs[kInputCount];
+uint16_t fxHueInputs[kInputCount];
+float kelvinInputs[kInputCount];
+float timeInputs[kInputCount];
+uint32_t fxTimeInputs[kInputCount];
+
+// Results are folded into this, so the calls aren't optimized away.
+volatile uint32_t sink;
+
+void prepareInputs() {
+  for (size_t i = 0; i < kInputCount; ++i) {
+    uint32_t x = (i + 1) * 2654435761u;
+    rgbInputs[i] = {static_cast<uint8_t>(x >> 24),
+                    static_cast<uint8_t>(x >> 16),
+                    static_cast<uint8_t>(x >> 8)};
+    // Chroma stays in the range the float lchToRgb() is defined for.
+    float l = ((x >> 4) & 0xFF) / 255.0f;
+    float c = 2.0f * std::min(l, 1.0f - l) * (x & 0xF) / 15.0f;
+    lchInputs[i] = {l, c, 360.0f * i / kInputCount};
+    fxLchInputs[i] = fx::fromLch(lchInputs[i]);
+    oklchInputs[i] = rgbToOklch(rgbInputs[i]);
+    fxOklchInputs[i] = fx::fromOklch(oklchInputs[i]);
+    hueInputs[i] = 360.0f * i / kInputCount;
+    fxHueInputs[i] = fx::hueFromDegrees(hueInputs[i]);
+    kelvinInputs[i] = 1500.0f + 8500.0f * i / kInputCount;
+    timeInputs[i] = static_cast<float>(i) / kInputCount;
+    fxTimeInputs[i] = static_cast<uint32_t>(Easing::Q16_ONE * i / kInputCount);
+  }
+}
+
+// Runs `op` for every iteration and returns the elapsed ticks.
+template <typename Op> decltype(now()) measure(Op op) {
+  uint32_t accumulator = 0;
+  auto start = now();
+  for (uint32_t i = 0; i < kIterations; ++i) {
+    accumulator += op(i % kInputCount);
+  }
+  auto elapsed = now() - start;
+  sink = accumulator;
+  return elapsed;
+}
+
+uint32_t fold(const RGB &rgb) { return rgb.r + rgb.g + rgb.b; }
+uint32_t fold(const RGB16 &rgb) { return rgb.r + rgb.g + rgb.b; }
+uint32_t fold(const LCH &lch) {
+  return static_cast<uint32_t>(lch.l + lch.c + lch.h);
+}
+} // namespace
+
+void test_color_conversions() {
+  report("rgbToLch", measure([](size_t i) {
+           return fold(rgbToLch(rgbInputs[i]));
+         }));
+
+  auto lchFloat =
+      measure([](size_t i) { return fold(lchToRgb(lchInputs[i])); });
+  report("lchToRgb", lchFloat);
+  auto lchFast =
+      measure([](size_t i) { return fold(fx::lchToRgb(fxLchInputs[i])); });
+  report("fx::lchToRgb", lchFast);
+
+  auto hsvFloat = measure(
+      [](size_t i) { return fold(hsvToRgb(hueInputs[i], 1.0f, 0.75f)); });
+  report("hsvToRgb", hsvFloat);
+  auto hsvFast = measure([](size_t i) {
+    return fold(fx::hsvToRgb(fxHueInputs[i], 65535, 49151));
+  });
+  report("fx::hsvToRgb", hsvFast);
+
+  report("kelvinToRgb", measure([](size_t i) {
+           return fold(kelvinToRgb(kelvinInputs[i]));
+         }));
+
+  report("fx::interpolate+lchToRgb", measure([](size_t i) {
+           return fold(fx::lchToRgb(fx::interpolate(
+               fxLchInputs[i], fxLchInputs[(i + 1) % kInputCount],
+               fxTimeInputs[i])));
+         }));
+
+  report("rgbToOklch", measure([](size_t i) {
+           return fold(rgbToOklch(rgbInputs[i]));
+         }));
+
+  auto oklchFloat =
+      measure([](size_t i) { return fold(oklchToRgb(oklchInputs[i])); });
+  report("oklchToRgb", oklchFloat);
+  auto oklchFast = measure(
+      [](size_t i) { return fold(fx::oklchToRgb(fxOklchInputs[i])); });
+  report("fx::oklchToRgb", oklchFast);
+
+  report("fx::interpolateOklch+toRgb", measure([](size_t i) {
+           return fold(fx::oklchToRgb(fx::interpolateOklch(
+               fxOklchInputs[i], fxOklchInputs[(i + 1) % kInputCount],
+               fxTimeInputs[i])));
+         }));
+
+#ifdef ARDUINO
+  TEST_ASSERT_TRUE_MESSAGE(lchFast < lchFloat, "fx::lchToRgb got slower");
+  TEST_ASSERT_TRUE_MESSAGE(oklchFast < oklchFloat,
+                           "fx::oklchToRgb got slower");
+  TEST_ASSERT_TRUE_MESSAGE(hsvFast < hsvFloat, "fx::hsvToRgb got slower");
+#endif
+}
+
+void test_easing_functions() {
+  static const char *const names[Easing::EASING_FUNCTION_COUNT] = {
+      "linear",        "sine-in-out",    "quad-in-out",  "cubic-in-out",
+      "quart-in-out",  "quint-in-out",   "circ-in-out",  "elastic-in-out",
+      "back-in-out",   "bounce-in-out"};
+  for (size_t f = 0; f < Easing::EASING_FUNCTION_COUNT; ++f) {
+    Easing::EasingFunction func = static_cast<Easing::EasingFunction>(f);
+    auto floatTicks = measure([func](size_t i) {
+      return static_cast<uint32_t>(
+          Easing::getEasedValue(func, timeInputs[i]) * 65536.0f);
+    });
+    report(names[f], floatTicks);
+
+    auto fastTicks = measure([func](size_t i) {
+      return static_cast<uint32_t>(
+          Easing::getEasedValueQ16(func, fxTimeInputs[i]));
+    });
+    char name[32];
+    snprintf(name, sizeof(name), "%s (Q16)", names[f]);
+    report(name, fastTicks);
+
+#ifdef ARDUINO
+    // Linear is a plain return in float, there's nothing to beat.
+    if (func != Easing::Linear) {
+      TEST_ASSERT_TRUE_MESSAGE(fastTicks < floatTicks,
+                               "getEasedValueQ16 got slower");
+    }
+#endif
+  }
+}
+
+int runTests() {
+  prepareInputs();
+  UNITY_BEGIN();
+  RUN_TEST(test_color_conversions);
+  RUN_TEST(test_easing_functions);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+  // Give the test runner time to open the serial port.
+  delay(2000);
+  runTests();
+}
+
+void loop() {}
+#else
+int main() { return runTests(); }
+#endif